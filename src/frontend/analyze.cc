@@ -0,0 +1,364 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "log_analysis.hh"
+#include "exception.hh"
+#include "ezio.hh"
+
+using namespace std;
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " [OPTION]... LOGFILE..." << endl;
+    cerr << endl;
+    cerr << "Options = --ms-per-bin=NUMBER (default 500)" << endl;
+    cerr << "          --csv --json --svg (write LOGFILE.csv, LOGFILE.json, LOGFILE.svg)" << endl;
+    cerr << "          --jobs=NUMBER (logs analyzed at once, default one per core)" << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+static double bin_rate( const uint64_t bits, const unsigned int ms_per_bin )
+{
+    return bits / (ms_per_bin / 1000.0) / 1000000.0;
+}
+
+static string summary( const LogAnalysis & analysis )
+{
+    ostringstream out;
+    out << fixed;
+
+    const double capacity = analysis.average_capacity();
+    const double throughput = analysis.average_throughput();
+
+    out << analysis.filename() << ":" << endl;
+    out << setprecision( 2 );
+    out << "  Average capacity: " << capacity << " Mbits/s" << endl;
+    out << "  Average throughput: " << throughput << " Mbits/s ("
+        << setprecision( 1 ) << (capacity > 0 ? 100.0 * throughput / capacity : 0.0) << "% utilization)" << endl;
+    out << setprecision( 2 );
+    out << "  Average ingress: " << analysis.average_ingress() << " Mbits/s" << endl;
+    out << "  Per-packet queueing delay: median " << analysis.delay_median() << " ms, 95th percentile "
+        << analysis.delay_percentile() << " ms, 99th percentile " << analysis.delay_99th() << " ms" << endl;
+    out << "  95th percentile signal delay: " << analysis.signal_delay_percentile() << " ms" << endl;
+    out << "  Drops: " << analysis.packets_dropped() << " packets (" << analysis.bytes_dropped() << " bytes)" << endl;
+
+    return out.str();
+}
+
+/* one row per bin: time, rates, and the bits that have arrived but not left */
+static void for_each_bin( const LogAnalysis & analysis,
+                          const function<void( double, double, double, double, int64_t )> & row )
+{
+    int64_t occupancy = 0;
+    uint64_t number = analysis.first_bin();
+
+    for ( const auto & bin : analysis.bins() ) {
+        occupancy += bin.arrivals;
+        occupancy -= bin.departures;
+
+        row( number * analysis.ms_per_bin() / 1000.0,
+             bin_rate( bin.capacity, analysis.ms_per_bin() ),
+             bin_rate( bin.arrivals, analysis.ms_per_bin() ),
+             bin_rate( bin.departures, analysis.ms_per_bin() ),
+             occupancy );
+
+        number++;
+    }
+}
+
+static ofstream open_output( const string & filename )
+{
+    ofstream out( filename );
+    if ( not out.good() ) {
+        throw runtime_error( filename + ": error opening for writing" );
+    }
+    return out;
+}
+
+static void write_csv( const LogAnalysis & analysis, const string & filename )
+{
+    ofstream out = open_output( filename );
+
+    out << "time_s,capacity_mbps,ingress_mbps,egress_mbps,queue_bits\n";
+    for_each_bin( analysis, [&] ( double t, double capacity, double ingress, double egress, int64_t queue ) {
+            out << t << "," << capacity << "," << ingress << "," << egress << "," << queue << "\n";
+        } );
+}
+
+static string json_string( const string & str )
+{
+    ostringstream out;
+    out << '"';
+    for ( const unsigned char ch : str ) {
+        if ( ch == '"' or ch == '\\' ) {
+            out << '\\' << ch;
+        } else if ( ch < 0x20 ) {
+            out << "\\u" << hex << setw( 4 ) << setfill( '0' ) << int( ch ) << dec;
+        } else {
+            out << ch;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+static void write_json( const LogAnalysis & analysis, const string & filename )
+{
+    ofstream out = open_output( filename );
+
+    out << "{\n";
+    out << "  \"file\": " << json_string( analysis.filename() ) << ",\n";
+    out << "  \"ms_per_bin\": " << analysis.ms_per_bin() << ",\n";
+    out << "  \"first_timestamp_ms\": " << analysis.first_timestamp() << ",\n";
+    out << "  \"last_timestamp_ms\": " << analysis.last_timestamp() << ",\n";
+    out << "  \"capacity_mbps\": " << analysis.average_capacity() << ",\n";
+    out << "  \"ingress_mbps\": " << analysis.average_ingress() << ",\n";
+    out << "  \"throughput_mbps\": " << analysis.average_throughput() << ",\n";
+    out << "  \"delay_ms\": { \"median\": " << analysis.delay_median()
+        << ", \"p95\": " << analysis.delay_percentile()
+        << ", \"p99\": " << analysis.delay_99th() << " },\n";
+    out << "  \"signal_delay_p95_ms\": " << analysis.signal_delay_percentile() << ",\n";
+    out << "  \"drops\": { \"packets\": " << analysis.packets_dropped()
+        << ", \"bytes\": " << analysis.bytes_dropped() << " },\n";
+    out << "  \"bins\": [";
+
+    bool first = true;
+    for_each_bin( analysis, [&] ( double t, double capacity, double ingress, double egress, int64_t queue ) {
+            out << (first ? "\n" : ",\n") << "    [" << t << ", " << capacity << ", " << ingress
+                << ", " << egress << ", " << queue << "]";
+            first = false;
+        } );
+
+    out << "\n  ]\n}\n";
+}
+
+/* SVG: throughput (as mm-throughput-graph draws it) above signal delay */
+class SVGPlot
+{
+private:
+    ostream & out_;
+    double left_, top_, width_, height_;
+    double x_min_, x_max_, y_max_;
+
+public:
+    SVGPlot( ostream & out, const double top, const double height,
+             const double x_min, const double x_max, const double y_max )
+        : out_( out ), left_( 70 ), top_( top ), width_( 920 ), height_( height ),
+          x_min_( x_min ), x_max_( x_max > x_min ? x_max : x_min + 1 ), y_max_( y_max > 0 ? y_max : 1 )
+    {}
+
+    double x( const double value ) const { return left_ + width_ * (value - x_min_) / (x_max_ - x_min_); }
+    double y( const double value ) const { return top_ + height_ * (1 - min( value, y_max_ ) / y_max_); }
+
+    void axes( const string & y_label )
+    {
+        out_ << "<rect x='" << left_ << "' y='" << top_ << "' width='" << width_ << "' height='" << height_
+             << "' fill='none' stroke='black'/>\n";
+
+        for ( int i = 0; i <= 5; i++ ) {
+            const double xv = x_min_ + (x_max_ - x_min_) * i / 5, yv = y_max_ * i / 5;
+            out_ << "<text x='" << x( xv ) << "' y='" << top_ + height_ + 16
+                 << "' text-anchor='middle'>" << setprecision( 4 ) << xv << "</text>\n";
+            out_ << "<text x='" << left_ - 6 << "' y='" << y( yv ) + 4
+                 << "' text-anchor='end'>" << setprecision( 4 ) << yv << "</text>\n";
+        }
+
+        out_ << "<text x='16' y='" << top_ + height_ / 2 << "' transform='rotate(-90 16 " << top_ + height_ / 2
+             << ")' text-anchor='middle'>" << y_label << "</text>\n";
+    }
+
+    void polyline( const vector< pair< double, double > > & points, const string & style )
+    {
+        out_ << "<polyline fill='none' " << style << " points='";
+        for ( const auto & point : points ) {
+            out_ << x( point.first ) << "," << y( point.second ) << " ";
+        }
+        out_ << "'/>\n";
+    }
+
+    void area( const vector< pair< double, double > > & points, const string & style )
+    {
+        if ( points.empty() ) {
+            return;
+        }
+
+        out_ << "<polygon " << style << " points='" << x( points.front().first ) << "," << y( 0 ) << " ";
+        for ( const auto & point : points ) {
+            out_ << x( point.first ) << "," << y( point.second ) << " ";
+        }
+        out_ << x( points.back().first ) << "," << y( 0 ) << "'/>\n";
+    }
+};
+
+static void write_svg( const LogAnalysis & analysis, const string & filename )
+{
+    vector< pair< double, double > > capacity, ingress, egress, signal;
+    double rate_max = 0;
+
+    for_each_bin( analysis, [&] ( double t, double c, double i, double e, int64_t ) {
+            capacity.emplace_back( t, c );
+            ingress.emplace_back( t, i );
+            egress.emplace_back( t, e );
+            rate_max = max( { rate_max, c, i, e } );
+        } );
+
+    /* the worst signal delay in each bin */
+    double delay_max = 0;
+    const auto & signal_delay = analysis.signal_delay();
+    for ( size_t i = 0; i < signal_delay.size(); i++ ) {
+        const uint64_t sent = analysis.first_send() + i;
+        const double t = (sent / analysis.ms_per_bin()) * analysis.ms_per_bin() / 1000.0;
+        if ( signal.empty() or signal.back().first != t ) {
+            signal.emplace_back( t, 0 );
+        }
+        signal.back().second = max( signal.back().second, double( signal_delay.at( i ) ) );
+        delay_max = max( delay_max, signal.back().second );
+    }
+
+    const double x_min = analysis.first_timestamp() / 1000.0, x_max = analysis.last_timestamp() / 1000.0;
+
+    ofstream out = open_output( filename );
+    out << fixed << setprecision( 2 );
+
+    out << "<?xml version='1.0' encoding='utf-8'?>\n"
+        << "<svg xmlns='http://www.w3.org/2000/svg' width='1024' height='640' font-family='Arial' font-size='12'>\n"
+        << "<rect width='100%' height='100%' fill='white'/>\n";
+
+    out << "<text x='512' y='20' text-anchor='middle'>"
+        << "Capacity (mean " << analysis.average_capacity() << " Mbits/s), "
+        << "<tspan fill='#0020a0'>traffic ingress (mean " << analysis.average_ingress() << " Mbits/s)</tspan>, "
+        << "<tspan fill='#ff6040'>traffic egress (mean " << analysis.average_throughput() << " Mbits/s)</tspan>"
+        << "</text>\n";
+
+    SVGPlot throughput( out, 35, 320, x_min, x_max, rate_max * 1.1 );
+    throughput.area( capacity, "fill='#c0c0ff' stroke='#8080ff' stroke-width='0.5'" );
+    throughput.polyline( ingress, "stroke='#0020a0' stroke-width='2'" );
+    throughput.polyline( egress, "stroke='#ff6040' stroke-width='1.5'" );
+    throughput.axes( "throughput (Mbits/s)" );
+
+    out << "<text x='512' y='395' text-anchor='middle'>"
+        << "Signal delay (95th percentile " << analysis.signal_delay_percentile() << " ms), "
+        << "95th percentile per-packet delay " << analysis.delay_percentile() << " ms</text>\n";
+
+    SVGPlot delay( out, 405, 200, x_min, x_max, delay_max * 1.1 );
+    delay.area( signal, "fill='#8080ff' fill-opacity='0.4'" );
+    delay.axes( "delay (ms)" );
+
+    out << "<text x='530' y='632' text-anchor='middle'>time (s)</text>\n";
+    out << "</svg>\n";
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        const option command_line_options[] = {
+            { "ms-per-bin", required_argument, nullptr, 'b' },
+            { "csv",              no_argument, nullptr, 'c' },
+            { "json",             no_argument, nullptr, 'j' },
+            { "svg",              no_argument, nullptr, 's' },
+            { "jobs",       required_argument, nullptr, 'p' },
+            { 0,                            0, nullptr, 0 }
+        };
+
+        unsigned int ms_per_bin = 500;
+        bool csv = false, json = false, svg = false;
+        unsigned int jobs = max( 1u, thread::hardware_concurrency() );
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'b':
+                ms_per_bin = myatoi( optarg );
+                break;
+            case 'c':
+                csv = true;
+                break;
+            case 'j':
+                json = true;
+                break;
+            case 's':
+                svg = true;
+                break;
+            case 'p':
+                jobs = myatoi( optarg );
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind >= argc or ms_per_bin == 0 or jobs == 0 ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const vector< string > logs( argv + optind, argv + argc );
+
+        /* each thread takes the next log not yet started */
+        atomic< size_t > next_log( 0 );
+        atomic< bool > failed( false );
+        mutex output_mutex;
+
+        auto worker = [&] () {
+            for ( size_t i = next_log++; i < logs.size(); i = next_log++ ) {
+                try {
+                    LogAnalysis analysis( logs.at( i ), ms_per_bin );
+                    analysis.read();
+
+                    if ( csv ) {
+                        write_csv( analysis, logs.at( i ) + ".csv" );
+                    }
+                    if ( json ) {
+                        write_json( analysis, logs.at( i ) + ".json" );
+                    }
+                    if ( svg ) {
+                        write_svg( analysis, logs.at( i ) + ".svg" );
+                    }
+
+                    const string text = summary( analysis );
+                    unique_lock<mutex> ul( output_mutex );
+                    cout << text << flush;
+                } catch ( const exception & e ) {
+                    unique_lock<mutex> ul( output_mutex );
+                    print_exception( e );
+                    failed = true;
+                }
+            }
+        };
+
+        vector< thread > threads;
+        for ( unsigned int i = 1; i < min( size_t( jobs ), logs.size() ); i++ ) {
+            threads.emplace_back( worker );
+        }
+
+        worker();
+
+        for ( auto & thread : threads ) {
+            thread.join();
+        }
+
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
@@ -7,16 +7,32 @@
 
 using namespace std;
 
-void DelayQueue::read_packet( const string & contents )
+void DelayQueue::read_packet( PacketBuffer && contents )
 {
-    packet_queue_.emplace( timestamp() + delay_ms_, contents );
+    packet_queue_.push( make_pair( timestamp_usecs() + delay_ms_ * 1000, move( contents ) ) );
 }
 
+/* Release times only increase, so the packets due are a run at the front
+   and one clock read releases them all. (A TUN device takes one packet
+   per write, so they still go out one write apiece.) */
 void DelayQueue::write_packets( FileDescriptor & fd )
 {
+    const uint64_t now = timestamp_usecs();
+
+    while ( (!packet_queue_.empty())
+            && (packet_queue_.front().first <= now) ) {
+        packet_queue_.front().second.write_to( fd );
+        packet_queue_.pop();
+    }
+}
+
+void DelayQueue::pass_packets( const function<void(PacketBuffer &&)> & next )
+{
+    const uint64_t now = timestamp_usecs();
+
     while ( (!packet_queue_.empty())
-            && (packet_queue_.front().first <= timestamp()) ) {
-        fd.write( packet_queue_.front().second );
+            && (packet_queue_.front().first <= now) ) {
+        next( move( packet_queue_.front().second ) );
         packet_queue_.pop();
     }
 }
@@ -24,10 +40,10 @@ void DelayQueue::write_packets( FileDescriptor & fd )
 unsigned int DelayQueue::wait_time( void ) const
 {
     if ( packet_queue_.empty() ) {
-        return numeric_limits<uint16_t>::max();
+        return numeric_limits<uint16_t>::max() * 1000;
     }
 
-    const auto now = timestamp();
+    const auto now = timestamp_usecs();
 
     if ( packet_queue_.front().first <= now ) {
         return 0;
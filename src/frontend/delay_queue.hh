@@ -3,29 +3,38 @@
 #ifndef DELAY_QUEUE_HH
 #define DELAY_QUEUE_HH
 
-#include <queue>
 #include <cstdint>
 #include <string>
+#include <functional>
 
 #include "file_descriptor.hh"
+#include "packet_buffer.hh"
+#include "ring_buffer.hh"
 
 class DelayQueue
 {
 private:
+    /* room for this many packets in flight before the ring first grows */
+    static const size_t INITIAL_SLOTS = 1024;
+
     uint64_t delay_ms_;
-    std::queue< std::pair<uint64_t, std::string> > packet_queue_;
-    /* release timestamp, contents */
+    RingBuffer< std::pair<uint64_t, PacketBuffer> > packet_queue_;
+    /* release timestamp (microseconds), contents */
 
 public:
-    DelayQueue( const uint64_t & s_delay_ms ) : delay_ms_( s_delay_ms ), packet_queue_() {}
+    DelayQueue( const uint64_t & s_delay_ms ) : delay_ms_( s_delay_ms ), packet_queue_( INITIAL_SLOTS ) {}
 
-    void read_packet( const std::string & contents );
+    void read_packet( PacketBuffer && contents );
 
     void write_packets( FileDescriptor & fd );
 
+    /* hand the packets that are ready to the next stage of a pipeline */
+    void pass_packets( const std::function<void(PacketBuffer &&)> & next );
+
+    /* microseconds until the next packet is due */
     unsigned int wait_time( void ) const;
 
-    bool pending_output( void ) const { return wait_time() <= 0; }
+    bool pending_output( void ) const { return wait_time() == 0; }
 
     static bool finished( void ) { return false; }
 };
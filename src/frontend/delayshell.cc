@@ -3,6 +3,8 @@
 #include <vector>
 #include <string>
 
+#include <getopt.h>
+
 #include "delay_queue.hh"
 #include "util.hh"
 #include "ezio.hh"
@@ -10,6 +12,11 @@
 
 using namespace std;
 
+void usage( const string & program_name )
+{
+    throw runtime_error( "Usage: " + program_name + " [--threads=N] delay-milliseconds [command...]" );
+}
+
 int main( int argc, char *argv[] )
 {
     try {
@@ -21,23 +28,50 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " delay-milliseconds [command...]" );
+        const option command_line_options[] = {
+            { "threads", required_argument, nullptr, 't' },
+            { 0,                         0, nullptr, 0 }
+        };
+
+        long int threads = 1;
+
+        while ( true ) {
+            /* stop at the delay, so the command keeps its options */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 't':
+                threads = myatoi( optarg );
+                break;
+            case '?':
+                usage( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 1 > argc or threads < 1 or threads > TunDevice::MAX_QUEUES ) {
+            usage( argv[ 0 ] );
         }
 
-        const uint64_t delay_ms = myatoi( argv[ 1 ] );
+        const uint64_t delay_ms = myatoi( argv[ optind ] );
 
         vector< string > command;
 
-        if ( argc == 2 ) {
+        if ( optind + 1 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = optind + 1; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
 
-        PacketShell<DelayQueue> delay_shell_app( "delay", user_environment, passthrough_until_signal );
+        PacketShell<DelayQueue> delay_shell_app( "delay", user_environment, passthrough_until_signal,
+                                                 false, threads );
 
         delay_shell_app.start_uplink( "[delay " + to_string( delay_ms ) + " ms] ",
                                       command,
@@ -0,0 +1,242 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <cstring>
+#include <chrono>
+
+#include "link_log.hh"
+#include "exception.hh"
+#include "varint.hh"
+
+using namespace std;
+
+static const string log_magic = "MMLINKL1";
+
+/* magic followed by the uint32 length of the text header */
+static const size_t preamble_size = 8 + sizeof( uint32_t );
+
+static string encode_u32( const uint32_t value )
+{
+    const uint32_t le = htole32( value );
+    return string( reinterpret_cast<const char *>( &le ), sizeof( le ) );
+}
+
+/* the mapping carries no alignment guarantee, so copy out */
+static uint32_t decode_u32( const char * data )
+{
+    uint32_t le;
+    memcpy( &le, data, sizeof( le ) );
+    return le32toh( le );
+}
+
+static bool has_extra( const char type )
+{
+    return type == '-' or type == 'd';
+}
+
+void append_text( const LinkLogRecord & record, string & out )
+{
+    out += to_string( record.time / 1000 );
+    out += ' ';
+    out += record.type;
+    out += ' ';
+    out += to_string( record.bytes );
+
+    if ( record.type == '-' ) {
+        out += ' ';
+        out += to_string( record.extra / 1000 );
+    } else if ( record.type == 'd' ) {
+        out += ' ';
+        out += to_string( record.extra );
+    }
+
+    out += '\n';
+}
+
+LinkLog::LinkLog( const string & filename, const bool binary, const string & header )
+    : binary_( binary ),
+      fd_( SystemCall( "open " + filename,
+                       open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                             S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH ) ) ),
+      last_time_( 0 ),
+      halt_( false )
+{
+    /* the block being filled is the ring's last */
+    for ( size_t i = 0; i < BLOCKS - 1; i++ ) {
+        empty_.emplace_back();
+        empty_.back().reserve( BLOCK_SIZE );
+    }
+
+    block_.reserve( BLOCK_SIZE );
+
+    if ( binary_ ) {
+        block_ = log_magic + encode_u32( header.size() );
+    }
+
+    block_ += header;
+
+    writer_ = thread( [&] () { write_loop(); } );
+}
+
+LinkLog::~LinkLog()
+{
+    {
+        unique_lock<mutex> ul( mutex_ );
+
+        try {
+            if ( not block_.empty() ) {
+                hand_off( ul );
+            }
+        } catch ( const exception & e ) {
+            print_exception( e );
+        }
+
+        halt_ = true;
+    }
+
+    not_empty_.notify_one();
+    writer_.join();
+}
+
+void LinkLog::append( const LinkLogRecord & record )
+{
+    unique_lock<mutex> ul( mutex_ );
+
+    if ( binary_ ) {
+        block_.push_back( record.type );
+        encode_varint( zigzag_encode( int64_t( record.time - last_time_ ) ), block_ );
+        encode_varint( record.bytes, block_ );
+        if ( has_extra( record.type ) ) {
+            encode_varint( record.extra, block_ );
+        }
+        last_time_ = record.time;
+    } else {
+        append_text( record, block_ );
+    }
+
+    if ( block_.size() >= BLOCK_SIZE - 128 ) {
+        hand_off( ul );
+    }
+}
+
+/* pass the block to the writer, and take the next empty one (waiting if the writer is behind) */
+void LinkLog::hand_off( unique_lock<mutex> & lock )
+{
+    block_free_.wait( lock, [&] () { return not empty_.empty(); } );
+
+    /* the writer may have taken the block while we waited */
+    if ( block_.empty() ) {
+        return;
+    }
+
+    full_.push_back( move( block_ ) );
+    block_ = move( empty_.front() );
+    empty_.pop_front();
+
+    not_empty_.notify_one();
+}
+
+void LinkLog::write_loop( void )
+{
+    unique_lock<mutex> ul( mutex_ );
+
+    while ( true ) {
+        const auto deadline = chrono::steady_clock::now() + chrono::microseconds( HAND_OFF_INTERVAL );
+
+        if ( not not_empty_.wait_until( ul, deadline, [&] () { return halt_ or not full_.empty(); } )
+             and not block_.empty() and not empty_.empty() ) {
+            /* nothing to write for a while, so take the block being filled */
+            full_.push_back( move( block_ ) );
+            block_ = move( empty_.front() );
+            empty_.pop_front();
+        }
+
+        if ( full_.empty() ) {
+            if ( halt_ ) {
+                return; /* everything has been written */
+            }
+            continue;
+        }
+
+        string block = move( full_.front() );
+        full_.pop_front();
+
+        ul.unlock();
+
+        try {
+            fd_.write( block );
+        } catch ( const exception & e ) {
+            print_exception( e );
+        }
+
+        block.clear();
+
+        ul.lock();
+        empty_.push_back( move( block ) );
+        block_free_.notify_one();
+    }
+}
+
+bool BinaryLinkLog::is_binary_log( const string & filename )
+{
+    struct stat file_info;
+    if ( stat( filename.c_str(), &file_info ) < 0 or not S_ISREG( file_info.st_mode ) ) {
+        return false;
+    }
+
+    FileDescriptor fd( SystemCall( "open " + filename, open( filename.c_str(), O_RDONLY ) ) );
+    return fd.read( log_magic.size() ) == log_magic;
+}
+
+BinaryLinkLog::BinaryLinkLog( const string & filename )
+    : filename_( filename ),
+      file_( filename ),
+      header_(),
+      offset_( preamble_size ),
+      time_( 0 )
+{
+    const char * const data = file_.data();
+
+    if ( file_.size() < preamble_size or string( data, log_magic.size() ) != log_magic ) {
+        throw runtime_error( filename_ + ": not a binary mm-link log" );
+    }
+
+    const uint32_t header_length = decode_u32( data + 8 );
+    if ( header_length > file_.size() - preamble_size ) {
+        throw runtime_error( filename_ + ": corrupt log header" );
+    }
+
+    header_.assign( data + preamble_size, header_length );
+    offset_ += header_length;
+}
+
+bool BinaryLinkLog::next( LinkLogRecord & record )
+{
+    const char * const data = file_.data();
+    size_t offset = offset_;
+
+    if ( offset == file_.size() ) {
+        return false;
+    }
+
+    const char type = data[ offset++ ];
+    if ( type != '+' and type != '-' and type != '#' and type != 'd' ) {
+        throw runtime_error( filename_ + ": corrupt log record at offset " + to_string( offset_ ) );
+    }
+
+    uint64_t time_change, bytes, extra = 0;
+    if ( not decode_varint( data, file_.size(), offset, time_change )
+         or not decode_varint( data, file_.size(), offset, bytes )
+         or ( has_extra( type ) and not decode_varint( data, file_.size(), offset, extra ) ) ) {
+        return false;
+    }
+
+    time_ += zigzag_decode( time_change );
+    offset_ = offset;
+
+    record = { type, time_, bytes, extra };
+    return true;
+}
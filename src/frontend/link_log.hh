@@ -0,0 +1,94 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef LINK_LOG_HH
+#define LINK_LOG_HH
+
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+
+#include "file_descriptor.hh"
+#include "mapped_file.hh"
+
+/* one event in an mm-link log (times in us) */
+struct LinkLogRecord
+{
+    char type;         /* + arrival, - departure, # delivery opportunity, d drop */
+    uint64_t time;
+    uint64_t bytes;    /* packets dropped, for a drop */
+    uint64_t extra;    /* delay of a departure, or bytes dropped */
+};
+
+/* append the record as a line of the text log format (times in ms) */
+void append_text( const LinkLogRecord & record, std::string & out );
+
+/* mm-link's log. Records are encoded into the block being filled; full
+   blocks go round a fixed ring to a writer thread that writes each in
+   one go. If the writer has had nothing to write for a second, it
+   takes the block being filled as it is, so a quiet link's log still
+   keeps up.
+
+   The binary format is the magic, a little-endian uint32 length, the
+   text log's "#" header lines, then the records: each a type byte, a
+   zigzag varint change in time since the previous record, and varints
+   for the bytes and (for departures and drops) the extra field. */
+
+class LinkLog
+{
+private:
+    const static size_t BLOCK_SIZE = 256 * 1024, BLOCKS = 8;
+    const static uint64_t HAND_OFF_INTERVAL = 1000000; /* us */
+
+    bool binary_;
+    FileDescriptor fd_;
+
+    /* shared with the writer thread */
+    std::string block_ {};
+    uint64_t last_time_;
+    std::deque< std::string > full_ {}, empty_ {};
+    bool halt_;
+    std::mutex mutex_ {};
+    std::condition_variable not_empty_ {}, block_free_ {};
+    std::thread writer_ {};
+
+    void append( const LinkLogRecord & record );
+    void hand_off( std::unique_lock<std::mutex> & lock );
+    void write_loop( void );
+
+public:
+    /* header is the text log's "#" lines, each ending in a newline */
+    LinkLog( const std::string & filename, const bool binary, const std::string & header );
+    ~LinkLog();
+
+    void arrival( const uint64_t time, const uint64_t bytes ) { append( { '+', time, bytes, 0 } ); }
+    void departure( const uint64_t time, const uint64_t bytes, const uint64_t delay ) { append( { '-', time, bytes, delay } ); }
+    void opportunity( const uint64_t time, const uint64_t bytes ) { append( { '#', time, bytes, 0 } ); }
+    void drop( const uint64_t time, const uint64_t packets, const uint64_t bytes ) { append( { 'd', time, packets, bytes } ); }
+};
+
+/* reads back a binary log */
+class BinaryLinkLog
+{
+private:
+    std::string filename_;
+    MappedFile file_;
+    std::string header_;
+    size_t offset_;
+    uint64_t time_;
+
+public:
+    /* does the file start with the binary log magic? */
+    static bool is_binary_log( const std::string & filename );
+
+    BinaryLinkLog( const std::string & filename );
+
+    const std::string & header( void ) const { return header_; }
+
+    /* the next record; false at the end (or at a partial record left by a writer that died) */
+    bool next( LinkLogRecord & record );
+};
+
+#endif /* LINK_LOG_HH */
@@ -8,77 +8,49 @@
 #include "util.hh"
 #include "ezio.hh"
 #include "abstract_packet_queue.hh"
+#include "tun_packet.hh"
 
 using namespace std;
 
-LinkQueue::LinkQueue( const string & link_name, const string & filename, const string & logfile,
+LinkQueue::LinkQueue( const string & link_name, const string & filename, const bool rate_trace,
+                      const string & logfile, const bool binary_log,
                       const bool repeat, const bool graph_throughput, const bool graph_delay,
                       unique_ptr<AbstractPacketQueue> && packet_queue,
-                      const string & command_line )
-    : next_delivery_( 0 ),
-      schedule_(),
-      base_timestamp_( timestamp() ),
+                      const string & command_line, const bool offload )
+    : trace_( LinkTrace::open( filename, rate_trace ) ),
+      run_position_( 0 ),
+      period_( trace_->period() * 1000 ),
+      base_timestamp_( timestamp_usecs() ),
       packet_queue_( move( packet_queue ) ),
-      packet_in_transit_( "", 0 ),
+      packet_in_transit_( PacketBuffer(), 0 ),
       packet_in_transit_bytes_left_( 0 ),
       output_queue_(),
       log_(),
       throughput_graph_( nullptr ),
       delay_graph_( nullptr ),
       repeat_( repeat ),
-      finished_( false )
+      finished_( false ),
+      offload_( offload )
 {
     assert_not_root();
 
-    /* open filename and load schedule */
-    ifstream trace_file( filename );
-
-    if ( not trace_file.good() ) {
-        throw runtime_error( filename + ": error opening for reading" );
-    }
-
-    string line;
-
-    while ( trace_file.good() and getline( trace_file, line ) ) {
-        if ( line.empty() ) {
-            throw runtime_error( filename + ": invalid empty line" );
-        }
-
-        const uint64_t ms = myatoi( line );
-
-        if ( not schedule_.empty() ) {
-            if ( ms < schedule_.back() ) {
-                throw runtime_error( filename + ": timestamps must be monotonically nondecreasing" );
-            }
-        }
-
-        schedule_.emplace_back( ms );
-    }
-
-    if ( schedule_.empty() ) {
-        throw runtime_error( filename + ": no valid timestamps found" );
-    }
-
-    if ( schedule_.back() == 0 ) {
+    if ( trace_->period() == 0 ) {
         throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
     }
 
     /* open logfile if called for */
     if ( not logfile.empty() ) {
-        log_.reset( new ofstream( logfile ) );
-        if ( not log_->good() ) {
-            throw runtime_error( logfile + ": error opening for writing" );
-        }
-
-        *log_ << "# mahimahi mm-link (" << link_name << ") [" << filename << "] > " << logfile << endl;
-        *log_ << "# command line: " << command_line << endl;
-        *log_ << "# queue: " << packet_queue_->to_string() << endl;
-        *log_ << "# init timestamp: " << initial_timestamp() << endl;
-        *log_ << "# base timestamp: " << base_timestamp_ << endl;
+        string header = "# mahimahi mm-link (" + link_name + ") [" + filename + "] > " + logfile + "\n";
+        header += "# command line: " + command_line + "\n";
+        header += "# queue: " + packet_queue_->to_string() + "\n";
+        header += "# init timestamp: " + to_string( initial_timestamp() ) + "\n";
+        header += "# base timestamp: " + to_string( base_timestamp_ / 1000 ) + "\n";
         const char * prefix = getenv( "MAHIMAHI_SHELL_PREFIX" );
         if ( prefix ) {
-            *log_ << "# mahimahi config: " << prefix << endl;
+            header += "# mahimahi config: " + string( prefix ) + "\n";
         }
+
+        log_.reset( new LinkLog( logfile, binary_log, header ) );
     }
 
     /* create graphs if called for */
@@ -103,11 +75,22 @@ LinkQueue::LinkQueue( const string & link_name, const string & filename, const s
     }
 }
 
+size_t LinkQueue::wire_size( const PacketBuffer & contents, size_t & segments ) const
+{
+    return tun_wire_size( contents.data(), contents.size(), offload_, segments );
+}
+
+size_t LinkQueue::wire_size( const PacketBuffer & contents ) const
+{
+    size_t segments;
+    return wire_size( contents, segments );
+}
+
 void LinkQueue::record_arrival( const uint64_t arrival_time, const size_t pkt_size )
 {
     /* log it */
     if ( log_ ) {
-        *log_ << arrival_time << " + " << pkt_size << endl;
+        log_->arrival( arrival_time, pkt_size );
     }
 
     /* meter it */
@@ -120,7 +103,7 @@ void LinkQueue::record_drop( const uint64_t time, const size_t pkts_dropped, con
 {
     /* log it */
     if ( log_ ) {
-        *log_ << time << " d " << pkts_dropped << " " << bytes_dropped << endl;
+        log_->drop( time, pkts_dropped, bytes_dropped );
     }
 }
 
@@ -128,7 +111,7 @@ void LinkQueue::record_departure_opportunity( void )
 {
     /* log the delivery opportunity */
     if ( log_ ) {
-        *log_ << next_delivery_time() << " # " << PACKET_SIZE << endl;
+        log_->opportunity( next_delivery_time(), PACKET_SIZE );
     }
 
     /* meter the delivery opportunity */
@@ -139,44 +122,49 @@ void LinkQueue::record_departure_opportunity( void )
 
 void LinkQueue::record_departure( const uint64_t departure_time, const QueuedPacket & packet )
 {
+    const size_t size = wire_size( packet.contents );
+
     /* log the delivery */
     if ( log_ ) {
-        *log_ << departure_time << " - " << packet.contents.size()
-              << " " << departure_time - packet.arrival_time << endl;
+        log_->departure( departure_time, size, departure_time - packet.arrival_time );
     }
 
     /* meter the delivery */
     if ( throughput_graph_ ) {
-        throughput_graph_->add_value_now( 2, packet.contents.size() );
+        throughput_graph_->add_value_now( 2, size );
     }
 
     if ( delay_graph_ ) {
-        delay_graph_->set_max_value_now( 0, departure_time - packet.arrival_time );
+        delay_graph_->set_max_value_now( 0, (departure_time - packet.arrival_time) / 1000 );
     }    
 }
 
-void LinkQueue::read_packet( const string & contents )
+void LinkQueue::read_packet( PacketBuffer && contents )
 {
-    const uint64_t now = timestamp();
+    const uint64_t now = timestamp_usecs();
+    const size_t size = contents.size();
+
+    size_t segments;
+    const size_t charge = wire_size( contents, segments );
 
-    if ( contents.size() > PACKET_SIZE ) {
+    if ( charge > segments * PACKET_SIZE ) {
         throw runtime_error( "packet size is greater than maximum" );
     }
 
     rationalize( now );
 
-    record_arrival( now, contents.size() );
+    record_arrival( now, charge );
 
     unsigned int bytes_before = packet_queue_->size_bytes();
     unsigned int packets_before = packet_queue_->size_packets();
 
-    packet_queue_->enqueue( QueuedPacket( contents, now ) );
+    packet_queue_->enqueue( QueuedPacket( move( contents ), now ) );
 
     assert( packet_queue_->size_packets() <= packets_before + 1 );
-    assert( packet_queue_->size_bytes() <= bytes_before + contents.size() );
+    assert( packet_queue_->size_bytes() <= bytes_before + size );
     
     unsigned int missing_packets = packets_before + 1 - packet_queue_->size_packets();
-    unsigned int missing_bytes = bytes_before + contents.size() - packet_queue_->size_bytes();
+    unsigned int missing_bytes = bytes_before + size - packet_queue_->size_bytes();
     if ( missing_packets > 0 || missing_bytes > 0 ) {
         record_drop( now, missing_packets, missing_bytes );
     }
@@ -187,7 +175,11 @@ uint64_t LinkQueue::next_delivery_time( void ) const
     if ( finished_ ) {
         return -1;
     } else {
-        return schedule_.at( next_delivery_ ) + base_timestamp_;
+        /* the final opportunities of the trace are left at the end, where the next pass begins */
+        const uint64_t ms = trace_->timestamp();
+        const uint64_t offset = ms * 1000 == period_ ? 0 : run_position_ * 1000 / trace_->run_length();
+
+        return base_timestamp_ + ms * 1000 + offset;
     }
 }
 
@@ -195,24 +187,108 @@ void LinkQueue::use_a_delivery_opportunity( void )
 {
     record_departure_opportunity();
 
-    next_delivery_ = (next_delivery_ + 1) % schedule_.size();
+    run_position_++;
+    if ( run_position_ == trace_->run_length() ) {
+        next_run();
+    }
+}
+
+void LinkQueue::next_run( void )
+{
+    run_position_ = 0;
 
-    /* wraparound */
-    if ( next_delivery_ == 0 ) {
-        if ( repeat_ ) {
-            base_timestamp_ += schedule_.back();
-        } else {
-            finished_ = true;
+    if ( not trace_->next_run() ) {
+        wraparound();
+    }
+}
+
+void LinkQueue::wraparound( void )
+{
+    if ( repeat_ ) {
+        base_timestamp_ += period_;
+    } else {
+        finished_ = true;
+    }
+}
+
+/* how many of the current run's remaining opportunities are due by now */
+uint64_t LinkQueue::due_in_run( const uint64_t now ) const
+{
+    const uint64_t length = trace_->run_length();
+    const uint64_t start = base_timestamp_ + trace_->timestamp() * 1000;
+
+    if ( trace_->timestamp() * 1000 == period_ or now - start >= 1000 ) {
+        return length - run_position_;
+    }
+
+    /* opportunity i is at start + i * 1000 / length */
+    const uint64_t last_due = ( (now - start + 1) * length - 1 ) / 1000;
+    return last_due + 1 - run_position_;
+}
+
+/* from the start of a run, pass over every run (and every whole pass
+   through the trace) that is entirely due by now */
+void LinkQueue::skip_runs( const uint64_t now, uint64_t & skipped )
+{
+    while ( not finished_ and now >= base_timestamp_ ) {
+        if ( trace_->skip_to( (now - base_timestamp_) / 1000, skipped ) ) {
+            return;
+        }
+
+        wraparound();
+
+        if ( not finished_ and now >= base_timestamp_ ) {
+            const uint64_t passes = (now - base_timestamp_) / period_;
+            base_timestamp_ += passes * period_;
+            skipped += passes * trace_->opportunity_count();
         }
     }
 }
 
+/* with nothing to send, use up every opportunity due by now at once.
+   Unused opportunities are logged one line per ms, and metered in one go. */
+void LinkQueue::fast_forward( const uint64_t now )
+{
+    uint64_t skipped = 0;
+
+    while ( next_delivery_time() <= now ) {
+        /* without a log, whole runs need not be visited */
+        if ( run_position_ == 0 and not log_ ) {
+            skip_runs( now, skipped );
+            if ( next_delivery_time() > now ) {
+                break;
+            }
+        }
+
+        const uint64_t due = due_in_run( now );
+
+        if ( log_ ) {
+            log_->opportunity( next_delivery_time(), due * PACKET_SIZE );
+        }
+
+        skipped += due;
+        run_position_ += due;
+        if ( run_position_ == trace_->run_length() ) {
+            next_run();
+        }
+    }
+
+    if ( throughput_graph_ and skipped ) {
+        throughput_graph_->add_value_now( 0, min( skipped * PACKET_SIZE, uint64_t( numeric_limits<unsigned int>::max() ) ) );
+    }
+}
+
 /* emulate the link up to the given timestamp */
 /* this function should be called before enqueueing any packets and before
    calculating the wait_time until the next event */
 void LinkQueue::rationalize( const uint64_t now )
 {
     while ( next_delivery_time() <= now ) {
+        if ( idle() ) {
+            fast_forward( now );
+            return;
+        }
+
         const uint64_t this_delivery_time = next_delivery_time();
 
         /* burn a delivery opportunity */
@@ -225,13 +301,12 @@ void LinkQueue::rationalize( const uint64_t now )
                     break;
                 }
                 packet_in_transit_ = packet_queue_->dequeue();
-                packet_in_transit_bytes_left_ = packet_in_transit_.contents.size();
+                packet_in_transit_bytes_left_ = wire_size( packet_in_transit_.contents );
             }
 
+            /* a super-packet takes as many opportunities as its segments would */
             assert( packet_in_transit_.arrival_time <= this_delivery_time );
-            assert( packet_in_transit_bytes_left_ <= PACKET_SIZE );
             assert( packet_in_transit_bytes_left_ > 0 );
-            assert( packet_in_transit_bytes_left_ <= packet_in_transit_.contents.size() );
 
             /* how many bytes of the delivery opportunity can we use? */
             const unsigned int amount_to_send = min( bytes_left_in_this_delivery,
@@ -255,21 +330,30 @@ void LinkQueue::rationalize( const uint64_t now )
 void LinkQueue::write_packets( FileDescriptor & fd )
 {
     while ( not output_queue_.empty() ) {
-        fd.write( output_queue_.front() );
+        output_queue_.front().write_to( fd );
+        output_queue_.pop();
+    }
+}
+
+void LinkQueue::pass_packets( const function<void(PacketBuffer &&)> & next )
+{
+    while ( not output_queue_.empty() ) {
+        next( move( output_queue_.front() ) );
         output_queue_.pop();
     }
 }
 
 unsigned int LinkQueue::wait_time( void )
 {
-    const auto now = timestamp();
+    const auto now = timestamp_usecs();
 
     rationalize( now );
 
     if ( next_delivery_time() <= now ) {
         return 0;
     } else {
-        return next_delivery_time() - now;
+        /* don't let a long gap in the trace overflow the ferry's timeout */
+        return min( next_delivery_time() - now, uint64_t( numeric_limits<uint16_t>::max() ) * 1000 );
     }
 }
 
@@ -6,37 +6,52 @@
 #include <queue>
 #include <cstdint>
 #include <string>
-#include <fstream>
 #include <memory>
+#include <functional>
 
 #include "file_descriptor.hh"
 #include "binned_livegraph.hh"
 #include "abstract_packet_queue.hh"
+#include "link_trace.hh"
+#include "link_log.hh"
 
 class LinkQueue
 {
 private:
-    const static unsigned int PACKET_SIZE = 1504; /* default max TUN payload size */
-
-    unsigned int next_delivery_;
-    std::vector<uint64_t> schedule_;
-    uint64_t base_timestamp_;
+    /* delivery opportunities. The trace gives them in ms; several
+       in the same ms (a run) are spread evenly across it. */
+    std::unique_ptr<LinkTrace> trace_;
+    uint64_t run_position_; /* next opportunity's place in the trace's current run */
+    uint64_t period_; /* length of the trace (us) */
+    uint64_t base_timestamp_; /* start of this pass through the trace (us) */
 
     std::unique_ptr<AbstractPacketQueue> packet_queue_;
     QueuedPacket packet_in_transit_;
     unsigned int packet_in_transit_bytes_left_;
-    std::queue<std::string> output_queue_;
+    std::queue<PacketBuffer> output_queue_;
 
-    std::unique_ptr<std::ofstream> log_;
+    std::unique_ptr<LinkLog> log_;
     std::unique_ptr<BinnedLiveGraph> throughput_graph_;
     std::unique_ptr<BinnedLiveGraph> delay_graph_;
 
     bool repeat_;
     bool finished_;
 
+    bool offload_; /* packets carry a virtio-net header (see tun_packet.hh) */
+
     uint64_t next_delivery_time( void ) const;
 
+    /* what a packet costs on the link (a super-packet, its segments) */
+    size_t wire_size( const PacketBuffer & contents, size_t & segments ) const;
+    size_t wire_size( const PacketBuffer & contents ) const;
+
     void use_a_delivery_opportunity( void );
+    void next_run( void );
+    void wraparound( void );
+
+    uint64_t due_in_run( const uint64_t now ) const;
+    void skip_runs( const uint64_t now, uint64_t & skipped );
+    void fast_forward( const uint64_t now );
 
     void record_arrival( const uint64_t arrival_time, const size_t pkt_size );
     void record_drop( const uint64_t time, const size_t pkts_dropped, const size_t bytes_dropped );
@@ -47,20 +62,33 @@ private:
     void dequeue_packet( void );
 
 public:
-    LinkQueue( const std::string & link_name, const std::string & filename, const std::string & logfile,
+    /* with offload, the packets come from TUN devices opened with offloads
+       (and packet_queue should have been made to expect that) */
+    LinkQueue( const std::string & link_name, const std::string & filename, const bool rate_trace,
+               const std::string & logfile, const bool binary_log,
                const bool repeat, const bool graph_throughput, const bool graph_delay,
                std::unique_ptr<AbstractPacketQueue> && packet_queue,
-               const std::string & command_line );
+               const std::string & command_line, const bool offload = false );
 
-    void read_packet( const std::string & contents );
+    void read_packet( PacketBuffer && contents );
 
     void write_packets( FileDescriptor & fd );
 
+    /* hand the packets that are ready to the next stage of a pipeline */
+    void pass_packets( const std::function<void(PacketBuffer &&)> & next );
+
+    /* microseconds until the next delivery opportunity */
     unsigned int wait_time( void );
 
     bool pending_output( void ) const;
 
     bool finished( void ) const { return finished_; }
+
+    /* nothing queued or being delivered */
+    bool idle( void ) const { return not packet_in_transit_bytes_left_ and packet_queue_->empty(); }
+
+    /* for an offline run: forget the packets that would have been written */
+    void discard_output( void ) { while ( not output_queue_.empty() ) { output_queue_.pop(); } }
 };
 
 #endif /* LINK_QUEUE_HH */
@@ -0,0 +1,259 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cmath>
+
+#include "link_queue.hh"
+#include "packet_queue_factory.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " [OPTION]... TRACE ARRIVALS LOGFILE" << endl;
+    cerr << endl;
+    cerr << "Options = --once --rate --binary-log" << endl;
+    cerr << "          --queue=QUEUE_TYPE --queue-args=QUEUE_ARGS (as for mm-link's downlink)" << endl;
+    cerr << endl;
+    cerr << "          ARRIVALS has one packet per line: TIME_MS [BYTES [FLOW]]" << endl;
+    cerr << "              (BYTES defaults to 1500; FLOW picks the packet's UDP source port)" << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+/* A TUN packet as mm-link would see it: packet information, then an IPv4
+   header and a UDP header carrying the flow in its source port (for
+   fq_codel), then zeros. Packets too short for the headers are all zeros. */
+static void make_packet( const unsigned int bytes, const unsigned int flow, string & packet )
+{
+    packet.assign( bytes, 0 );
+
+    if ( bytes < 4 + 20 + 8 ) {
+        return;
+    }
+
+    const unsigned int ip_length = bytes - 4;
+
+    packet[ 2 ] = 0x08; /* IPv4 ethertype */
+    packet[ 4 ] = 0x45; /* version 4, 20-byte header */
+    packet[ 6 ] = char( ip_length >> 8 );
+    packet[ 7 ] = char( ip_length & 0xff );
+    packet[ 12 ] = 64; /* TTL */
+    packet[ 13 ] = 17; /* UDP */
+    packet[ 16 ] = 10; packet[ 19 ] = 1; /* 10.0.0.1 */
+    packet[ 20 ] = 10; packet[ 23 ] = 2; /* 10.0.0.2 */
+    packet[ 24 ] = char( ( flow >> 8 ) & 0xff );
+    packet[ 25 ] = char( flow & 0xff );
+    packet[ 26 ] = 0x13; packet[ 27 ] = char( 0x88 ); /* port 5000 */
+}
+
+/* one line of the arrivals file (false for a blank or comment line) */
+static bool parse_arrival( const string & line, uint64_t & time, unsigned int & bytes, unsigned int & flow )
+{
+    const char * position = line.c_str();
+    char * end;
+
+    while ( *position == ' ' or *position == '\t' ) {
+        position++;
+    }
+
+    if ( *position == '\0' or *position == '#' ) {
+        return false;
+    }
+
+    const double ms = strtod( position, &end );
+    if ( end == position or not ( ms >= 0 ) or not isfinite( ms ) ) {
+        throw runtime_error( "invalid arrival time" );
+    }
+    time = llround( ms * 1000 );
+
+    bytes = 1500;
+    flow = 0;
+
+    position = end;
+    const unsigned long long given_bytes = strtoull( position, &end, 10 );
+    if ( end != position ) {
+        bytes = given_bytes;
+        position = end;
+
+        const unsigned long long given_flow = strtoull( position, &end, 10 );
+        if ( end != position ) {
+            flow = given_flow;
+            position = end;
+        }
+    }
+
+    while ( *position == ' ' or *position == '\t' ) {
+        position++;
+    }
+
+    if ( *position != '\0' or bytes == 0 ) {
+        throw runtime_error( "format: TIME_MS [BYTES [FLOW]]" );
+    }
+
+    return true;
+}
+
+/* Run the link in virtual time. Between arrivals, the clock steps from
+   one delivery opportunity to the next, as mm-link's event loop would
+   wake for each, so the queue discipline sees the times it would see
+   live; an idle link jumps straight to the next arrival. */
+class LinkSimulation
+{
+private:
+    VirtualClock clock_;
+    ThreadClockOverride thread_clock_; /* in place before the link is built and until it is gone, even if building it throws */
+    unique_ptr<LinkQueue> link_;
+
+public:
+    /* the link takes its base timestamp from the clock */
+    LinkSimulation( const string & trace, const bool rate_trace, const string & logfile, const bool binary_log,
+                    const bool repeat, unique_ptr<AbstractPacketQueue> && queue, const string & command_line )
+        : clock_(),
+          thread_clock_( clock_ ),
+          link_( new LinkQueue( "Simulated", trace, rate_trace, logfile, binary_log, repeat,
+                                false, false, move( queue ), command_line ) )
+    {}
+
+    /* deliver everything due before the given time */
+    void run_until( const uint64_t time )
+    {
+        while ( not link_->finished() and not link_->idle() ) {
+            const uint64_t next = clock_.usecs() + link_->wait_time();
+            link_->discard_output();
+
+            if ( next >= time ) {
+                break;
+            }
+
+            clock_.advance_to( next );
+        }
+    }
+
+    /* deliver what is left */
+    void drain( void )
+    {
+        run_until( -1 );
+    }
+
+    void arrival( const uint64_t time, PacketBuffer && packet )
+    {
+        run_until( time );
+        clock_.advance_to( time );
+        link_->read_packet( move( packet ) );
+    }
+
+    bool finished( void ) const { return link_->finished(); }
+};
+
+int main( int argc, char *argv[] )
+{
+    try {
+        string command_line = argv[ 0 ]; /* for the log file */
+        for ( int i = 1; i < argc; i++ ) {
+            command_line += string( " " ) + argv[ i ];
+        }
+
+        const option command_line_options[] = {
+            { "once",              no_argument, nullptr, 'o' },
+            { "rate",              no_argument, nullptr, 'r' },
+            { "binary-log",        no_argument, nullptr, 'l' },
+            { "queue",       required_argument, nullptr, 'q' },
+            { "queue-args",  required_argument, nullptr, 'a' },
+            { 0,                             0, nullptr, 0 }
+        };
+
+        bool repeat = true, rate_trace = false, binary_log = false;
+        string queue_type = "infinite", queue_args;
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'o':
+                repeat = false;
+                break;
+            case 'r':
+                rate_trace = true;
+                break;
+            case 'l':
+                binary_log = true;
+                break;
+            case 'q':
+                queue_type = optarg;
+                break;
+            case 'a':
+                queue_args = optarg;
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 3 != argc ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const string trace_filename = argv[ optind ], arrivals_filename = argv[ optind + 1 ],
+            logfile = argv[ optind + 2 ];
+
+        unique_ptr<AbstractPacketQueue> queue = make_packet_queue( queue_type, queue_args );
+        if ( not queue ) {
+            cerr << "Unknown queue type: " << queue_type << endl;
+            usage_error( argv[ 0 ] );
+        }
+
+        ifstream arrivals( arrivals_filename );
+        if ( not arrivals.good() ) {
+            throw runtime_error( arrivals_filename + ": error opening for reading" );
+        }
+
+        LinkSimulation simulation( trace_filename, rate_trace, logfile, binary_log, repeat,
+                                   move( queue ), command_line );
+
+        string line, packet;
+        uint64_t line_number = 0, last_time = 0;
+
+        while ( not simulation.finished() and getline( arrivals, line ) ) {
+            line_number++;
+
+            try {
+                uint64_t time;
+                unsigned int bytes, flow;
+
+                if ( not parse_arrival( line, time, bytes, flow ) ) {
+                    continue;
+                }
+
+                if ( time < last_time ) {
+                    throw runtime_error( "arrivals must be in time order" );
+                }
+                last_time = time;
+
+                make_packet( bytes, flow, packet );
+                simulation.arrival( time, PacketBuffer( packet ) );
+            } catch ( const exception & e ) {
+                throw runtime_error( arrivals_filename + ":" + to_string( line_number ) + ": " + e.what() );
+            }
+        }
+
+        simulation.drain();
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,531 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+
+#include "link_trace.hh"
+#include "file_descriptor.hh"
+#include "exception.hh"
+#include "ezio.hh"
+#include "varint.hh"
+
+using namespace std;
+
+unique_ptr<LinkTrace> LinkTrace::open( const string & filename, const bool rate )
+{
+    if ( rate ) {
+        return unique_ptr<LinkTrace>( new TextTrace( filename, true ) );
+    } else if ( BinaryTrace::is_binary_trace( filename ) ) {
+        return unique_ptr<LinkTrace>( new BinaryTrace( filename ) );
+    } else {
+        return unique_ptr<LinkTrace>( new TextTrace( filename ) );
+    }
+}
+
+/* kilobits in one ms -> bits, to the nearest bit */
+static uint64_t parse_rate( const string & filename, const string & line )
+{
+    char * end;
+    errno = 0;
+    const double kilobits = strtod( line.c_str(), &end );
+
+    if ( end == line.c_str() or *end != 0 or errno or not (kilobits >= 0 and kilobits < 1e12) ) {
+        throw runtime_error( filename + ": invalid rate \"" + line + "\"" );
+    }
+
+    return llround( kilobits * 1000 );
+}
+
+/* Check every line once, in constant memory, so a bad trace fails
+   before the link starts rather than whenever the reader reaches it.
+   Returns the period. */
+uint64_t TextTrace::scan( void ) const
+{
+    ifstream trace_file( filename_ );
+
+    if ( not trace_file.good() ) {
+        throw runtime_error( filename_ + ": error opening for reading" );
+    }
+
+    uint64_t lines = 0, last_ms = 0, bits = 0;
+    string line;
+
+    while ( trace_file.good() and getline( trace_file, line ) ) {
+        if ( line.empty() ) {
+            throw runtime_error( filename_ + ": invalid empty line" );
+        }
+
+        if ( rate_ ) {
+            bits = min( bits + parse_rate( filename_, line ), OPPORTUNITY_BITS );
+        } else {
+            const uint64_t ms = myatoi( line );
+            if ( lines > 0 and ms < last_ms ) {
+                throw runtime_error( filename_ + ": timestamps must be monotonically nondecreasing" );
+            }
+            last_ms = ms;
+        }
+
+        lines++;
+    }
+
+    if ( trace_file.bad() ) {
+        throw runtime_error( filename_ + ": error reading" );
+    }
+
+    if ( lines == 0 ) {
+        throw runtime_error( filename_ + ( rate_ ? ": no rates found" : ": no valid timestamps found" ) );
+    }
+
+    if ( rate_ and bits < OPPORTUNITY_BITS ) {
+        throw runtime_error( filename_ + ": rate never adds up to a delivery opportunity" );
+    }
+
+    return rate_ ? lines : last_ms;
+}
+
+TextTrace::TextTrace( const string & filename, const bool rate )
+    : filename_( filename ),
+      rate_( rate ),
+      period_( scan() ),
+      halt_( false ),
+      next_run_( 0 ),
+      consumed_( 0 ),
+      opportunity_count_( 0 )
+{
+    reader_ = thread( [&] () { read_loop(); } );
+
+    /* wait for the first chunk, so a trace that fails early fails here */
+    try {
+        take_chunk();
+    } catch ( ... ) {
+        stop();
+        throw;
+    }
+}
+
+TextTrace::~TextTrace()
+{
+    stop();
+}
+
+void TextTrace::stop( void )
+{
+    {
+        unique_lock<mutex> ul( mutex_ );
+        halt_ = true;
+    }
+
+    not_full_.notify_all();
+
+    if ( reader_.joinable() ) {
+        reader_.join();
+    }
+}
+
+/* runs on the reader thread */
+void TextTrace::read_loop( void )
+{
+    try {
+        ifstream trace_file( filename_ );
+
+        if ( not trace_file.good() ) {
+            throw runtime_error( filename_ + ": error opening for reading" );
+        }
+
+        while ( rate_ ? read_rate_pass( trace_file ) : read_pass( trace_file ) ) {
+            /* rewind for the next pass */
+            trace_file.clear();
+            trace_file.seekg( 0 );
+        }
+    } catch ( ... ) {
+        {
+            unique_lock<mutex> ul( mutex_ );
+            error_ = current_exception();
+        }
+
+        not_empty_.notify_one();
+    }
+}
+
+/* parse the whole file once; returns false if halted along the way */
+bool TextTrace::read_pass( ifstream & trace_file )
+{
+    Chunk chunk;
+    uint64_t pass_opportunities = 0;
+    pair< uint64_t, uint64_t > run( 0, 0 );
+    bool have_run = false;
+    string line;
+
+    while ( trace_file.good() and getline( trace_file, line ) ) {
+        if ( line.empty() ) {
+            throw runtime_error( filename_ + ": invalid empty line" );
+        }
+
+        const uint64_t ms = myatoi( line );
+
+        if ( have_run ) {
+            if ( ms < run.first ) {
+                throw runtime_error( filename_ + ": timestamps must be monotonically nondecreasing" );
+            }
+
+            if ( ms == run.first ) {
+                run.second++;
+                continue;
+            }
+
+            if ( not add_run( chunk, run, pass_opportunities ) ) {
+                return false;
+            }
+        }
+
+        run = make_pair( ms, 1 );
+        have_run = true;
+    }
+
+    if ( not have_run ) {
+        throw runtime_error( filename_ + ": no valid timestamps found" );
+    }
+
+    if ( run.first != period_ ) {
+        throw runtime_error( filename_ + ": trace changed while being read" );
+    }
+
+    if ( not add_run( chunk, run, pass_opportunities ) ) {
+        return false;
+    }
+
+    chunk.ends_pass = true;
+    chunk.pass_opportunities = pass_opportunities;
+    return publish( chunk );
+}
+
+/* work out the opportunities of a rate trace, once through; returns false if halted along the way */
+bool TextTrace::read_rate_pass( ifstream & trace_file )
+{
+    Chunk chunk;
+    uint64_t pass_opportunities = 0, ms = 0, reserve_bits = 0;
+    string line;
+
+    while ( trace_file.good() and getline( trace_file, line ) ) {
+        if ( line.empty() ) {
+            throw runtime_error( filename_ + ": invalid empty line" );
+        }
+
+        reserve_bits += parse_rate( filename_, line );
+
+        const uint64_t opportunities = reserve_bits / OPPORTUNITY_BITS;
+        reserve_bits %= OPPORTUNITY_BITS;
+
+        if ( opportunities > 0 and not add_run( chunk, make_pair( ms, opportunities ), pass_opportunities ) ) {
+            return false;
+        }
+
+        ms++;
+    }
+
+    if ( ms != period_ ) {
+        throw runtime_error( filename_ + ": trace changed while being read" );
+    }
+
+    if ( chunk.runs.empty() ) {
+        throw runtime_error( filename_ + ": rate never adds up to a delivery opportunity" );
+    }
+
+    chunk.ends_pass = true;
+    chunk.pass_opportunities = pass_opportunities;
+    return publish( chunk );
+}
+
+/* the last chunk is held back until it has a run after it, so the pass's final chunk is never empty */
+bool TextTrace::add_run( Chunk & chunk, const pair< uint64_t, uint64_t > & run,
+                         uint64_t & pass_opportunities )
+{
+    if ( chunk.runs.size() == CHUNK_RUNS and not publish( chunk ) ) {
+        return false;
+    }
+
+    chunk.runs.push_back( run );
+    chunk.opportunities += run.second;
+    pass_opportunities += run.second;
+    return true;
+}
+
+/* hand a chunk to the cursor, waiting if it is far enough ahead; returns false if halted */
+bool TextTrace::publish( Chunk & chunk )
+{
+    {
+        unique_lock<mutex> ul( mutex_ );
+        not_full_.wait( ul, [&] () { return halt_ or chunks_.size() < CHUNKS_AHEAD; } );
+
+        if ( halt_ ) {
+            return false;
+        }
+
+        chunks_.push_back( move( chunk ) );
+    }
+
+    not_empty_.notify_one();
+
+    chunk = Chunk();
+    return true;
+}
+
+void TextTrace::take_chunk( void )
+{
+    Chunk next;
+
+    {
+        unique_lock<mutex> ul( mutex_ );
+        not_empty_.wait( ul, [&] () { return error_ or not chunks_.empty(); } );
+
+        /* a parse error shows up after every run before it */
+        if ( chunks_.empty() ) {
+            rethrow_exception( error_ );
+        }
+
+        next = move( chunks_.front() );
+        chunks_.pop_front();
+    }
+
+    not_full_.notify_one();
+
+    current_ = move( next );
+    next_run_ = 0;
+    consumed_ = 0;
+
+    if ( current_.ends_pass ) {
+        opportunity_count_ = current_.pass_opportunities;
+    }
+}
+
+bool TextTrace::next_run( void )
+{
+    consumed_ += run_length();
+    next_run_++;
+
+    if ( next_run_ < current_.runs.size() ) {
+        return true;
+    }
+
+    const bool ended_pass = current_.ends_pass;
+    take_chunk();
+
+    return not ended_pass;
+}
+
+bool TextTrace::skip_to( const uint64_t ms, uint64_t & skipped )
+{
+    /* pass over whole chunks without looking at their runs */
+    while ( current_.runs.back().first < ms ) {
+        skipped += current_.opportunities - consumed_;
+
+        const bool ended_pass = current_.ends_pass;
+        take_chunk();
+
+        if ( ended_pass ) {
+            return false;
+        }
+    }
+
+    /* the chunk's last run is at or after ms, so this stops within it */
+    while ( timestamp() < ms ) {
+        skipped += run_length();
+        next_run();
+    }
+
+    return true;
+}
+
+static const string trace_magic = "MMTRACE1";
+
+/* magic followed by three uint64s: opportunity count, run count, period */
+static const size_t header_size = 8 + 3 * sizeof( uint64_t );
+
+static string encode_u64( const uint64_t value )
+{
+    const uint64_t le = htole64( value );
+    return string( reinterpret_cast<const char *>( &le ), sizeof( le ) );
+}
+
+/* the mapping carries no alignment guarantee, so copy out */
+static uint64_t decode_u64( const char * data )
+{
+    uint64_t le;
+    memcpy( &le, data, sizeof( le ) );
+    return le64toh( le );
+}
+
+static string make_header( const uint64_t opportunity_count, const uint64_t run_count, const uint64_t period )
+{
+    return trace_magic + encode_u64( opportunity_count ) + encode_u64( run_count ) + encode_u64( period );
+}
+
+bool BinaryTrace::is_binary_trace( const string & filename )
+{
+    struct stat file_info;
+    if ( stat( filename.c_str(), &file_info ) < 0 or not S_ISREG( file_info.st_mode ) ) {
+        return false;
+    }
+
+    FileDescriptor fd( SystemCall( "open " + filename, ::open( filename.c_str(), O_RDONLY ) ) );
+    return fd.read( trace_magic.size() ) == trace_magic;
+}
+
+BinaryTrace::BinaryTrace( const string & filename )
+    : filename_( filename ),
+      file_( filename ),
+      opportunity_count_( 0 ),
+      period_( 0 ),
+      cursor_()
+{
+    const char * const data = file_.data();
+
+    if ( file_.size() < header_size or string( data, trace_magic.size() ) != trace_magic ) {
+        throw runtime_error( filename_ + ": not a binary trace" );
+    }
+
+    opportunity_count_ = decode_u64( data + 8 );
+    const uint64_t run_count = decode_u64( data + 16 );
+    period_ = decode_u64( data + 24 );
+
+    /* check every run once, so next_run() never has to */
+    uint64_t timestamp = 0, runs_seen = 0, opportunities_seen = 0;
+    size_t offset = header_size;
+
+    while ( offset < file_.size() ) {
+        uint64_t delta, length;
+        if ( not decode_varint( data, file_.size(), offset, delta )
+             or not decode_varint( data, file_.size(), offset, length ) ) {
+            throw runtime_error( filename_ + ": truncated or corrupt run" );
+        }
+
+        if ( (runs_seen > 0 and delta == 0) or length == 0 or length > MAX_RUN_LENGTH
+             or delta > numeric_limits<uint64_t>::max() - timestamp
+             or length > numeric_limits<uint64_t>::max() - opportunities_seen ) {
+            throw runtime_error( filename_ + ": corrupt run" );
+        }
+
+        timestamp += delta;
+
+        if ( runs_seen % INDEX_INTERVAL == 0 ) {
+            index_.push_back( { offset, timestamp, length, opportunities_seen } );
+        }
+
+        runs_seen++;
+        opportunities_seen += length;
+    }
+
+    if ( runs_seen == 0 ) {
+        throw runtime_error( filename_ + ": no valid timestamps found" );
+    }
+
+    /* a writer that died leaves a zeroed header */
+    if ( runs_seen != run_count or opportunities_seen != opportunity_count_ or timestamp != period_ ) {
+        throw runtime_error( filename_ + ": header does not match runs (incomplete trace?)" );
+    }
+
+    first_run();
+}
+
+void BinaryTrace::first_run( void )
+{
+    cursor_ = index_.front();
+}
+
+bool BinaryTrace::next_run( void )
+{
+    if ( cursor_.offset == file_.size() ) {
+        first_run();
+        return false;
+    }
+
+    uint64_t delta;
+    decode_varint( file_.data(), file_.size(), cursor_.offset, delta );
+    cursor_.opportunities_before += cursor_.run_length;
+    decode_varint( file_.data(), file_.size(), cursor_.offset, cursor_.run_length );
+    cursor_.timestamp += delta;
+
+    return true;
+}
+
+bool BinaryTrace::skip_to( const uint64_t ms, uint64_t & skipped )
+{
+    const uint64_t opportunities_before = cursor_.opportunities_before;
+
+    /* every run left is before ms (the last run is at the period) */
+    if ( period_ < ms ) {
+        skipped += opportunity_count_ - opportunities_before;
+        first_run();
+        return false;
+    }
+
+    /* jump to the last noted run before ms, if that is ahead */
+    const auto after = lower_bound( index_.begin(), index_.end(), ms,
+                                    [] ( const Cursor & noted, const uint64_t target ) {
+                                        return noted.timestamp < target; } );
+    if ( after != index_.begin() and prev( after )->offset > cursor_.offset ) {
+        cursor_ = *prev( after );
+    }
+
+    /* then walk the rest of the way */
+    while ( cursor_.timestamp < ms ) {
+        next_run();
+    }
+
+    skipped += cursor_.opportunities_before - opportunities_before;
+    return true;
+}
+
+void write_binary_trace( LinkTrace & trace, const string & filename )
+{
+    FileDescriptor fd( SystemCall( "open " + filename,
+                                   ::open( filename.c_str(), O_WRONLY | O_CREAT | O_EXCL,
+                                           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH ) ) );
+
+    /* placeholder header until every run is written */
+    fd.write( make_header( 0, 0, 0 ) );
+
+    const size_t flush_size = 65536;
+    string runs;
+    uint64_t opportunity_count = 0, run_count = 0, previous_timestamp = 0;
+
+    do {
+        if ( trace.run_length() > BinaryTrace::MAX_RUN_LENGTH ) {
+            throw runtime_error( filename + ": more than " + to_string( BinaryTrace::MAX_RUN_LENGTH )
+                                 + " opportunities at " + to_string( trace.timestamp() ) + " ms" );
+        }
+
+        encode_varint( trace.timestamp() - previous_timestamp, runs );
+        encode_varint( trace.run_length(), runs );
+
+        previous_timestamp = trace.timestamp();
+        opportunity_count += trace.run_length();
+        run_count++;
+
+        if ( runs.size() >= flush_size ) {
+            fd.write( runs );
+            runs.clear();
+        }
+    } while ( trace.next_run() );
+
+    if ( not runs.empty() ) {
+        fd.write( runs );
+    }
+
+    const string header = make_header( opportunity_count, run_count, previous_timestamp );
+    const ssize_t bytes_written = SystemCall( "pwrite", pwrite( fd.fd_num(), header.data(), header.size(), 0 ) );
+    if ( size_t( bytes_written ) != header.size() ) {
+        throw runtime_error( filename + ": short write of trace header" );
+    }
+}
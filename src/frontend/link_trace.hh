@@ -0,0 +1,173 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef LINK_TRACE_HH
+#define LINK_TRACE_HH
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <fstream>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+
+#include "mapped_file.hh"
+
+/* A packet-delivery trace: a nondecreasing series of delivery
+   opportunities, each a timestamp in ms. Opportunities that share a
+   timestamp are kept together as one run. The trace is read through a
+   cursor that starts at the first run. */
+
+class LinkTrace
+{
+public:
+    /* opens a text trace (one timestamp per line) or a binary trace
+       (written by write_binary_trace()), telling them apart by magic,
+       or a rate trace (see TextTrace) */
+    static std::unique_ptr<LinkTrace> open( const std::string & filename, const bool rate = false );
+
+    virtual ~LinkTrace() {}
+
+    /* the run at the cursor */
+    virtual uint64_t timestamp( void ) const = 0;
+    virtual uint64_t run_length( void ) const = 0;
+
+    /* move to the next run; after the last, go back to the first and return false */
+    virtual bool next_run( void ) = 0;
+
+    /* from the start of the cursor's run, move past every run before
+       the given timestamp, adding the opportunities passed over to
+       skipped; after the last run, go back to the first and return false */
+    virtual bool skip_to( const uint64_t ms, uint64_t & skipped ) = 0;
+
+    /* opportunities in one pass (for a streamed trace, known once the cursor has wrapped) */
+    virtual uint64_t opportunity_count( void ) const = 0;
+
+    /* length of one pass through the trace (ms). For a trace of
+       opportunities, this is the timestamp of the final one. */
+    virtual uint64_t period( void ) const = 0;
+};
+
+/* Text trace, streamed in constant memory: a reader thread parses the
+   file ahead of the cursor in chunks of runs, going back to the start
+   each time it reaches the end. The whole file is checked once when
+   the trace is opened.
+
+   A trace of opportunities has a timestamp per line; its period comes
+   from the last line. A rate trace instead gives the kilobits that can
+   be delivered in each ms, one ms per line (as mm-rate-to-events takes).
+   Its opportunities are worked out as it is read: each ms gets as many
+   as the credit banked so far covers, and the rest carries over. Its
+   period is the number of lines. */
+class TextTrace : public LinkTrace
+{
+private:
+    struct Chunk
+    {
+        std::vector< std::pair< uint64_t, uint64_t > > runs {};
+        uint64_t opportunities {};
+        bool ends_pass {}; /* holds the last run of the trace */
+        uint64_t pass_opportunities {}; /* if it does */
+    };
+
+    const static size_t CHUNK_RUNS = 4096, CHUNKS_AHEAD = 8;
+    const static uint64_t OPPORTUNITY_BITS = 12000; /* in a rate trace */
+
+    std::string filename_;
+    bool rate_;
+    uint64_t period_;
+
+    /* shared with the reader thread */
+    std::deque< Chunk > chunks_ {};
+    std::exception_ptr error_ {};
+    bool halt_;
+    std::mutex mutex_ {};
+    std::condition_variable not_empty_ {}, not_full_ {};
+    std::thread reader_ {};
+
+    /* the cursor */
+    Chunk current_ {};
+    size_t next_run_;
+    uint64_t consumed_; /* opportunities in the chunk before the cursor's run */
+    uint64_t opportunity_count_;
+
+    uint64_t scan( void ) const;
+    void read_loop( void );
+    bool read_pass( std::ifstream & trace_file );
+    bool read_rate_pass( std::ifstream & trace_file );
+    bool add_run( Chunk & chunk, const std::pair< uint64_t, uint64_t > & run,
+                  uint64_t & pass_opportunities );
+    bool publish( Chunk & chunk );
+    void take_chunk( void );
+    void stop( void );
+
+public:
+    TextTrace( const std::string & filename, const bool rate = false );
+    ~TextTrace();
+
+    uint64_t timestamp( void ) const override { return current_.runs[ next_run_ ].first; }
+    uint64_t run_length( void ) const override { return current_.runs[ next_run_ ].second; }
+    bool next_run( void ) override;
+    bool skip_to( const uint64_t ms, uint64_t & skipped ) override;
+    uint64_t opportunity_count( void ) const override { return opportunity_count_; }
+    uint64_t period( void ) const override { return period_; }
+};
+
+/* The binary trace format:
+
+     header: magic, then little-endian uint64s: opportunity count, run count, period (ms)
+     runs:   each a varint timestamp delta (from the previous run, or from zero)
+             followed by a varint run length
+
+   Varints are LEB128 (see varint.hh). The whole file is checked
+   when opened, so the cursor can walk the mapping without further checks.
+   A run may hold at most MAX_RUN_LENGTH opportunities.
+   Every INDEX_INTERVAL-th run's cursor is noted along the way, so
+   skip_to() can binary-search them rather than decode every run. */
+
+class BinaryTrace : public LinkTrace
+{
+private:
+    struct Cursor
+    {
+        size_t offset; /* of the run after this one */
+        uint64_t timestamp, run_length;
+        uint64_t opportunities_before;
+    };
+
+    const static uint64_t INDEX_INTERVAL = 1024;
+
+    std::string filename_;
+    MappedFile file_;
+    uint64_t opportunity_count_, period_;
+    std::vector< Cursor > index_ {};
+
+    Cursor cursor_;
+
+    void first_run( void );
+
+public:
+    /* more opportunities in one ms than any link (some 200 Tbit/s) would
+       have, so a longer run is taken for corruption rather than unpacked */
+    const static uint64_t MAX_RUN_LENGTH = uint64_t( 1 ) << 24;
+
+    /* does the file start with the binary trace magic? */
+    static bool is_binary_trace( const std::string & filename );
+
+    BinaryTrace( const std::string & filename );
+
+    uint64_t timestamp( void ) const override { return cursor_.timestamp; }
+    uint64_t run_length( void ) const override { return cursor_.run_length; }
+    bool next_run( void ) override;
+    bool skip_to( const uint64_t ms, uint64_t & skipped ) override;
+    uint64_t opportunity_count( void ) const override { return opportunity_count_; }
+    uint64_t period( void ) const override { return period_; }
+};
+
+/* write a whole trace, from its first run, to a new file in the binary format */
+void write_binary_trace( LinkTrace & trace, const std::string & filename );
+
+#endif /* LINK_TRACE_HH */
@@ -2,11 +2,7 @@
 
 #include <getopt.h>
 
-#include "infinite_packet_queue.hh"
-#include "drop_tail_packet_queue.hh"
-#include "drop_head_packet_queue.hh"
-#include "codel_packet_queue.hh"
-#include "pie_packet_queue.hh"
+#include "packet_queue_factory.hh"
 #include "link_queue.hh"
 #include "packetshell.cc"
 
@@ -16,41 +12,42 @@ void usage_error( const string & program_name )
 {
     cerr << "Usage: " << program_name << " UPLINK-TRACE DOWNLINK-TRACE [OPTION]... [COMMAND]" << endl;
     cerr << endl;
-    cerr << "Options = --once" << endl;
-    cerr << "          --uplink-log=FILENAME --downlink-log=FILENAME" << endl;
+    cerr << "Options = --once --rate" << endl;
+    cerr << "          --uplink-log=FILENAME --downlink-log=FILENAME --binary-log" << endl;
     cerr << "          --meter-uplink --meter-uplink-delay" << endl;
     cerr << "          --meter-downlink --meter-downlink-delay" << endl;
     cerr << "          --meter-all" << endl;
     cerr << "          --uplink-queue=QUEUE_TYPE --downlink-queue=QUEUE_TYPE" << endl;
     cerr << "          --uplink-queue-args=QUEUE_ARGS --downlink-queue-args=QUEUE_ARGS" << endl;
+    cerr << "          --offload" << endl;
     cerr << endl;
-    cerr << "          QUEUE_TYPE = infinite | droptail | drophead | codel | pie" << endl;
+    cerr << "          QUEUE_TYPE = infinite | droptail | drophead | codel | pie | fq_codel" << endl;
     cerr << "          QUEUE_ARGS = \"NAME=NUMBER[, NAME2=NUMBER2, ...]\"" << endl;
-    cerr << "              (with NAME = bytes | packets | target | interval | qdelay_ref | max_burst)" << endl;
-    cerr << "                  target, interval, qdelay_ref, max_burst are in milli-second" << endl << endl;
+    cerr << "              (with NAME = bytes | packets | target | interval | qdelay_ref | max_burst | flows | quantum | seed)" << endl;
+    cerr << "                  target, interval, qdelay_ref, max_burst are in milli-second" << endl;
+    cerr << "                  fq_codel defaults: target=5, interval=100, flows=1024, quantum=1504 (bytes)" << endl;
+    cerr << "                  seed fixes the randomness of pie and fq_codel" << endl;
+    cerr << endl;
+    cerr << "          --rate: traces give the kilobits deliverable in each millisecond, one per line" << endl;
+    cerr << "          --offload: let TSO/GSO super-packets through the link whole" << endl;
+    cerr << endl;
+    cerr << "          A text trace is read through once to check it before the link starts;" << endl;
+    cerr << "          for long traces, \"mm-trace pack\" gives a binary trace that opens much faster." << endl << endl;
 
     throw runtime_error( "invalid arguments" );
 }
 
-unique_ptr<AbstractPacketQueue> get_packet_queue( const string & type, const string & args, const string & program_name )
+unique_ptr<AbstractPacketQueue> get_packet_queue( const string & type, const string & args, const string & program_name,
+                                                  const bool offload )
 {
-    if ( type == "infinite" ) {
-        return unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( args ) );
-    } else if ( type == "droptail" ) {
-        return unique_ptr<AbstractPacketQueue>( new DropTailPacketQueue( args ) );
-    } else if ( type == "drophead" ) {
-        return unique_ptr<AbstractPacketQueue>( new DropHeadPacketQueue( args ) );
-    } else if ( type == "codel" ) {
-        return unique_ptr<AbstractPacketQueue>( new CODELPacketQueue( args ) );
-    } else if ( type == "pie" ) {
-        return unique_ptr<AbstractPacketQueue>( new PIEPacketQueue( args ) );
-    } else {
+    unique_ptr<AbstractPacketQueue> ret = make_packet_queue( type, args, offload );
+
+    if ( not ret ) {
         cerr << "Unknown queue type: " << type << endl;
+        usage_error( program_name );
     }
 
-    usage_error( program_name );
-
-    return nullptr;
+    return ret;
 }
 
 string shell_quote( const string & arg )
@@ -91,7 +88,9 @@ int main( int argc, char *argv[] )
         const option command_line_options[] = {
             { "uplink-log",           required_argument, nullptr, 'u' },
             { "downlink-log",         required_argument, nullptr, 'd' },
+            { "binary-log",                 no_argument, nullptr, 'l' },
             { "once",                       no_argument, nullptr, 'o' },
+            { "rate",                       no_argument, nullptr, 'r' },
             { "meter-uplink",               no_argument, nullptr, 'm' },
             { "meter-downlink",             no_argument, nullptr, 'n' },
             { "meter-uplink-delay",         no_argument, nullptr, 'x' },
@@ -101,11 +100,15 @@ int main( int argc, char *argv[] )
             { "downlink-queue",       required_argument, nullptr, 'w' },
             { "uplink-queue-args",    required_argument, nullptr, 'a' },
             { "downlink-queue-args",  required_argument, nullptr, 'b' },
+            { "offload",                    no_argument, nullptr, 'g' },
             { 0,                                      0, nullptr, 0 }
         };
 
         string uplink_logfile, downlink_logfile;
+        bool binary_log = false;
         bool repeat = true;
+        bool rate_traces = false;
+        bool offload = false;
         bool meter_uplink = false, meter_downlink = false;
         bool meter_uplink_delay = false, meter_downlink_delay = false;
         string uplink_queue_type = "infinite", downlink_queue_type = "infinite",
@@ -124,9 +127,15 @@ int main( int argc, char *argv[] )
             case 'd':
                 downlink_logfile = optarg;
                 break;
+            case 'l':
+                binary_log = true;
+                break;
             case 'o':
                 repeat = false;
                 break;
+            case 'r':
+                rate_traces = true;
+                break;
             case 'm':
                 meter_uplink = true;
                 break;
@@ -156,6 +165,9 @@ int main( int argc, char *argv[] )
             case 'b':
                 downlink_queue_args = optarg;
                 break;
+            case 'g':
+                offload = true;
+                break;
             case '?':
                 usage_error( argv[ 0 ] );
                 break;
@@ -181,16 +193,16 @@ int main( int argc, char *argv[] )
             }
         }
 
-        PacketShell<LinkQueue> link_shell_app( "link", user_environment, passthrough_until_signal );
+        PacketShell<LinkQueue> link_shell_app( "link", user_environment, passthrough_until_signal, offload );
 
         link_shell_app.start_uplink( "[link] ", command,
-                                     "Uplink", uplink_filename, uplink_logfile, repeat, meter_uplink, meter_uplink_delay,
-                                     get_packet_queue( uplink_queue_type, uplink_queue_args, argv[ 0 ] ),
-                                     command_line );
+                                     "Uplink", uplink_filename, rate_traces, uplink_logfile, binary_log, repeat, meter_uplink, meter_uplink_delay,
+                                     get_packet_queue( uplink_queue_type, uplink_queue_args, argv[ 0 ], offload ),
+                                     command_line, offload );
 
-        link_shell_app.start_downlink( "Downlink", downlink_filename, downlink_logfile, repeat, meter_downlink, meter_downlink_delay,
-                                       get_packet_queue( downlink_queue_type, downlink_queue_args, argv[ 0 ] ),
-                                       command_line );
+        link_shell_app.start_downlink( "Downlink", downlink_filename, rate_traces, downlink_logfile, binary_log, repeat, meter_downlink, meter_downlink_delay,
+                                       get_packet_queue( downlink_queue_type, downlink_queue_args, argv[ 0 ], offload ),
+                                       command_line, offload );
 
         return link_shell_app.wait_for_exit();
     } catch ( const exception & e ) {
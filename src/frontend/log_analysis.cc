@@ -0,0 +1,311 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+
+#include "log_analysis.hh"
+#include "link_log.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const uint32_t no_signal = numeric_limits<uint32_t>::max();
+
+LogAnalysis::LogAnalysis( const string & filename, const unsigned int ms_per_bin )
+    : filename_( filename ),
+      ms_per_bin_( ms_per_bin ),
+      have_base_( false ),
+      base_timestamp_( 0 ),
+      have_events_( false ),
+      first_timestamp_( 0 ),
+      last_timestamp_( 0 ),
+      first_bin_( 0 ),
+      capacity_sum_( 0 ),
+      arrival_sum_( 0 ),
+      departure_sum_( 0 ),
+      packets_dropped_( 0 ),
+      bytes_dropped_( 0 ),
+      departures_( 0 ),
+      first_send_( 0 ),
+      finished_( false ),
+      delay_percentile_( 0 ),
+      delay_median_( 0 ),
+      delay_99th_( 0 ),
+      signal_delay_percentile_( 0 )
+{
+    if ( ms_per_bin_ == 0 ) {
+        throw runtime_error( "ms per bin must be positive" );
+    }
+}
+
+/* a whole token of decimal digits */
+static uint64_t parse_number( const string & token, const string & what )
+{
+    if ( token.empty() or token.find_first_not_of( "0123456789" ) != string::npos ) {
+        throw runtime_error( "invalid " + what + ": " + token );
+    }
+
+    return strtoull( token.c_str(), nullptr, 10 );
+}
+
+/* whitespace-separated fields, reusing the caller's strings */
+static void split_fields( const string & line, vector< string > & fields )
+{
+    size_t count = 0, position = 0;
+
+    while ( true ) {
+        const size_t start = line.find_first_not_of( " \t", position );
+        if ( start == string::npos ) {
+            break;
+        }
+
+        const size_t end = min( line.find_first_of( " \t", start ), line.size() );
+
+        if ( count == fields.size() ) {
+            fields.emplace_back();
+        }
+        fields.at( count++ ).assign( line, start, end - start );
+        position = end;
+    }
+
+    fields.resize( count );
+}
+
+void LogAnalysis::read( void )
+{
+    if ( BinaryLinkLog::is_binary_log( filename_ ) ) {
+        BinaryLinkLog log( filename_ );
+
+        istringstream header( log.header() );
+        string line;
+        while ( getline( header, line ) ) {
+            header_line( line );
+        }
+
+        LinkLogRecord record;
+        while ( log.next( record ) ) {
+            /* the binary log keeps us; the text log has ms */
+            event( record.type, record.time / 1000, record.bytes,
+                   record.type == '-' ? record.extra / 1000 : record.extra );
+        }
+    } else {
+        ifstream log( filename_ );
+        if ( not log.good() ) {
+            throw runtime_error( filename_ + ": error opening for reading" );
+        }
+
+        string line;
+        uint64_t line_number = 0;
+        vector< string > tokens;
+
+        while ( getline( log, line ) ) {
+            line_number++;
+
+            if ( not line.empty() and line.front() == '#' ) {
+                header_line( line );
+                continue;
+            }
+
+            try {
+                split_fields( line, tokens );
+
+                if ( tokens.size() < 3 or tokens.size() > 4 or tokens.at( 1 ).size() != 1 ) {
+                    throw runtime_error( "format: timestamp event_type num_bytes [delay]" );
+                }
+
+                if ( tokens.at( 1 ) == "-" and tokens.size() != 4 ) {
+                    throw runtime_error( "departure format: timestamp - num_bytes delay" );
+                }
+
+                event( tokens.at( 1 ).front(), parse_number( tokens.at( 0 ), "timestamp" ),
+                       parse_number( tokens.at( 2 ), "byte count" ),
+                       tokens.size() == 4 ? parse_number( tokens.at( 3 ), "delay" ) : 0 );
+            } catch ( const exception & e ) {
+                throw runtime_error( filename_ + ":" + to_string( line_number ) + ": " + e.what() );
+            }
+        }
+    }
+
+    finish();
+}
+
+void LogAnalysis::header_line( const string & line )
+{
+    const string base_prefix = "# base timestamp: ";
+
+    if ( line.compare( 0, base_prefix.size(), base_prefix ) == 0 ) {
+        if ( have_base_ ) {
+            throw runtime_error( filename_ + ": base timestamp multiply defined" );
+        }
+
+        base_timestamp_ = parse_number( line.substr( base_prefix.size() ), "base timestamp" );
+        have_base_ = true;
+    }
+}
+
+LogAnalysis::Bin & LogAnalysis::bin( const uint64_t timestamp )
+{
+    const uint64_t number = timestamp / ms_per_bin_;
+
+    if ( bins_.empty() ) {
+        first_bin_ = number;
+    }
+
+    while ( number < first_bin_ ) {
+        bins_.push_front( Bin() );
+        first_bin_--;
+    }
+
+    while ( number >= first_bin_ + bins_.size() ) {
+        bins_.push_back( Bin() );
+    }
+
+    return bins_.at( number - first_bin_ );
+}
+
+void LogAnalysis::note_signal_delay( const uint64_t sent, const uint64_t delay )
+{
+    if ( signal_delay_.empty() ) {
+        first_send_ = sent;
+    }
+
+    while ( sent < first_send_ ) {
+        signal_delay_.push_front( no_signal );
+        first_send_--;
+    }
+
+    while ( sent >= first_send_ + signal_delay_.size() ) {
+        signal_delay_.push_back( no_signal );
+    }
+
+    uint32_t & least = signal_delay_.at( sent - first_send_ );
+    least = min( least, uint32_t( min( delay, uint64_t( no_signal - 1 ) ) ) );
+}
+
+void LogAnalysis::event( const char type, const uint64_t timestamp, const uint64_t bytes, const uint64_t extra )
+{
+    if ( not have_base_ ) {
+        throw runtime_error( "logfile is missing base timestamp" );
+    }
+
+    if ( timestamp < base_timestamp_ ) {
+        throw runtime_error( "timestamp " + to_string( timestamp ) + " precedes base timestamp" );
+    }
+
+    /* correct for startup time variation */
+    const uint64_t time = timestamp - base_timestamp_;
+
+    if ( not have_events_ ) {
+        first_timestamp_ = last_timestamp_ = time;
+        have_events_ = true;
+    }
+
+    last_timestamp_ = max( last_timestamp_, time );
+
+    const uint64_t bits = bytes * 8;
+
+    switch ( type ) {
+    case '+':
+        bin( time ).arrivals += bits;
+        arrival_sum_ += bits;
+        break;
+    case '#':
+        bin( time ).capacity += bits;
+        capacity_sum_ += bits;
+        break;
+    case '-':
+        if ( extra > time ) {
+            throw runtime_error( "invalid timestamp and delay: ts=" + to_string( time ) + ", delay=" + to_string( extra ) );
+        }
+
+        bin( time ).departures += bits;
+        departure_sum_ += bits;
+
+        if ( extra >= delay_counts_.size() ) {
+            delay_counts_.resize( extra + 1 );
+        }
+        delay_counts_.at( extra )++;
+        departures_++;
+
+        note_signal_delay( time - extra, extra );
+        break;
+    case 'd':
+        packets_dropped_ += bytes;
+        bytes_dropped_ += extra;
+        break;
+    default:
+        throw runtime_error( string( "unknown event type: " ) + type );
+    }
+}
+
+/* the sample at index floor( fraction * count ) of the sorted delays */
+static uint64_t histogram_percentile( const vector< uint64_t > & counts, const uint64_t total, const double fraction )
+{
+    const uint64_t index = fraction * total;
+    uint64_t seen = 0;
+
+    for ( size_t delay = 0; delay < counts.size(); delay++ ) {
+        seen += counts.at( delay );
+        if ( seen > index ) {
+            return delay;
+        }
+    }
+
+    return 0;
+}
+
+void LogAnalysis::finish( void )
+{
+    if ( finished_ ) {
+        return;
+    }
+
+    finished_ = true;
+
+    if ( not have_events_ ) {
+        throw runtime_error( filename_ + ": must have at least one event" );
+    }
+
+    delay_median_ = histogram_percentile( delay_counts_, departures_, 0.5 );
+    delay_percentile_ = histogram_percentile( delay_counts_, departures_, 0.95 );
+    delay_99th_ = histogram_percentile( delay_counts_, departures_, 0.99 );
+
+    if ( signal_delay_.empty() ) {
+        return;
+    }
+
+    /* nothing sent in a ms: it would have gone with the next ms's, a ms later */
+    for ( size_t i = signal_delay_.size() - 1; i-- > 0; ) {
+        if ( signal_delay_.at( i ) == no_signal ) {
+            signal_delay_.at( i ) = signal_delay_.at( i + 1 ) + 1;
+        }
+    }
+
+    vector< uint32_t > sorted( signal_delay_.begin(), signal_delay_.end() );
+    const auto percentile = sorted.begin() + size_t( 0.95 * sorted.size() );
+    nth_element( sorted.begin(), percentile, sorted.end() );
+    signal_delay_percentile_ = *percentile;
+}
+
+static double mbps( const uint64_t bits, const uint64_t ms )
+{
+    return ms ? bits / (ms / 1000.0) / 1000000.0 : 0;
+}
+
+double LogAnalysis::average_capacity( void ) const
+{
+    return mbps( capacity_sum_, last_timestamp_ - first_timestamp_ );
+}
+
+double LogAnalysis::average_ingress( void ) const
+{
+    return mbps( arrival_sum_, last_timestamp_ - first_timestamp_ );
+}
+
+double LogAnalysis::average_throughput( void ) const
+{
+    return mbps( departure_sum_, last_timestamp_ - first_timestamp_ );
+}
@@ -0,0 +1,96 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef LOG_ANALYSIS_HH
+#define LOG_ANALYSIS_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+/* Statistics of one mm-link log, gathered in a single pass (what
+   mm-throughput-graph and mm-delay-graph compute). Timestamps are in
+   ms after the log's base timestamp; throughput is binned, and delays
+   are kept as counts per ms of delay rather than one by one. */
+
+class LogAnalysis
+{
+public:
+    struct Bin
+    {
+        uint64_t capacity, arrivals, departures; /* bits */
+    };
+
+private:
+    std::string filename_;
+    unsigned int ms_per_bin_;
+
+    bool have_base_;
+    uint64_t base_timestamp_;
+
+    bool have_events_;
+    uint64_t first_timestamp_, last_timestamp_;
+
+    std::deque< Bin > bins_ {};
+    uint64_t first_bin_;
+
+    uint64_t capacity_sum_, arrival_sum_, departure_sum_;
+    uint64_t packets_dropped_, bytes_dropped_;
+
+    std::vector< uint64_t > delay_counts_ {}; /* indexed by per-packet delay */
+    uint64_t departures_;
+
+    /* least delay of anything sent in each ms, from first_send_ on (-1 if none yet) */
+    std::deque< uint32_t > signal_delay_ {};
+    uint64_t first_send_;
+
+    bool finished_;
+
+    uint64_t delay_percentile_, delay_median_, delay_99th_, signal_delay_percentile_;
+
+    Bin & bin( const uint64_t timestamp );
+    void note_signal_delay( const uint64_t sent, const uint64_t delay );
+
+public:
+    LogAnalysis( const std::string & filename, const unsigned int ms_per_bin );
+
+    /* read a whole log, text or binary */
+    void read( void );
+
+    /* one header ("#") line, or one event */
+    void header_line( const std::string & line );
+    void event( const char type, const uint64_t timestamp, const uint64_t bytes, const uint64_t extra );
+
+    /* after the last event: fill in the signal delay and percentiles */
+    void finish( void );
+
+    const std::string & filename( void ) const { return filename_; }
+    unsigned int ms_per_bin( void ) const { return ms_per_bin_; }
+
+    uint64_t first_timestamp( void ) const { return first_timestamp_; }
+    uint64_t last_timestamp( void ) const { return last_timestamp_; }
+
+    /* bins, the first covering first_bin() * ms_per_bin() onward */
+    const std::deque< Bin > & bins( void ) const { return bins_; }
+    uint64_t first_bin( void ) const { return first_bin_; }
+
+    /* means over the log, in Mbits/s */
+    double average_capacity( void ) const;
+    double average_ingress( void ) const;
+    double average_throughput( void ) const;
+
+    uint64_t packets_dropped( void ) const { return packets_dropped_; }
+    uint64_t bytes_dropped( void ) const { return bytes_dropped_; }
+
+    /* per-packet queueing delay (ms) */
+    uint64_t delay_median( void ) const { return delay_median_; }
+    uint64_t delay_percentile( void ) const { return delay_percentile_; } /* 95th */
+    uint64_t delay_99th( void ) const { return delay_99th_; }
+
+    /* signal delay (ms): for each ms, the least time for something sent then to arrive */
+    const std::deque< uint32_t > & signal_delay( void ) const { return signal_delay_; }
+    uint64_t first_send( void ) const { return first_send_; }
+    uint64_t signal_delay_percentile( void ) const { return signal_delay_percentile_; } /* 95th */
+};
+
+#endif /* LOG_ANALYSIS_HH */
@@ -0,0 +1,44 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <iostream>
+
+#include "link_log.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* binary mm-link log -> the text format on stdout (e.g., for mm-throughput-graph) */
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc != 2 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " binary-log" );
+        }
+
+        BinaryLinkLog log( argv[ 1 ] );
+
+        const size_t flush_size = 65536;
+        string lines = log.header();
+        LinkLogRecord record;
+
+        while ( log.next( record ) ) {
+            append_text( record, lines );
+
+            if ( lines.size() >= flush_size ) {
+                cout << lines;
+                lines.clear();
+            }
+        }
+
+        cout << lines << flush;
+
+        if ( not cout.good() ) {
+            throw runtime_error( string( argv[ 0 ] ) + ": error writing" );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -8,48 +8,62 @@
 
 using namespace std;
 
+/* longest a queue with nothing to do asks the ferry to sleep */
+static const unsigned int MAX_WAIT_USECS = numeric_limits<uint16_t>::max() * 1000;
+
 LossQueue::LossQueue()
     : prng_( random_device()() )
 {}
 
-void LossQueue::read_packet( const string & contents )
+void LossQueue::read_packet( PacketBuffer && contents )
 {
     if ( not drop_packet( contents ) ) {
-        packet_queue_.emplace( contents );
+        packet_queue_.emplace( move( contents ) );
     }
 }
 
 void LossQueue::write_packets( FileDescriptor & fd )
 {
     while ( not packet_queue_.empty() ) {
-        fd.write( packet_queue_.front() );
+        packet_queue_.front().write_to( fd );
+        packet_queue_.pop();
+    }
+}
+
+void LossQueue::pass_packets( const function<void(PacketBuffer &&)> & next )
+{
+    while ( not packet_queue_.empty() ) {
+        next( move( packet_queue_.front() ) );
         packet_queue_.pop();
     }
 }
 
 unsigned int LossQueue::wait_time( void )
 {
-    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() : 0;
+    return packet_queue_.empty() ? MAX_WAIT_USECS : 0;
 }
 
-bool IIDLoss::drop_packet( const string & packet __attribute((unused)) )
+bool IIDLoss::drop_packet( const PacketBuffer & packet __attribute((unused)) )
 {
     return drop_dist_( prng_ );
 }
 
-static const double MS_PER_SECOND = 1000.0;
+static const double USECS_PER_SECOND = 1000000.0;
 
 StochasticSwitchingLink::StochasticSwitchingLink( const double mean_on_time, const double mean_off_time )
     : link_is_on_( false ),
-      on_process_( 1.0 / (MS_PER_SECOND * mean_off_time) ),
-      off_process_( 1.0 / (MS_PER_SECOND * mean_on_time) ),
-      next_switch_time_( timestamp() )
+      on_process_( 1.0 / (USECS_PER_SECOND * mean_off_time) ),
+      off_process_( 1.0 / (USECS_PER_SECOND * mean_on_time) ),
+      next_switch_time_( timestamp_usecs() )
 {}
 
 uint64_t bound( const double x )
 {
-    if ( x > (1 << 30) ) {
-        return 1 << 30;
+    /* about twelve days */
+    const uint64_t limit = uint64_t( 1 ) << 40;
+
+    if ( x > limit ) {
+        return limit;
     }
 
     return x;
@@ -57,7 +71,7 @@ uint64_t bound( const double x )
 
 unsigned int StochasticSwitchingLink::wait_time( void )
 {
-    const uint64_t now = timestamp();
+    const uint64_t now = timestamp_usecs();
 
     while ( next_switch_time_ <= now ) {
         /* switch */
@@ -70,23 +84,23 @@ unsigned int StochasticSwitchingLink::wait_time( void )
         return 0;
     }
 
-    if ( next_switch_time_ - now > numeric_limits<uint16_t>::max() ) {
-        return numeric_limits<uint16_t>::max();
+    if ( next_switch_time_ - now > MAX_WAIT_USECS ) {
+        return MAX_WAIT_USECS;
     }
 
     return next_switch_time_ - now;
 }
 
-bool StochasticSwitchingLink::drop_packet( const string & packet __attribute((unused)) )
+bool StochasticSwitchingLink::drop_packet( const PacketBuffer & packet __attribute((unused)) )
 {
     return !link_is_on_;
 }
 
 PeriodicSwitchingLink::PeriodicSwitchingLink( const double on_time, const double off_time )
     : link_is_on_( false ),
-      on_time_( bound( MS_PER_SECOND * on_time ) ),
-      off_time_( bound( MS_PER_SECOND * off_time ) ),
-      next_switch_time_( timestamp() )
+      on_time_( bound( USECS_PER_SECOND * on_time ) ),
+      off_time_( bound( USECS_PER_SECOND * off_time ) ),
+      next_switch_time_( timestamp_usecs() )
 {
   if ( on_time_ == 0 and off_time_ == 0 ) {
       throw runtime_error( "on_time and off_time cannot both be zero" );
@@ -95,7 +109,7 @@ PeriodicSwitchingLink::PeriodicSwitchingLink( const double on_time, const double
 
 unsigned int PeriodicSwitchingLink::wait_time( void )
 {
-    const uint64_t now = timestamp();
+    const uint64_t now = timestamp_usecs();
 
     while ( next_switch_time_ <= now ) {
         /* switch */
@@ -107,14 +121,14 @@ unsigned int PeriodicSwitchingLink::wait_time( void )
         return 0;
     }
 
-    if ( next_switch_time_ - now > numeric_limits<uint16_t>::max() ) {
-        return numeric_limits<uint16_t>::max();
+    if ( next_switch_time_ - now > MAX_WAIT_USECS ) {
+        return MAX_WAIT_USECS;
     }
 
     return next_switch_time_ - now;
 }
 
-bool PeriodicSwitchingLink::drop_packet( const string & packet __attribute((unused)) )
+bool PeriodicSwitchingLink::drop_packet( const PacketBuffer & packet __attribute((unused)) )
 {
     return !link_is_on_;
 }
@@ -7,15 +7,17 @@
 #include <cstdint>
 #include <string>
 #include <random>
+#include <functional>
 
 #include "file_descriptor.hh"
+#include "packet_buffer.hh"
 
 class LossQueue
 {
 private:
-    std::queue<std::string> packet_queue_ {};
+    std::queue<PacketBuffer> packet_queue_ {};
 
-    virtual bool drop_packet( const std::string & packet ) = 0;
+    virtual bool drop_packet( const PacketBuffer & packet ) = 0;
 
 protected:
     std::default_random_engine prng_;
@@ -24,10 +26,17 @@ public:
     LossQueue();
     virtual ~LossQueue() {}
 
-    void read_packet( const std::string & contents );
+    /* packets can be moved but not copied */
+    LossQueue( LossQueue && other ) = default;
+
+    void read_packet( PacketBuffer && contents );
 
     void write_packets( FileDescriptor & fd );
 
+    /* hand the packets that are ready to the next stage of a pipeline */
+    void pass_packets( const std::function<void(PacketBuffer &&)> & next );
+
+    /* microseconds until something may happen */
     unsigned int wait_time( void );
 
     bool pending_output( void ) const { return not packet_queue_.empty(); }
@@ -40,7 +49,7 @@ class IIDLoss : public LossQueue
 private:
     std::bernoulli_distribution drop_dist_;
 
-    bool drop_packet( const std::string & packet ) override;
+    bool drop_packet( const PacketBuffer & packet ) override;
 
 public:
     IIDLoss( const double loss_rate ) : drop_dist_( loss_rate ) {}
@@ -53,9 +62,9 @@ private:
     std::exponential_distribution<> on_process_;
     std::exponential_distribution<> off_process_;
 
-    uint64_t next_switch_time_;
+    uint64_t next_switch_time_; /* microseconds */
 
-    bool drop_packet( const std::string & packet ) override;
+    bool drop_packet( const PacketBuffer & packet ) override;
 
 public:
     StochasticSwitchingLink( const double mean_on_time_, const double mean_off_time );
@@ -67,9 +76,9 @@ class PeriodicSwitchingLink : public LossQueue
 {
 private:
     bool link_is_on_;
-    uint64_t on_time_, off_time_, next_switch_time_;
+    uint64_t on_time_, off_time_, next_switch_time_; /* microseconds */
 
-    bool drop_packet( const std::string & packet ) override;
+    bool drop_packet( const PacketBuffer & packet ) override;
 
 public:
     PeriodicSwitchingLink( const double on_time, const double off_time );
@@ -15,7 +15,7 @@ using namespace std;
 
 void usage( const string & program_name )
 {
-    throw runtime_error( "Usage: " + program_name + " uplink|downlink RATE [COMMAND...]" );
+    throw runtime_error( "Usage: " + program_name + " [--threads=N] uplink|downlink RATE [COMMAND...]" );
 }
 
 int main( int argc, char *argv[] )
@@ -29,11 +29,37 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 3 ) {
+        const option command_line_options[] = {
+            { "threads", required_argument, nullptr, 't' },
+            { 0,                         0, nullptr, 0 }
+        };
+
+        long int threads = 1;
+
+        while ( true ) {
+            /* stop at the direction, so the command keeps its options */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 't':
+                threads = myatoi( optarg );
+                break;
+            case '?':
+                usage( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 2 > argc or threads < 1 or threads > TunDevice::MAX_QUEUES ) {
             usage( argv[ 0 ] );
         }
 
-        const double loss_rate = myatof( argv[ 2 ] );
+        const double loss_rate = myatof( argv[ optind + 1 ] );
         if ( (0 <= loss_rate) and (loss_rate <= 1) ) {
             /* do nothing */
         } else {
@@ -43,7 +69,7 @@ int main( int argc, char *argv[] )
 
         double uplink_loss = 0, downlink_loss = 0;
 
-        const string link = argv[ 1 ];
+        const string link = argv[ optind ];
         if ( link == "uplink" ) {
             uplink_loss = loss_rate;
         } else if ( link == "downlink" ) {
@@ -54,15 +80,16 @@ int main( int argc, char *argv[] )
 
         vector<string> command;
 
-        if ( argc == 3 ) {
+        if ( optind + 2 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 3; i < argc; i++ ) {
+            for ( int i = optind + 2; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
 
-        PacketShell<IIDLoss> loss_app( "loss", user_environment, passthrough_until_signal );
+        PacketShell<IIDLoss> loss_app( "loss", user_environment, passthrough_until_signal,
+                                       false, threads );
 
         string shell_prefix = "[loss ";
         if ( link == "uplink" ) {
@@ -70,7 +97,7 @@ int main( int argc, char *argv[] )
         } else {
             shell_prefix += "down=";
         }
-        shell_prefix += argv[ 2 ];
+        shell_prefix += argv[ optind + 1 ];
         shell_prefix += "] ";
 
         loss_app.start_uplink( shell_prefix,
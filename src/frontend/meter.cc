@@ -3,13 +3,14 @@
 #include <getopt.h>
 
 #include "meter_queue.hh"
+#include "ezio.hh"
 #include "packetshell.cc"
 
 using namespace std;
 
 void usage_error( const string & program_name )
 {
-    throw runtime_error( "Usage: " + program_name + " [--meter-uplink] [--meter-downlink] [COMMAND...]" );
+    throw runtime_error( "Usage: " + program_name + " [--meter-uplink] [--meter-downlink] [--threads=N] [COMMAND...]" );
 }
 
 int main( int argc, char *argv[] )
@@ -24,12 +25,14 @@ int main( int argc, char *argv[] )
         check_requirements( argc, argv );
 
         const option command_line_options[] = {
-            { "meter-uplink",   no_argument, nullptr, 'u' },
-            { "meter-downlink", no_argument, nullptr, 'd' },
-            { 0,                0,           nullptr, 0 }
+            { "meter-uplink",   no_argument,       nullptr, 'u' },
+            { "meter-downlink", no_argument,       nullptr, 'd' },
+            { "threads",        required_argument, nullptr, 't' },
+            { 0,                0,                 nullptr, 0 }
         };
 
         bool meter_uplink = false, meter_downlink = false;
+        long int threads = 1;
 
         while ( true ) {
             const int opt = getopt_long( argc, argv, "ud", command_line_options, nullptr );
@@ -44,6 +47,9 @@ int main( int argc, char *argv[] )
             case 'd':
                 meter_downlink = true;
                 break;
+            case 't':
+                threads = myatoi( optarg );
+                break;
             case '?':
                 usage_error( argv[ 0 ] );
                 break;
@@ -52,6 +58,10 @@ int main( int argc, char *argv[] )
             }
         }
 
+        if ( threads < 1 or threads > TunDevice::MAX_QUEUES ) {
+            usage_error( argv[ 0 ] );
+        }
+
         vector< string > command;
 
         if ( optind == argc ) {
@@ -62,7 +72,8 @@ int main( int argc, char *argv[] )
             }
         }
 
-        PacketShell<MeterQueue> link_shell_app( "meter", user_environment, passthrough_until_signal );
+        PacketShell<MeterQueue> link_shell_app( "meter", user_environment, passthrough_until_signal,
+                                                false, threads );
 
         const string uplink_name = "Uplink", downlink_name = "Downlink";
 
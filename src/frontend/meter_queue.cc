@@ -1,11 +1,31 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
+#include <map>
+#include <mutex>
+
 #include "meter_queue.hh"
 #include "util.hh"
 #include "timestamp.hh"
 
 using namespace std;
 
+/* one window per name, however many ferry threads meter it */
+static shared_ptr<BinnedLiveGraph> named_graph( const string & name )
+{
+    static mutex graphs_mutex;
+    static map<string, weak_ptr<BinnedLiveGraph>> graphs;
+
+    unique_lock<mutex> ul { graphs_mutex };
+
+    shared_ptr<BinnedLiveGraph> graph = graphs[ name ].lock();
+    if ( not graph ) {
+        graph.reset( new BinnedLiveGraph( name, { make_tuple( 0.0, 0.0, 0.4, 1.0, false ) }, "throughput (Mbps)", 8.0 / 1000000.0, true, 500, [] ( int, int & x ) { x = 0; } ) );
+        graphs[ name ] = graph;
+    }
+
+    return graph;
+}
+
 MeterQueue::MeterQueue( const string & name, const bool graph )
     : packet_queue_(),
       graph_( nullptr )
@@ -13,29 +33,37 @@ MeterQueue::MeterQueue( const string & name, const bool graph )
     assert_not_root();
 
     if ( graph ) {
-        graph_.reset( new BinnedLiveGraph( name, { make_tuple( 0.0, 0.0, 0.4, 1.0, false ) }, "throughput (Mbps)", 8.0 / 1000000.0, true, 500, [] ( int, int & x ) { x = 0; } ) );
+        graph_ = named_graph( name );
     }
 }
 
-void MeterQueue::read_packet( const string & contents )
+void MeterQueue::read_packet( PacketBuffer && contents )
 {
-    packet_queue_.emplace( contents );
-
     /* meter it */
     if ( graph_ ) {
         graph_->add_value_now( 0, contents.size() );
     }
+
+    packet_queue_.emplace( move( contents ) );
 }
 
 void MeterQueue::write_packets( FileDescriptor & fd )
 {
     while ( not packet_queue_.empty() ) {
-        fd.write( packet_queue_.front() );
+        packet_queue_.front().write_to( fd );
+        packet_queue_.pop();
+    }
+}
+
+void MeterQueue::pass_packets( const function<void(PacketBuffer &&)> & next )
+{
+    while ( not packet_queue_.empty() ) {
+        next( move( packet_queue_.front() ) );
         packet_queue_.pop();
     }
 }
 
 unsigned int MeterQueue::wait_time( void ) const
 {
-    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() : 0;
+    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() * 1000 : 0;
 }
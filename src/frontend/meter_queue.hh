@@ -6,23 +6,29 @@
 #include <queue>
 #include <string>
 #include <memory>
+#include <functional>
 
 #include "file_descriptor.hh"
+#include "packet_buffer.hh"
 #include "binned_livegraph.hh"
 
 class MeterQueue
 {
 private:
-    std::queue<std::string> packet_queue_;
-    std::unique_ptr<BinnedLiveGraph> graph_;
+    std::queue<PacketBuffer> packet_queue_;
+    std::shared_ptr<BinnedLiveGraph> graph_; /* shared by the queues of ferry threads */
 
 public:
     MeterQueue( const std::string & name, const bool graph );
 
-    void read_packet( const std::string & contents );
+    void read_packet( PacketBuffer && contents );
 
     void write_packets( FileDescriptor & fd );
 
+    /* hand the packets that are ready to the next stage of a pipeline */
+    void pass_packets( const std::function<void(PacketBuffer &&)> & next );
+
+    /* in microseconds */
     unsigned int wait_time( void ) const;
 
     bool pending_output( void ) const { return not packet_queue_.empty(); }
@@ -0,0 +1,446 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <limits>
+
+#include "pipeline_queue.hh"
+#include "delay_queue.hh"
+#include "loss_queue.hh"
+#include "link_queue.hh"
+#include "meter_queue.hh"
+#include "packet_queue_factory.hh"
+#include "util.hh"
+#include "ezio.hh"
+#include "packetshell.cc"
+
+using namespace std;
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " STAGE [ARG]... [+ STAGE [ARG]...]... [-- COMMAND...]" << endl;
+    cerr << "       " << program_name << " --config=FILE [-- COMMAND...]" << endl;
+    cerr << endl;
+    cerr << "STAGE [ARG]... = delay DELAY-MILLISECONDS" << endl;
+    cerr << "               | loss uplink|downlink RATE" << endl;
+    cerr << "               | onoff uplink|downlink MEAN-ON-TIME MEAN-OFF-TIME" << endl;
+    cerr << "               | intermittent uplink|downlink ON-TIME OFF-TIME" << endl;
+    cerr << "               | link UPLINK-TRACE DOWNLINK-TRACE [OPTION]... (as for mm-link)" << endl;
+    cerr << "               | meter [--meter-uplink] [--meter-downlink]" << endl;
+    cerr << endl;
+    cerr << "          Stages are given outermost first, as the shells would be nested." << endl;
+    cerr << "          A config FILE has one stage per line." << endl << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+string shell_quote( const string & arg )
+{
+    string ret = "'";
+    for ( const auto & ch : arg ) {
+        if ( ch != '\'' ) {
+            ret.push_back( ch );
+        } else {
+            ret += "'\\''";
+        }
+    }
+    ret += "'";
+
+    return ret;
+}
+
+/* one stage, as each direction's queue will make it (a stage that does
+   nothing in a direction has no maker for it) */
+struct Stage
+{
+    string shell_prefix {};
+    PipelineQueue::StageMaker uplink {}, downlink {};
+};
+
+template <class QueueType, typename... Targs>
+PipelineQueue::StageMaker stage_maker( const Targs &... Fargs )
+{
+    return [=] () { return unique_ptr<PipelineStage>( new QueueStage<QueueType>( Fargs... ) ); };
+}
+
+/* "uplink" or "downlink" */
+static bool is_uplink( const string & word )
+{
+    if ( word == "uplink" ) {
+        return true;
+    } else if ( word == "downlink" ) {
+        return false;
+    }
+
+    throw runtime_error( "expected uplink or downlink, not \"" + word + "\"" );
+}
+
+static Stage delay_stage( const vector<string> & words )
+{
+    if ( words.size() != 2 ) {
+        throw runtime_error( "usage: delay DELAY-MILLISECONDS" );
+    }
+
+    const long int delay = myatoi( words.at( 1 ) );
+    if ( delay < 0 ) {
+        throw runtime_error( "delay must not be negative" );
+    }
+    const uint64_t delay_ms = delay;
+
+    Stage ret;
+    ret.shell_prefix = "[delay " + to_string( delay_ms ) + " ms] ";
+    ret.uplink = ret.downlink = stage_maker<DelayQueue>( delay_ms );
+    return ret;
+}
+
+static Stage loss_stage( const vector<string> & words )
+{
+    if ( words.size() != 3 ) {
+        throw runtime_error( "usage: loss uplink|downlink RATE" );
+    }
+
+    const bool uplink = is_uplink( words.at( 1 ) );
+    const double loss_rate = myatof( words.at( 2 ) );
+    if ( not ( (0 <= loss_rate) and (loss_rate <= 1) ) ) {
+        throw runtime_error( "loss rate must be between 0 and 1" );
+    }
+
+    Stage ret;
+    ret.shell_prefix = string( "[loss " ) + ( uplink ? "up=" : "down=" ) + words.at( 2 ) + "] ";
+    ( uplink ? ret.uplink : ret.downlink ) = stage_maker<IIDLoss>( loss_rate );
+    return ret;
+}
+
+/* onoff and intermittent */
+template <class SwitchingLinkType>
+static Stage switching_stage( const vector<string> & words )
+{
+    const string & name = words.at( 0 );
+
+    if ( words.size() != 4 ) {
+        throw runtime_error( "usage: " + name + " uplink|downlink ON-TIME OFF-TIME" );
+    }
+
+    const bool uplink = is_uplink( words.at( 1 ) );
+    const double on_time = myatof( words.at( 2 ) ), off_time = myatof( words.at( 3 ) );
+
+    if ( not ( (0 <= on_time) and (0 <= off_time) ) ) {
+        throw runtime_error( name + ": on-time and off-time must not be negative" );
+    } else if ( on_time == 0 and off_time == 0 ) {
+        throw runtime_error( name + ": on-time and off-time cannot both be 0 seconds" );
+    }
+
+    Stage ret;
+    ret.shell_prefix = "[" + name + ( uplink ? " (up)" : " (down)" ) + " on=" + words.at( 2 )
+        + "s off=" + words.at( 3 ) + "s] ";
+    ( uplink ? ret.uplink : ret.downlink ) = stage_maker<SwitchingLinkType>( on_time, off_time );
+    return ret;
+}
+
+static Stage link_stage( const vector<string> & words, const string & command_line )
+{
+    /* the stage's words, as a command line for getopt */
+    vector<string> arguments = words;
+    vector<char *> argv;
+    for ( auto & argument : arguments ) {
+        argv.push_back( &argument[ 0 ] );
+    }
+    argv.push_back( nullptr );
+
+    const option command_line_options[] = {
+        { "uplink-log",           required_argument, nullptr, 'u' },
+        { "downlink-log",         required_argument, nullptr, 'd' },
+        { "binary-log",                 no_argument, nullptr, 'l' },
+        { "once",                       no_argument, nullptr, 'o' },
+        { "rate",                       no_argument, nullptr, 'r' },
+        { "meter-uplink",               no_argument, nullptr, 'm' },
+        { "meter-downlink",             no_argument, nullptr, 'n' },
+        { "meter-uplink-delay",         no_argument, nullptr, 'x' },
+        { "meter-downlink-delay",       no_argument, nullptr, 'y' },
+        { "meter-all",                  no_argument, nullptr, 'z' },
+        { "uplink-queue",         required_argument, nullptr, 'q' },
+        { "downlink-queue",       required_argument, nullptr, 'w' },
+        { "uplink-queue-args",    required_argument, nullptr, 'a' },
+        { "downlink-queue-args",  required_argument, nullptr, 'b' },
+        { 0,                                      0, nullptr, 0 }
+    };
+
+    string uplink_logfile, downlink_logfile;
+    bool binary_log = false, repeat = true, rate_traces = false;
+    bool meter_uplink = false, meter_downlink = false;
+    bool meter_uplink_delay = false, meter_downlink_delay = false;
+    string uplink_queue_type = "infinite", downlink_queue_type = "infinite",
+           uplink_queue_args, downlink_queue_args;
+
+    optind = 0; /* start over */
+
+    while ( true ) {
+        const int opt = getopt_long( argv.size() - 1, &argv[ 0 ], "", command_line_options, nullptr );
+        if ( opt == -1 ) { /* end of options */
+            break;
+        }
+
+        switch ( opt ) {
+        case 'u':
+            uplink_logfile = optarg;
+            break;
+        case 'd':
+            downlink_logfile = optarg;
+            break;
+        case 'l':
+            binary_log = true;
+            break;
+        case 'o':
+            repeat = false;
+            break;
+        case 'r':
+            rate_traces = true;
+            break;
+        case 'm':
+            meter_uplink = true;
+            break;
+        case 'n':
+            meter_downlink = true;
+            break;
+        case 'x':
+            meter_uplink_delay = true;
+            break;
+        case 'y':
+            meter_downlink_delay = true;
+            break;
+        case 'z':
+            meter_uplink = meter_downlink
+                = meter_uplink_delay = meter_downlink_delay
+                = true;
+            break;
+        case 'q':
+            uplink_queue_type = optarg;
+            break;
+        case 'w':
+            downlink_queue_type = optarg;
+            break;
+        case 'a':
+            uplink_queue_args = optarg;
+            break;
+        case 'b':
+            downlink_queue_args = optarg;
+            break;
+        case '?':
+            throw runtime_error( "link: invalid option" );
+        default:
+            throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+        }
+    }
+
+    if ( optind + 2 != int( argv.size() - 1 ) ) {
+        throw runtime_error( "usage: link UPLINK-TRACE DOWNLINK-TRACE [OPTION]..." );
+    }
+
+    const string uplink_filename = argv.at( optind ), downlink_filename = argv.at( optind + 1 );
+
+    /* check the queues now, rather than in the ferries */
+    for ( const auto & queue : { make_pair( uplink_queue_type, uplink_queue_args ),
+                                 make_pair( downlink_queue_type, downlink_queue_args ) } ) {
+        if ( not make_packet_queue( queue.first, queue.second ) ) {
+            throw runtime_error( "link: unknown queue type: " + queue.first );
+        }
+    }
+
+    Stage ret;
+    ret.shell_prefix = "[link] ";
+    ret.uplink = [=] () {
+        return unique_ptr<PipelineStage>( new QueueStage<LinkQueue>(
+            "Uplink", uplink_filename, rate_traces, uplink_logfile, binary_log, repeat,
+            meter_uplink, meter_uplink_delay,
+            make_packet_queue( uplink_queue_type, uplink_queue_args ), command_line ) );
+    };
+    ret.downlink = [=] () {
+        return unique_ptr<PipelineStage>( new QueueStage<LinkQueue>(
+            "Downlink", downlink_filename, rate_traces, downlink_logfile, binary_log, repeat,
+            meter_downlink, meter_downlink_delay,
+            make_packet_queue( downlink_queue_type, downlink_queue_args ), command_line ) );
+    };
+    return ret;
+}
+
+static Stage meter_stage( const vector<string> & words )
+{
+    bool meter_uplink = false, meter_downlink = false;
+
+    for ( size_t i = 1; i < words.size(); i++ ) {
+        if ( words.at( i ) == "--meter-uplink" ) {
+            meter_uplink = true;
+        } else if ( words.at( i ) == "--meter-downlink" ) {
+            meter_downlink = true;
+        } else {
+            throw runtime_error( "usage: meter [--meter-uplink] [--meter-downlink]" );
+        }
+    }
+
+    /* an unmetered direction has nothing to do */
+    Stage ret;
+    ret.shell_prefix = "[meter] ";
+    if ( meter_uplink ) {
+        ret.uplink = stage_maker<MeterQueue>( string( "Uplink" ), true );
+    }
+    if ( meter_downlink ) {
+        ret.downlink = stage_maker<MeterQueue>( string( "Downlink" ), true );
+    }
+    return ret;
+}
+
+static Stage parse_stage( const vector<string> & words, const string & command_line )
+{
+    const string & type = words.at( 0 );
+
+    try {
+        if ( type == "delay" ) {
+            return delay_stage( words );
+        } else if ( type == "loss" ) {
+            return loss_stage( words );
+        } else if ( type == "onoff" ) {
+            return switching_stage<StochasticSwitchingLink>( words );
+        } else if ( type == "intermittent" ) {
+            return switching_stage<PeriodicSwitchingLink>( words );
+        } else if ( type == "link" ) {
+            return link_stage( words, command_line );
+        } else if ( type == "meter" ) {
+            return meter_stage( words );
+        }
+    } catch ( const exception & e ) {
+        throw runtime_error( "stage \"" + type + "\": " + e.what() );
+    }
+
+    throw runtime_error( "unknown stage: " + type );
+}
+
+/* one stage per line; blank lines and # comments are skipped */
+static vector<vector<string>> read_config( const string & filename )
+{
+    /* the file is the user's to read, not root's */
+    TemporarilyUnprivileged tu;
+
+    ifstream config( filename );
+    if ( not config.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    vector<vector<string>> ret;
+    string line;
+
+    while ( getline( config, line ) ) {
+        istringstream line_words( line.substr( 0, line.find( '#' ) ) );
+        vector<string> words;
+        string word;
+        while ( line_words >> word ) {
+            words.push_back( word );
+        }
+
+        if ( not words.empty() ) {
+            ret.push_back( words );
+        }
+    }
+
+    return ret;
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        const bool passthrough_until_signal = getenv( "MAHIMAHI_PASSTHROUGH_UNTIL_SIGNAL" );
+
+        /* clear environment while running as root */
+        char ** const user_environment = environ;
+        environ = nullptr;
+
+        check_requirements( argc, argv );
+
+        string command_line { shell_quote( argv[ 0 ] ) }; /* for the log files */
+        for ( int i = 1; i < argc; i++ ) {
+            command_line += string( " " ) + shell_quote( argv[ i ] );
+        }
+
+        /* the stages (from the arguments or a file), then -- and the command */
+        vector<vector<string>> stage_words;
+        int i = 1;
+
+        const string config_option = "--config=";
+        if ( i < argc and string( argv[ i ] ).compare( 0, config_option.size(), config_option ) == 0 ) {
+            stage_words = read_config( string( argv[ i ] ).substr( config_option.size() ) );
+            i++;
+        } else {
+            for ( ; i < argc and string( argv[ i ] ) != "--"; i++ ) {
+                if ( stage_words.empty() or string( argv[ i ] ) == "+" ) {
+                    stage_words.emplace_back();
+                }
+
+                if ( string( argv[ i ] ) != "+" ) {
+                    stage_words.back().push_back( argv[ i ] );
+                }
+            }
+        }
+
+        vector< string > command;
+
+        if ( i < argc and string( argv[ i ] ) == "--" ) {
+            i++;
+        }
+
+        if ( i < argc ) {
+            if ( string( argv[ i - 1 ] ) != "--" ) {
+                usage_error( argv[ 0 ] );
+            }
+
+            for ( ; i < argc; i++ ) {
+                command.push_back( argv[ i ] );
+            }
+        } else {
+            command.push_back( shell_path() );
+        }
+
+        vector<Stage> stages;
+        for ( const auto & words : stage_words ) {
+            if ( words.empty() ) {
+                usage_error( argv[ 0 ] );
+            }
+
+            stages.push_back( parse_stage( words, command_line ) );
+        }
+
+        if ( stages.empty() ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        /* incoming packets meet the outermost stage first, outgoing ones the innermost;
+           the innermost shell's prompt comes first */
+        vector<PipelineQueue::StageMaker> uplink_stages, downlink_stages;
+        string shell_prefix;
+
+        for ( auto stage = stages.begin(); stage != stages.end(); stage++ ) {
+            if ( stage->downlink ) {
+                downlink_stages.push_back( stage->downlink );
+            }
+        }
+
+        for ( auto stage = stages.rbegin(); stage != stages.rend(); stage++ ) {
+            shell_prefix += stage->shell_prefix;
+            if ( stage->uplink ) {
+                uplink_stages.push_back( stage->uplink );
+            }
+        }
+
+        PacketShell<PipelineQueue> pipeline_app( "pipe", user_environment, passthrough_until_signal );
+
+        pipeline_app.start_uplink( shell_prefix, command, uplink_stages );
+        pipeline_app.start_downlink( downlink_stages );
+        return pipeline_app.wait_for_exit();
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
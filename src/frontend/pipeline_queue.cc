@@ -0,0 +1,75 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <algorithm>
+#include <limits>
+
+#include "pipeline_queue.hh"
+#include "meter_queue.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+PipelineQueue::PipelineQueue( const vector<StageMaker> & stage_makers )
+    : wheel_( new TimerWheel( timestamp_usecs() ) ),
+      stages_()
+{
+    for ( const auto & make_stage : stage_makers ) {
+        stages_.emplace_back( new Stage( make_stage() ) );
+    }
+
+    /* an unmetered meter passes packets straight through */
+    if ( stages_.empty() ) {
+        stages_.emplace_back( new Stage( unique_ptr<PipelineStage>( new QueueStage<MeterQueue>( "", false ) ) ) );
+    }
+}
+
+void PipelineQueue::read_packet( PacketBuffer && contents )
+{
+    stages_.front()->queue->read_packet( move( contents ) );
+    stages_.front()->dirty = true;
+}
+
+void PipelineQueue::write_packets( FileDescriptor & fd )
+{
+    stages_.back()->queue->write_packets( fd );
+    stages_.back()->dirty = true;
+}
+
+unsigned int PipelineQueue::wait_time( void )
+{
+    const uint64_t now = timestamp_usecs();
+
+    wheel_->advance( now ); /* marks the stages that are due */
+
+    for ( size_t i = 0; i < stages_.size(); i++ ) {
+        Stage & stage = *stages_.at( i );
+
+        if ( not stage.dirty ) {
+            continue;
+        }
+        stage.dirty = false;
+
+        /* a packet can go through several stages at once */
+        if ( i + 1 < stages_.size() ) {
+            stage.queue->wait_time(); /* e.g., for a link, make the deliveries due by now */
+            if ( stage.queue->pass_packets( *stages_.at( i + 1 )->queue ) ) {
+                stages_.at( i + 1 )->dirty = true;
+            }
+        }
+
+        wheel_->schedule( stage.deadline, now + stage.queue->wait_time() );
+    }
+
+    const uint64_t next = wheel_->next_expiry();
+    if ( next <= now ) {
+        return 0;
+    }
+
+    return min( next - now, uint64_t( numeric_limits<unsigned int>::max() ) );
+}
+
+bool PipelineQueue::finished( void ) const
+{
+    return any_of( stages_.begin(), stages_.end(),
+                   [] ( const unique_ptr<Stage> & stage ) { return stage->queue->finished(); } );
+}
@@ -0,0 +1,110 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PIPELINE_QUEUE_HH
+#define PIPELINE_QUEUE_HH
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "file_descriptor.hh"
+#include "packet_buffer.hh"
+#include "timer_wheel.hh"
+
+/* one emulator (a delay, a loss process, a link, a meter) in a pipeline */
+class PipelineStage
+{
+public:
+    virtual void read_packet( PacketBuffer && contents ) = 0;
+
+    /* hand the packets that are ready to the next stage; returns how many */
+    virtual unsigned int pass_packets( PipelineStage & next ) = 0;
+
+    virtual void write_packets( FileDescriptor & fd ) = 0;
+
+    /* microseconds until something may happen (also brings the stage up to date) */
+    virtual unsigned int wait_time( void ) = 0;
+
+    virtual bool pending_output( void ) const = 0;
+
+    virtual bool finished( void ) const = 0;
+
+    virtual ~PipelineStage() {}
+};
+
+/* any of the shells' queues (DelayQueue, a LossQueue, LinkQueue, MeterQueue) as a stage */
+template <class QueueType>
+class QueueStage : public PipelineStage
+{
+private:
+    QueueType queue_;
+
+public:
+    template <typename... Targs>
+    QueueStage( Targs&&... Fargs ) : queue_( std::forward<Targs>( Fargs )... ) {}
+
+    void read_packet( PacketBuffer && contents ) override { queue_.read_packet( std::move( contents ) ); }
+
+    unsigned int pass_packets( PipelineStage & next ) override
+    {
+        unsigned int count = 0;
+        queue_.pass_packets( [&next, &count] ( PacketBuffer && contents ) {
+                next.read_packet( std::move( contents ) );
+                count++;
+            } );
+        return count;
+    }
+
+    void write_packets( FileDescriptor & fd ) override { queue_.write_packets( fd ); }
+
+    unsigned int wait_time( void ) override { return queue_.wait_time(); }
+
+    bool pending_output( void ) const override { return queue_.pending_output(); }
+
+    bool finished( void ) const override { return queue_.finished(); }
+};
+
+/* Several emulators in one ferry. Each packet passes through the stages
+   in order, as it would through the same shells nested, but without
+   crossing the kernel (and a TUN device) between one and the next.
+   Each stage keeps its deadline in a timer wheel, and only the stages
+   that are due, or were handed packets, are brought up to date. */
+class PipelineQueue
+{
+private:
+    struct Stage
+    {
+        std::unique_ptr<PipelineStage> queue;
+        TimerWheel::Timer deadline;
+        bool dirty; /* due, or its packets changed, since its deadline was set */
+
+        Stage( std::unique_ptr<PipelineStage> && s_queue )
+            : queue( std::move( s_queue ) ), deadline( [this] () { dirty = true; } ), dirty( true ) {}
+    };
+
+    /* on the heap, so the timers stay put when the queue is moved
+       (the wheel is declared first, to outlive the timers) */
+    std::unique_ptr<TimerWheel> wheel_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+
+public:
+    typedef std::function<std::unique_ptr<PipelineStage>(void)> StageMaker;
+
+    /* with no stages, packets pass straight through */
+    PipelineQueue( const std::vector<StageMaker> & stage_makers );
+
+    void read_packet( PacketBuffer && contents );
+
+    void write_packets( FileDescriptor & fd );
+
+    /* moves packets along the pipeline, then gives the microseconds
+       until any stage may have something to do */
+    unsigned int wait_time( void );
+
+    bool pending_output( void ) const { return stages_.back()->queue->pending_output(); }
+
+    /* when any stage is (e.g., a link that ran out of trace) */
+    bool finished( void ) const;
+};
+
+#endif /* PIPELINE_QUEUE_HH */
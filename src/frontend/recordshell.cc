@@ -4,6 +4,7 @@
 #include <sys/ioctl.h>
 #include <linux/if.h>
 #include <net/route.h>
+#include <getopt.h>
 
 #include "nat.hh"
 #include "util.hh"
@@ -29,27 +30,52 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " directory [command...]" );
+        const string usage = "Usage: " + string( argv[ 0 ] ) + " [--archive] directory|archive [command...]";
+
+        const option command_line_options[] = {
+            { "archive", no_argument, nullptr, 'a' },
+            { 0,                   0, nullptr, 0 }
+        };
+
+        bool use_archive = false;
+
+        while ( true ) {
+            /* "+": stop at the first non-option so the command keeps its own options */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'a':
+                use_archive = true;
+                break;
+            default:
+                throw runtime_error( usage );
+            }
+        }
+
+        if ( optind >= argc ) {
+            throw runtime_error( usage );
         }
 
         /* Make sure directory ends with '/' so we can prepend directory to file name for storage */
-        string directory( argv[ 1 ] );
+        string directory( argv[ optind ] );
 
         if ( directory.empty() ) {
             throw runtime_error( string( argv[ 0 ] ) + ": directory name must be non-empty" );
         }
 
-        if ( directory.back() != '/' ) {
+        if ( (not use_archive) and directory.back() != '/' ) {
             directory.append( "/" );
         }
 
         /* what command will we run inside the container? */
         vector < string > command;
-        if ( argc == 2 ) {
+        if ( optind + 1 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = optind + 1; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
@@ -149,15 +175,26 @@ int main( int argc, char *argv[] )
         outer_event_loop.add_child_process( "recorder", [&]() {
                 drop_privileges();
 
-                make_directory( directory );
-
                 /* set up backing store to save to disk */
-                HTTPDiskStore disk_backing_store( directory );
+                unique_ptr< HTTPBackingStore > disk_store;
+                if ( use_archive ) {
+                    disk_store.reset( new HTTPArchiveStore( directory ) );
+                } else {
+                    make_directory( directory );
+                    disk_store.reset( new HTTPDiskStore( directory ) );
+                }
+
+                /* keep the disk writes off the proxy's threads */
+                unique_ptr< HTTPBackingStore > backing_store( new HTTPAsyncStore( move( disk_store ) ) );
 
                 EventLoop recordr_event_loop;
                 dns_outside.register_handlers( recordr_event_loop );
-                http_proxy.register_handlers( recordr_event_loop, disk_backing_store );
-                return recordr_event_loop.loop();
+                http_proxy.register_handlers( recordr_event_loop, *backing_store );
+                const int status = recordr_event_loop.loop();
+
+                /* the proxy's workers save to the backing store, so stop them before it goes away */
+                http_proxy.stop();
+                return status;
             } );
 
         return outer_event_loop.loop();
@@ -16,6 +16,8 @@
 #include "http_request.hh"
 #include "http_response.hh"
 #include "file_descriptor.hh"
+#include "recording_index.hh"
+#include "recording_archive.hh"
 
 using namespace std;
 
@@ -28,77 +30,23 @@ string safe_getenv( const string & key )
     return value;
 }
 
-/* does the actual HTTP header match this stored request? */
-bool header_match( const string & env_var_name,
-                   const string & header_name,
-                   const HTTPRequest & saved_request )
+/* the parts of the incoming request (from the CGI environment) that matter for matching */
+HTTPRequest incoming_request( const string & request_line )
 {
-    const char * const env_value = getenv( env_var_name.c_str() );
-
-    /* case 1: neither header exists (OK) */
-    if ( (not env_value) and (not saved_request.has_header( header_name )) ) {
-        return true;
-    }
-
-    /* case 2: headers both exist (OK if values match) */
-    if ( env_value and saved_request.has_header( header_name ) ) {
-        return saved_request.get_header_value( header_name ) == string( env_value );
-    }
-
-    /* case 3: one exists but the other doesn't (failure) */
-    return false;
-}
-
-string strip_query( const string & request_line )
-{
-    const auto index = request_line.find( "?" );
-    if ( index == string::npos ) {
-        return request_line;
-    } else {
-        return request_line.substr( 0, index );
-    }
-}
-
-/* compare request_line and certain headers of incoming request and stored request */
-unsigned int match_score( const MahimahiProtobufs::RequestResponse & saved_record,
-                          const string & request_line,
-                          const bool is_https )
-{
-    const HTTPRequest saved_request( saved_record.request() );
-
-    /* match HTTP/HTTPS */
-    if ( is_https and (saved_record.scheme() != MahimahiProtobufs::RequestResponse_Scheme_HTTPS) ) {
-        return 0;
-    }
-
-    if ( (not is_https) and (saved_record.scheme() != MahimahiProtobufs::RequestResponse_Scheme_HTTP) ) {
-        return 0;
-    }
-
-    /* match host header */
-    if ( not header_match( "HTTP_HOST", "Host", saved_request ) ) {
-        return 0;
-    }
-
-    /* match user agent */
-    if ( not header_match( "HTTP_USER_AGENT", "User-Agent", saved_request ) ) {
-        return 0;
-    }
-
-    /* must match first line up to "?" at least */
-    if ( strip_query( request_line ) != strip_query( saved_request.first_line() ) ) {
-        return 0;
-    }
-
-    /* success! return size of common prefix */
-    const auto max_match = min( request_line.size(), saved_request.first_line().size() );
-    for ( unsigned int i = 0; i < max_match; i++ ) {
-        if ( request_line.at( i ) != saved_request.first_line().at( i ) ) {
-            return i;
+    MahimahiProtobufs::HTTPMessage request;
+    request.set_first_line( request_line );
+
+    for ( const auto & header : { make_pair( "HTTP_HOST", "Host" ),
+                                  make_pair( "HTTP_USER_AGENT", "User-Agent" ) } ) {
+        const char * const value = getenv( header.first );
+        if ( value ) {
+            MahimahiProtobufs::HTTPHeader * const new_header = request.add_header();
+            new_header->set_key( header.second );
+            new_header->set_value( value );
         }
     }
 
-    return max_match;
+    return HTTPRequest( request );
 }
 
 int main( void )
@@ -115,23 +63,52 @@ int main( void )
 
         SystemCall( "chdir", chdir( working_directory.c_str() ) );
 
-        const vector< string > files = list_directory_contents( recording_directory );
+        const HTTPRequest request = incoming_request( request_line );
+        const string key = recording_key( is_https,
+                                          request.has_header( "Host" ) ? request.get_header_value( "Host" ) : "",
+                                          request_line );
 
         unsigned int best_score = 0;
         MahimahiProtobufs::RequestResponse best_match;
 
-        for ( const auto & filename : files ) {
-            FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
-            MahimahiProtobufs::RequestResponse current_record;
-            if ( not current_record.ParseFromFileDescriptor( fd.fd_num() ) ) {
-                throw runtime_error( filename + ": invalid HTTP request/response" );
-            }
-
-            unsigned int score = match_score( current_record, request_line, is_https );
+        const auto consider = [&] ( const MahimahiProtobufs::RequestResponse & current_record ) {
+            unsigned int score = match_score( HTTPRequest( current_record.request() ),
+                                              current_record.scheme() == MahimahiProtobufs::RequestResponse_Scheme_HTTPS,
+                                              request, is_https );
             if ( score > best_score ) {
                 best_match = current_record;
                 best_score = score;
             }
+        };
+
+        if ( RecordingArchive::is_archive( recording_directory ) ) {
+            /* parse the candidates straight out of the mapped archive */
+            const RecordingArchive archive( recording_directory );
+            for ( const auto & i : archive.lookup( key ) ) {
+                consider( archive.record( i ) );
+            }
+        } else {
+            /* with an index, only parse the records that can possibly match */
+            vector< string > files;
+            const char * const index_filename = getenv( "MAHIMAHI_RECORD_INDEX" );
+            if ( index_filename ) {
+                FileDescriptor index_fd( SystemCall( "open", open( index_filename, O_RDONLY ) ) );
+                for ( const auto & filename : RecordingIndex( index_fd ).lookup( key ) ) {
+                    files.push_back( recording_directory + filename );
+                }
+            } else {
+                files = list_directory_contents( recording_directory );
+            }
+
+            for ( const auto & filename : files ) {
+                FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
+                MahimahiProtobufs::RequestResponse current_record;
+                if ( not current_record.ParseFromFileDescriptor( fd.fd_num() ) ) {
+                    throw runtime_error( filename + ": invalid HTTP request/response" );
+                }
+
+                consider( current_record );
+            }
         }
 
         if ( best_score > 0 ) { /* give client the best match */
@@ -2,9 +2,11 @@
 
 #include <net/route.h>
 #include <fcntl.h>
+#include <getopt.h>
 
 #include <vector>
 #include <set>
+#include <memory>
 
 #include "util.hh"
 #include "netdevice.hh"
@@ -16,6 +18,10 @@
 #include "http_response.hh"
 #include "dns_server.hh"
 #include "exception.hh"
+#include "recording_index.hh"
+#include "recording_archive.hh"
+#include "replay_store.hh"
+#include "replay_server.hh"
 
 #include "http_record.pb.h"
 
@@ -42,19 +48,52 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " directory [command...]" );
+        const string usage = "Usage: " + string( argv[ 0 ] ) + " [--apache] directory|archive [command...]";
+
+        const option command_line_options[] = {
+            { "apache", no_argument, nullptr, 'a' },
+            { 0,                  0, nullptr, 0 }
+        };
+
+        /* serve with an Apache (and a forked mm-replayserver per request) for each server, instead of in-process */
+        bool use_apache = false;
+
+        while ( true ) {
+            /* "+": stop at the first non-option so the command keeps its own options */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'a':
+                use_apache = true;
+                break;
+            default:
+                throw runtime_error( usage );
+            }
+        }
+
+        if ( optind >= argc ) {
+            throw runtime_error( usage );
         }
 
         /* clean directory name */
-        string directory = argv[ 1 ];
+        string directory = argv[ optind ];
 
         if ( directory.empty() ) {
             throw runtime_error( string( argv[ 0 ] ) + ": directory name must be non-empty" );
         }
 
+        /* recorded with mm-webrecord --archive (or packed with mm-webarchive)? */
+        bool archive;
+        {
+            TemporarilyUnprivileged tu;
+            archive = RecordingArchive::is_archive( directory );
+        }
+
         /* make sure directory ends with '/' so we can prepend directory to file name for storage */
-        if ( directory.back() != '/' ) {
+        if ( (not archive) and directory.back() != '/' ) {
             directory.append( "/" );
         }
 
@@ -66,10 +105,10 @@ int main( int argc, char *argv[] )
 
         /* what command will we run inside the container? */
         vector< string > command;
-        if ( argc == 2 ) {
+        if ( optind + 1 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = optind + 1; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
@@ -89,27 +128,60 @@ int main( int argc, char *argv[] )
         set< Address > unique_ip_and_port;
         vector< pair< string, Address > > hostname_to_ip;
 
+        /* the recording held in memory by the in-process server */
+        unique_ptr< ReplayStore > store;
+
+        /* index of the recording so mm-replayserver doesn't have to parse every file per request */
+        unique_ptr< TempFile > index_file;
+
         {
             TemporarilyUnprivileged tu;
             /* would be privilege escalation if we let the user read directories or open files as root */
 
-            const vector< string > files = list_directory_contents( directory  );
+            const auto add_server = [&] ( const Address & address, const HTTPRequest & request ) {
+                unique_ip.emplace( address.ip(), 0 );
+                unique_ip_and_port.emplace( address );
+
+                hostname_to_ip.emplace_back( request.get_header_value( "Host" ), address );
+            };
+
+            const auto add_record = [&] ( const MahimahiProtobufs::RequestResponse & protobuf ) {
+                add_server( Address( protobuf.ip(), protobuf.port() ), HTTPRequest( protobuf.request() ) );
+            };
+
+            if ( not use_apache ) {
+                store.reset( new ReplayStore( directory ) );
 
-            for ( const auto & filename : files ) {
-                FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
+                for ( const auto & entry : store->entries() ) {
+                    add_server( entry.server_address, entry.request );
+                }
+            } else if ( archive ) {
+                /* the archive carries its own index */
+                const RecordingArchive recording_archive( directory );
 
-                MahimahiProtobufs::RequestResponse protobuf;
-                if ( not protobuf.ParseFromFileDescriptor( fd.fd_num() ) ) {
-                    throw runtime_error( filename + ": invalid HTTP request/response" );
+                for ( size_t i = 0; i < recording_archive.size(); i++ ) {
+                    add_record( recording_archive.record( i ) );
                 }
+            } else {
+                const vector< string > files = list_directory_contents( directory  );
+                RecordingIndex recording_index;
 
-                const Address address( protobuf.ip(), protobuf.port() );
+                for ( const auto & filename : files ) {
+                    FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
 
-                unique_ip.emplace( address.ip(), 0 );
-                unique_ip_and_port.emplace( address );
+                    MahimahiProtobufs::RequestResponse protobuf;
+                    if ( not protobuf.ParseFromFileDescriptor( fd.fd_num() ) ) {
+                        throw runtime_error( filename + ": invalid HTTP request/response" );
+                    }
+
+                    add_record( protobuf );
 
-                hostname_to_ip.emplace_back( HTTPRequest( protobuf.request() ).get_header_value( "Host" ),
-                                             address );
+                    recording_index.add( protobuf, filename.substr( directory.size() ) );
+                }
+
+                /* created unprivileged so that mm-replayserver can read it */
+                index_file.reset( new TempFile( "/tmp/replayshell_index" ) );
+                recording_index.save( index_file->fd() );
             }
         }
 
@@ -122,8 +194,15 @@ int main( int argc, char *argv[] )
 
         /* set up web servers */
         vector< WebServer > servers;
-        for ( const auto & ip_port : unique_ip_and_port ) {
-            servers.emplace_back( ip_port, working_directory, directory );
+        unique_ptr< ReplayServer > replay_server;
+        if ( use_apache ) {
+            for ( const auto & ip_port : unique_ip_and_port ) {
+                servers.emplace_back( ip_port, working_directory, directory,
+                                      index_file ? index_file->name() : "" );
+            }
+        } else {
+            /* bind while still privileged; serving happens in an unprivileged child below */
+            replay_server.reset( new ReplayServer( unique_ip_and_port ) );
         }
 
         /* set up DNS server */
@@ -147,6 +226,17 @@ int main( int argc, char *argv[] )
         /* start dnsmasq */
         event_loop.add_child_process( start_dnsmasq( dnsmasq_args ) );
 
+        /* start in-process web server */
+        if ( replay_server ) {
+            event_loop.add_child_process( "replayserver", [&]() {
+                    drop_privileges();
+
+                    EventLoop server_event_loop;
+                    replay_server->register_handlers( server_event_loop, *store );
+                    return server_event_loop.loop();
+                } );
+        }
+
         /* start shell */
         event_loop.add_child_process( join( command ), [&]() {
                 drop_privileges();
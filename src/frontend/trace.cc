@@ -0,0 +1,76 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "link_trace.hh"
+#include "file_descriptor.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* text (or binary) trace -> binary trace */
+void pack( const string & trace_filename, const string & binary_filename )
+{
+    const unique_ptr<LinkTrace> trace = LinkTrace::open( trace_filename );
+    write_binary_trace( *trace, binary_filename );
+}
+
+/* binary (or text) trace -> text trace, one timestamp per line */
+void unpack( const string & trace_filename, const string & text_filename )
+{
+    const unique_ptr<LinkTrace> trace = LinkTrace::open( trace_filename );
+
+    FileDescriptor fd( SystemCall( "open " + text_filename,
+                                   open( text_filename.c_str(), O_WRONLY | O_CREAT | O_EXCL,
+                                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH ) ) );
+
+    const size_t flush_size = 65536;
+    string lines;
+
+    do {
+        /* a long run is written out as it goes, not gathered whole */
+        const string line = to_string( trace->timestamp() ) + "\n";
+        for ( uint64_t i = 0; i < trace->run_length(); i++ ) {
+            lines += line;
+
+            if ( lines.size() >= flush_size ) {
+                fd.write( lines );
+                lines.clear();
+            }
+        }
+    } while ( trace->next_run() );
+
+    if ( not lines.empty() ) {
+        fd.write( lines );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc != 4 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " pack text-trace binary-trace | unpack binary-trace text-trace" );
+        }
+
+        const string operation = argv[ 1 ], from = argv[ 2 ], to = argv[ 3 ];
+
+        if ( from.empty() or to.empty() ) {
+            throw runtime_error( string( argv[ 0 ] ) + ": file names must be non-empty" );
+        }
+
+        if ( operation == "pack" ) {
+            pack( from, to );
+        } else if ( operation == "unpack" ) {
+            unpack( from, to );
+        } else {
+            throw runtime_error( string( argv[ 0 ] ) + ": unknown operation " + operation );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -13,7 +13,8 @@
 
 using namespace std;
 
-WebServer::WebServer( const Address & addr, const string & working_directory, const string & record_path )
+WebServer::WebServer( const Address & addr, const string & working_directory, const string & record_path,
+                      const string & record_index )
     : config_file_( "/tmp/replayshell_apache_config" ),
       moved_away_( false )
 {
@@ -21,6 +22,9 @@ WebServer::WebServer( const Address & addr, const string & working_directory, co
 
     config_file_.write( "WorkingDir " + working_directory + "\n" );
     config_file_.write( "RecordingDir " + record_path + "\n" );
+    if ( not record_index.empty() ) {
+        config_file_.write( "RecordingIndex " + record_index + "\n" );
+    }
 
     /* if port 443, add ssl components */
     if ( addr.port() == 443 ) { /* ssl */
@@ -0,0 +1,89 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fcntl.h>
+
+#include <algorithm>
+
+#include "util.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "temp_file.hh"
+#include "recording_archive.hh"
+
+#include "http_record.pb.h"
+
+using namespace std;
+
+/* directory of recorded files -> single archive */
+void pack( string directory, const string & archive_filename )
+{
+    if ( directory.back() != '/' ) {
+        directory.append( "/" );
+    }
+
+    vector< string > files = list_directory_contents( directory );
+    sort( files.begin(), files.end() );
+
+    RecordingArchiveWriter archive( archive_filename );
+
+    for ( const auto & filename : files ) {
+        FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
+
+        MahimahiProtobufs::RequestResponse protobuf;
+        if ( not protobuf.ParseFromFileDescriptor( fd.fd_num() ) ) {
+            throw runtime_error( filename + ": invalid HTTP request/response" );
+        }
+
+        archive.append( protobuf );
+    }
+
+    archive.finish();
+}
+
+/* single archive -> directory of recorded files, as mm-webrecord would have written */
+void unpack( const string & archive_filename, string directory )
+{
+    if ( directory.back() != '/' ) {
+        directory.append( "/" );
+    }
+
+    const RecordingArchive archive( archive_filename );
+
+    make_directory( directory );
+
+    for ( size_t i = 0; i < archive.size(); i++ ) {
+        UniqueFile file( directory + "save" );
+
+        if ( not archive.record( i ).SerializeToFileDescriptor( file.fd().fd_num() ) ) {
+            throw runtime_error( "unpack: failure to serialize HTTP request/response pair" );
+        }
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc != 4 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " pack directory archive | unpack archive directory" );
+        }
+
+        const string operation = argv[ 1 ], from = argv[ 2 ], to = argv[ 3 ];
+
+        if ( from.empty() or to.empty() ) {
+            throw runtime_error( string( argv[ 0 ] ) + ": file and directory names must be non-empty" );
+        }
+
+        if ( operation == "pack" ) {
+            pack( from, to );
+        } else if ( operation == "unpack" ) {
+            unpack( from, to );
+        } else {
+            throw runtime_error( string( argv[ 0 ] ) + ": unknown operation " + operation );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -3,34 +3,121 @@
 #include "backing_store.hh"
 #include "http_record.pb.h"
 #include "temp_file.hh"
+#include "exception.hh"
 
 using namespace std;
 
+static MahimahiProtobufs::RequestResponse to_protobuf( const HTTPResponse & response, const Address & server_address )
+{
+    MahimahiProtobufs::RequestResponse output;
+
+    output.set_ip( server_address.ip() );
+    output.set_port( server_address.port() );
+    output.set_scheme( server_address.port() == 443
+                       ? MahimahiProtobufs::RequestResponse_Scheme_HTTPS
+                       : MahimahiProtobufs::RequestResponse_Scheme_HTTP );
+    output.mutable_request()->CopyFrom( response.request().toprotobuf() );
+    output.mutable_response()->CopyFrom( response.toprotobuf() );
+
+    return output;
+}
+
+void HTTPBackingStore::save( const HTTPResponse & response, const Address & server_address )
+{
+    save_record( to_protobuf( response, server_address ) );
+}
+
 HTTPDiskStore::HTTPDiskStore( const string & record_folder )
     : record_folder_( record_folder ),
       mutex_()
 {}
 
-void HTTPDiskStore::save( const HTTPResponse & response, const Address & server_address )
+void HTTPDiskStore::save_record( const MahimahiProtobufs::RequestResponse & record )
 {
     unique_lock<mutex> ul( mutex_ );
 
     /* output file to write current request/response pair protobuf (user has all permissions) */
     UniqueFile file( record_folder_ + "save" );
 
-    /* construct protocol buffer */
-    MahimahiProtobufs::RequestResponse output;
+    if ( not record.SerializeToFileDescriptor( file.fd().fd_num() ) ) {
+        throw runtime_error( "save_to_disk: failure to serialize HTTP request/response pair" );
+    }
 
-    output.set_ip( server_address.ip() );
-    output.set_port( server_address.port() );
-    output.set_scheme( server_address.port() == 443
-                       ? MahimahiProtobufs::RequestResponse_Scheme_HTTPS
-                       : MahimahiProtobufs::RequestResponse_Scheme_HTTP );
-    output.mutable_request()->CopyFrom( response.request().toprotobuf() );
-    output.mutable_response()->CopyFrom( response.toprotobuf() );
+}
 
-    if ( not output.SerializeToFileDescriptor( file.fd().fd_num() ) ) {
-        throw runtime_error( "save_to_disk: failure to serialize HTTP request/response pair" );
+HTTPArchiveStore::HTTPArchiveStore( const string & archive_filename )
+    : archive_( archive_filename ),
+      mutex_()
+{}
+
+void HTTPArchiveStore::save_record( const MahimahiProtobufs::RequestResponse & record )
+{
+    unique_lock<mutex> ul( mutex_ );
+
+    archive_.append( record );
+}
+
+HTTPAsyncStore::HTTPAsyncStore( unique_ptr< HTTPBackingStore > && store, const size_t queue_limit )
+    : store_( move( store ) ),
+      queue_limit_( queue_limit ),
+      queue_(),
+      halt_( false ),
+      mutex_(),
+      not_empty_(),
+      not_full_(),
+      writer_( [&] () { write_loop(); } )
+{}
+
+HTTPAsyncStore::~HTTPAsyncStore()
+{
+    {
+        unique_lock<mutex> ul( mutex_ );
+        halt_ = true;
     }
 
+    not_empty_.notify_one();
+    writer_.join();
+}
+
+void HTTPAsyncStore::save_record( const MahimahiProtobufs::RequestResponse & record )
+{
+    unique_lock<mutex> ul( mutex_ );
+
+    not_full_.wait( ul, [&] () { return queue_.size() < queue_limit_; } );
+
+    queue_.push_back( record );
+
+    ul.unlock();
+    not_empty_.notify_one();
+}
+
+void HTTPAsyncStore::write_loop( void )
+{
+    deque< MahimahiProtobufs::RequestResponse > batch;
+
+    while ( true ) {
+        {
+            unique_lock<mutex> ul( mutex_ );
+            not_empty_.wait( ul, [&] () { return halt_ or not queue_.empty(); } );
+
+            if ( queue_.empty() ) {
+                return; /* halted, and everything has been written */
+            }
+
+            /* take everything that is waiting */
+            batch.swap( queue_ );
+        }
+
+        not_full_.notify_all();
+
+        for ( const auto & record : batch ) {
+            try {
+                store_->save_record( record );
+            } catch ( const exception & e ) {
+                print_exception( e );
+            }
+        }
+
+        batch.clear();
+    }
 }
@@ -5,16 +5,24 @@
 
 #include <string>
 #include <mutex>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <condition_variable>
 
 #include "http_request.hh"
 #include "http_response.hh"
 #include "address.hh"
+#include "recording_archive.hh"
 
 /* abstract base class to store an HTTP request/response from a particular server address */
 class HTTPBackingStore
 {
 public:
-    virtual void save( const HTTPResponse & response, const Address & server_address ) = 0;
+    /* converts the pair to a record and saves it */
+    void save( const HTTPResponse & response, const Address & server_address );
+
+    virtual void save_record( const MahimahiProtobufs::RequestResponse & record ) = 0;
     virtual ~HTTPBackingStore() {}
 };
 
@@ -26,7 +34,47 @@ private:
 
 public:
     HTTPDiskStore( const std::string & record_folder );
-    void save( const HTTPResponse & response, const Address & server_address ) override;
+    void save_record( const MahimahiProtobufs::RequestResponse & record ) override;
+};
+
+/* appends every request/response to a single recording archive */
+class HTTPArchiveStore : public HTTPBackingStore
+{
+private:
+    RecordingArchiveWriter archive_;
+    std::mutex mutex_;
+
+public:
+    HTTPArchiveStore( const std::string & archive_filename );
+    void save_record( const MahimahiProtobufs::RequestResponse & record ) override;
+};
+
+/* hands each request/response to another store on a writer thread, so
+   that callers don't wait on the disk unless the queue is full */
+class HTTPAsyncStore : public HTTPBackingStore
+{
+private:
+    std::unique_ptr< HTTPBackingStore > store_;
+
+    /* saves waiting for the writer */
+    const size_t queue_limit_;
+    std::deque< MahimahiProtobufs::RequestResponse > queue_;
+    bool halt_;
+
+    std::mutex mutex_;
+    std::condition_variable not_empty_, not_full_;
+
+    std::thread writer_;
+
+    void write_loop( void );
+
+public:
+    HTTPAsyncStore( std::unique_ptr< HTTPBackingStore > && store, const size_t queue_limit = 4096 );
+
+    /* finishes every queued save before returning */
+    ~HTTPAsyncStore();
+
+    void save_record( const MahimahiProtobufs::RequestResponse & record ) override;
 };
 
 #endif /* BACKING_STORE_HH */
@@ -76,6 +76,16 @@ void HTTPMessage::eof( void )
     }
 }
 
+size_t HTTPMessage::body_bytes_wanted( void ) const
+{
+    if ( not body_size_is_known() ) {
+        return string::npos;
+    }
+
+    assert( body_.size() <= expected_body_size() );
+    return expected_body_size() - body_.size();
+}
+
 bool HTTPMessage::body_size_is_known( void ) const
 {
     assert( state_ > HEADERS_PENDING );
@@ -61,6 +61,9 @@ public:
     /* getters */
     bool body_size_is_known( void ) const;
     size_t expected_body_size( void ) const;
+
+    /* how many more bytes the body can take (npos if not known in advance) */
+    size_t body_bytes_wanted( void ) const;
     const HTTPMessageState & state( void ) const { return state_; }
     const std::string & first_line( void ) const { return first_line_; }
 
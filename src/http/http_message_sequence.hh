@@ -5,6 +5,8 @@
 
 #include <string>
 #include <queue>
+#include <algorithm>
+#include <cassert>
 
 #include "http_message.hh"
 
@@ -12,23 +14,41 @@ template <class MessageType>
 class HTTPMessageSequence
 {
 private:
+    /* bytes are consumed by advancing a cursor, and the consumed prefix
+       is only erased once it is at least half of the string, so popping
+       is O(1) amortized. The search for CRLF resumes where the last
+       unsuccessful search left off. */
     class InternalBuffer
     {
     private:
         std::string buffer_ {};
-    
+
+        /* start of the bytes not yet consumed */
+        size_t offset_ { 0 };
+
+        /* no line ending starts before here (at or after offset_) */
+        size_t scanned_ { 0 };
+
+        /* end of the first complete line, if found */
+        size_t line_end_ { std::string::npos };
+
+        void compact( void );
+
     public:
-        bool have_complete_line( void ) const;
+        bool have_complete_line( void );
 
         std::string get_and_pop_line( void );
 
         void pop_bytes( const size_t n );
 
-        bool empty( void ) const { return buffer_.empty(); }
+        bool empty( void ) const { return offset_ == buffer_.size(); }
+
+        void append( const std::string & str );
 
-        void append( const std::string & str ) { buffer_.append( str ); }
+        /* up to limit of the bytes not yet consumed */
+        std::string front( const size_t limit ) const { return buffer_.substr( offset_, limit ); }
 
-        const std::string & str( void ) const { return buffer_; }
+        size_t size( void ) const { return buffer_.size() - offset_; }
     };
 
     /* bytes that haven't been parsed yet */
@@ -65,20 +85,52 @@ public:
 };
 
 template <class MessageType>
-bool HTTPMessageSequence<MessageType>::InternalBuffer::have_complete_line( void ) const
+void HTTPMessageSequence<MessageType>::InternalBuffer::compact( void )
 {
-    size_t first_line_ending = buffer_.find( CRLF );
-    return first_line_ending != std::string::npos;
+    buffer_.erase( 0, offset_ );
+    scanned_ -= offset_;
+    if ( line_end_ != std::string::npos ) {
+        line_end_ -= offset_;
+    }
+    offset_ = 0;
+}
+
+template <class MessageType>
+void HTTPMessageSequence<MessageType>::InternalBuffer::append( const std::string & str )
+{
+    if ( offset_ > buffer_.size() / 2 ) {
+        compact();
+    }
+
+    buffer_.append( str );
+}
+
+template <class MessageType>
+bool HTTPMessageSequence<MessageType>::InternalBuffer::have_complete_line( void )
+{
+    if ( line_end_ != std::string::npos ) {
+        return true;
+    }
+
+    line_end_ = buffer_.find( CRLF, scanned_ );
+    if ( line_end_ == std::string::npos ) {
+        /* a CR at the very end may still be followed by LF */
+        scanned_ = std::max( scanned_, buffer_.size() - std::min( buffer_.size(), CRLF.size() - 1 ) );
+        return false;
+    }
+
+    return true;
 }
 
 template <class MessageType>
 std::string HTTPMessageSequence<MessageType>::InternalBuffer::get_and_pop_line( void )
 {
-    size_t first_line_ending = buffer_.find( CRLF );
-    assert( first_line_ending != std::string::npos );
+    const bool found = have_complete_line();
+    assert( found );
+    (void) found;
 
-    std::string first_line( buffer_.substr( 0, first_line_ending ) );
-    pop_bytes( first_line_ending + CRLF.size() );
+    std::string first_line( buffer_, offset_, line_end_ - offset_ );
+    pop_bytes( line_end_ + CRLF.size() - offset_ );
 
     return first_line;
 }
@@ -86,8 +138,15 @@ std::string HTTPMessageSequence<MessageType>::InternalBuffer::get_and_pop_line(
 template <class MessageType>
 void HTTPMessageSequence<MessageType>::InternalBuffer::pop_bytes( const size_t num )
 {
-    assert( buffer_.size() >= num );
-    buffer_.replace( 0, num, std::string() );
+    assert( size() >= num );
+    offset_ += num;
+    scanned_ = std::max( scanned_, offset_ );
+    line_end_ = std::string::npos;
+
+    if ( empty() ) {
+        buffer_.clear();
+        offset_ = scanned_ = 0;
+    }
 }
 
 template <class MessageType>
@@ -121,8 +180,10 @@ bool HTTPMessageSequence<MessageType>::parsing_step( void )
 
     case BODY_PENDING:
         {
-            size_t bytes_read = message_in_progress_.read_in_body( buffer_.str() );
-            assert( bytes_read == buffer_.str().size() or message_in_progress_.state() == COMPLETE );
+            /* only copy out what the body can take */
+            const std::string body_bytes = buffer_.front( message_in_progress_.body_bytes_wanted() );
+            size_t bytes_read = message_in_progress_.read_in_body( body_bytes );
+            assert( bytes_read == buffer_.size() or message_in_progress_.state() == COMPLETE );
             buffer_.pop_bytes( bytes_read );
         }
         return message_in_progress_.state() == COMPLETE;
@@ -0,0 +1,256 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <cstring>
+#include <limits>
+
+#include "recording_archive.hh"
+#include "recording_index.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const string archive_magic = "MMARCHV1";
+
+/* magic followed by four uint64s: record count, table offset, index offset, index length */
+static const size_t header_size = 8 + 4 * sizeof( uint64_t );
+
+/* a record length no record has, written between the records and the
+   table so that scanning an unfinished archive stops there */
+static const uint32_t end_of_records = numeric_limits<uint32_t>::max();
+
+static string encode_u32( const uint32_t value )
+{
+    const uint32_t le = htole32( value );
+    return string( reinterpret_cast<const char *>( &le ), sizeof( le ) );
+}
+
+static string encode_u64( const uint64_t value )
+{
+    const uint64_t le = htole64( value );
+    return string( reinterpret_cast<const char *>( &le ), sizeof( le ) );
+}
+
+/* the mapping carries no alignment guarantee, so copy out */
+static uint32_t decode_u32( const char * data )
+{
+    uint32_t le;
+    memcpy( &le, data, sizeof( le ) );
+    return le32toh( le );
+}
+
+static uint64_t decode_u64( const char * data )
+{
+    uint64_t le;
+    memcpy( &le, data, sizeof( le ) );
+    return le64toh( le );
+}
+
+static string make_header( const uint64_t record_count, const uint64_t table_offset,
+                           const uint64_t index_offset, const uint64_t index_length )
+{
+    return archive_magic + encode_u64( record_count ) + encode_u64( table_offset )
+        + encode_u64( index_offset ) + encode_u64( index_length );
+}
+
+RecordingArchiveWriter::RecordingArchiveWriter( const string & filename )
+    : filename_( filename ),
+      fd_( SystemCall( "open " + filename,
+                       open( filename.c_str(), O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR ) ) ),
+      end_offset_( header_size ),
+      finished_( false )
+{
+    /* placeholder header until finish() (a zero table offset marks an unfinished archive) */
+    fd_.write( make_header( 0, 0, 0, 0 ) );
+}
+
+RecordingArchiveWriter::~RecordingArchiveWriter()
+{
+    try {
+        finish();
+    } catch ( const exception & e ) {
+        print_exception( e );
+    }
+}
+
+void RecordingArchiveWriter::append( const MahimahiProtobufs::RequestResponse & record )
+{
+    if ( finished_ ) {
+        throw runtime_error( filename_ + ": append to finished archive" );
+    }
+
+    string serialized;
+    if ( not record.SerializeToString( &serialized ) ) {
+        throw runtime_error( filename_ + ": failure to serialize HTTP request/response pair" );
+    }
+
+    if ( serialized.size() >= end_of_records ) {
+        throw runtime_error( filename_ + ": HTTP request/response pair too large for archive" );
+    }
+
+    /* one write per record so a crash leaves at most one partial record at the end */
+    fd_.write( encode_u32( serialized.size() ) + serialized );
+
+    index_[ recording_key( record ) ].push_back( offsets_.size() );
+    offsets_.push_back( end_offset_ );
+    end_offset_ += sizeof( uint32_t ) + serialized.size();
+}
+
+void RecordingArchiveWriter::finish( void )
+{
+    if ( finished_ ) {
+        return;
+    }
+
+    finished_ = true;
+
+    const uint64_t table_offset = end_offset_ + sizeof( uint32_t );
+
+    string table;
+    for ( const auto & offset : offsets_ ) {
+        table += encode_u64( offset );
+    }
+
+    MahimahiProtobufs::RecordingArchiveIndex index;
+    for ( const auto & entry : index_ ) {
+        auto new_entry = index.add_entry();
+        new_entry->set_key( entry.first );
+        for ( const auto & record : entry.second ) {
+            new_entry->add_record( record );
+        }
+    }
+
+    string serialized_index;
+    if ( not index.SerializeToString( &serialized_index ) ) {
+        throw runtime_error( filename_ + ": failure to serialize archive index" );
+    }
+
+    /* a crash before the header is rewritten leaves the marker after the last record */
+    fd_.write( encode_u32( end_of_records ) + table + serialized_index );
+
+    const string header = make_header( offsets_.size(), table_offset,
+                                       table_offset + table.size(), serialized_index.size() );
+    const ssize_t bytes_written = SystemCall( "pwrite", pwrite( fd_.fd_num(), header.data(), header.size(), 0 ) );
+    if ( size_t( bytes_written ) != header.size() ) {
+        throw runtime_error( filename_ + ": short write of archive header" );
+    }
+}
+
+bool RecordingArchive::is_archive( const string & filename )
+{
+    struct stat file_info;
+    if ( stat( filename.c_str(), &file_info ) < 0 or not S_ISREG( file_info.st_mode ) ) {
+        return false;
+    }
+
+    FileDescriptor fd( SystemCall( "open " + filename, open( filename.c_str(), O_RDONLY ) ) );
+    return fd.read( archive_magic.size() ) == archive_magic;
+}
+
+RecordingArchive::RecordingArchive( const string & filename )
+    : filename_( filename ),
+      file_( filename ),
+      indexed_( false )
+{
+    const char * const data = file_.data();
+
+    if ( file_.size() < header_size or string( data, archive_magic.size() ) != archive_magic ) {
+        throw runtime_error( filename_ + ": not a recording archive" );
+    }
+
+    const uint64_t record_count = decode_u64( data + 8 );
+    const uint64_t table_offset = decode_u64( data + 16 );
+    const uint64_t index_offset = decode_u64( data + 24 );
+    const uint64_t index_length = decode_u64( data + 32 );
+
+    if ( table_offset == 0 ) {
+        /* never finished (e.g., recorder was killed) */
+        scan_records();
+        return;
+    }
+
+    if ( table_offset < header_size or table_offset > file_.size()
+         or record_count > ( file_.size() - table_offset ) / sizeof( uint64_t )
+         or index_offset != table_offset + record_count * sizeof( uint64_t )
+         or index_length > file_.size() - index_offset ) {
+        throw runtime_error( filename_ + ": corrupt archive header" );
+    }
+
+    offsets_.reserve( record_count );
+    for ( uint64_t i = 0; i < record_count; i++ ) {
+        const uint64_t offset = decode_u64( data + table_offset + i * sizeof( uint64_t ) );
+        if ( offset < header_size or offset > table_offset - sizeof( uint32_t )
+             or decode_u32( data + offset ) > table_offset - offset - sizeof( uint32_t ) ) {
+            throw runtime_error( filename_ + ": corrupt archive offset table" );
+        }
+        offsets_.push_back( offset );
+    }
+
+    MahimahiProtobufs::RecordingArchiveIndex index;
+    if ( not index.ParseFromArray( data + index_offset, index_length ) ) {
+        throw runtime_error( filename_ + ": corrupt archive index" );
+    }
+
+    for ( const auto & entry : index.entry() ) {
+        for ( const auto & record : entry.record() ) {
+            if ( record >= offsets_.size() ) {
+                throw runtime_error( filename_ + ": corrupt archive index" );
+            }
+        }
+        index_[ entry.key() ].assign( entry.record().begin(), entry.record().end() );
+    }
+
+    indexed_ = true;
+}
+
+void RecordingArchive::scan_records( void )
+{
+    uint64_t offset = header_size;
+
+    /* a trailing partial record is the one being written when the writer died,
+       and the marker starts a table written before the header was */
+    while ( file_.size() - offset >= sizeof( uint32_t ) ) {
+        const uint32_t length = decode_u32( file_.data() + offset );
+        if ( length == end_of_records or length > file_.size() - offset - sizeof( uint32_t ) ) {
+            break;
+        }
+
+        offsets_.push_back( offset );
+        offset += sizeof( uint32_t ) + length;
+    }
+}
+
+MahimahiProtobufs::RequestResponse RecordingArchive::record( const size_t i ) const
+{
+    const uint64_t offset = offsets_.at( i );
+    const uint32_t length = decode_u32( file_.data() + offset );
+
+    MahimahiProtobufs::RequestResponse ret;
+    if ( not ret.ParseFromArray( file_.data() + offset + sizeof( uint32_t ), length ) ) {
+        throw runtime_error( filename_ + ": invalid HTTP request/response at offset " + to_string( offset ) );
+    }
+
+    return ret;
+}
+
+vector< size_t > RecordingArchive::lookup( const string & key ) const
+{
+    if ( not indexed_ ) {
+        vector< size_t > all_records( offsets_.size() );
+        for ( size_t i = 0; i < all_records.size(); i++ ) {
+            all_records[ i ] = i;
+        }
+        return all_records;
+    }
+
+    const auto entry = index_.find( key );
+    if ( entry == index_.end() ) {
+        return {};
+    }
+
+    return vector< size_t >( entry->second.begin(), entry->second.end() );
+}
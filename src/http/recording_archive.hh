@@ -0,0 +1,79 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef RECORDING_ARCHIVE_HH
+#define RECORDING_ARCHIVE_HH
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "file_descriptor.hh"
+#include "mapped_file.hh"
+#include "http_record.pb.h"
+
+/* A recording archive holds a whole recording in one file:
+
+     header:  magic, record count, offset of table, offset and length of index
+     records: each a little-endian uint32 length followed by a RequestResponse
+     marker:  a uint32 length of 0xffffffff, ending the records
+     table:   little-endian uint64 offset of each record
+     index:   RecordingArchiveIndex mapping each recording_key() to record numbers
+
+   Records are only ever appended. The marker, table, index and final
+   header are written when the archive is finished; an archive whose
+   writer died before the header was is still readable by scanning the
+   records in order up to the marker. */
+
+class RecordingArchiveWriter
+{
+private:
+    std::string filename_;
+    FileDescriptor fd_;
+    uint64_t end_offset_;
+    std::vector< uint64_t > offsets_ {};
+    std::map< std::string, std::vector< uint32_t > > index_ {};
+    bool finished_;
+
+public:
+    /* creates the file; fails if it already exists */
+    RecordingArchiveWriter( const std::string & filename );
+    ~RecordingArchiveWriter();
+
+    void append( const MahimahiProtobufs::RequestResponse & record );
+
+    /* write the offset table, index, and header */
+    void finish( void );
+
+    /* forbid copying or assigning */
+    RecordingArchiveWriter( const RecordingArchiveWriter & other ) = delete;
+    RecordingArchiveWriter & operator=( const RecordingArchiveWriter & other ) = delete;
+};
+
+class RecordingArchive
+{
+private:
+    std::string filename_;
+    MappedFile file_;
+    std::vector< uint64_t > offsets_ {};
+    bool indexed_;
+    std::map< std::string, std::vector< uint32_t > > index_ {};
+
+    void scan_records( void );
+
+public:
+    /* is this a regular file that starts with the archive magic? */
+    static bool is_archive( const std::string & filename );
+
+    RecordingArchive( const std::string & filename );
+
+    size_t size( void ) const { return offsets_.size(); }
+
+    /* parse record i directly out of the mapping */
+    MahimahiProtobufs::RequestResponse record( const size_t i ) const;
+
+    /* numbers of the records that may match the key (every record if the archive was never finished) */
+    std::vector< size_t > lookup( const std::string & key ) const;
+};
+
+#endif /* RECORDING_ARCHIVE_HH */
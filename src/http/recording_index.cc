@@ -0,0 +1,132 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <algorithm>
+
+#include "recording_index.hh"
+#include "exception.hh"
+
+using namespace std;
+
+string strip_query( const string & request_line )
+{
+    const auto index = request_line.find( "?" );
+    if ( index == string::npos ) {
+        return request_line;
+    } else {
+        return request_line.substr( 0, index );
+    }
+}
+
+string recording_key( const bool is_https,
+                      const string & host,
+                      const string & request_line )
+{
+    return string( is_https ? "https://" : "http://" ) + host + " " + strip_query( request_line );
+}
+
+string recording_key( const MahimahiProtobufs::RequestResponse & record )
+{
+    const HTTPRequest saved_request( record.request() );
+
+    return recording_key( record.scheme() == MahimahiProtobufs::RequestResponse_Scheme_HTTPS,
+                          saved_request.has_header( "Host" ) ? saved_request.get_header_value( "Host" ) : "",
+                          saved_request.first_line() );
+}
+
+/* does the actual HTTP header match this stored request? */
+static bool header_match( const string & header_name,
+                          const HTTPRequest & saved_request,
+                          const HTTPRequest & request )
+{
+    /* case 1: neither header exists (OK) */
+    if ( (not request.has_header( header_name )) and (not saved_request.has_header( header_name )) ) {
+        return true;
+    }
+
+    /* case 2: headers both exist (OK if values match) */
+    if ( request.has_header( header_name ) and saved_request.has_header( header_name ) ) {
+        return saved_request.get_header_value( header_name ) == request.get_header_value( header_name );
+    }
+
+    /* case 3: one exists but the other doesn't (failure) */
+    return false;
+}
+
+/* compare request_line and certain headers of incoming request and stored request */
+unsigned int match_score( const HTTPRequest & saved_request, const bool saved_is_https,
+                          const HTTPRequest & request, const bool is_https )
+{
+    /* match HTTP/HTTPS */
+    if ( is_https != saved_is_https ) {
+        return 0;
+    }
+
+    /* match host header */
+    if ( not header_match( "Host", saved_request, request ) ) {
+        return 0;
+    }
+
+    /* match user agent */
+    if ( not header_match( "User-Agent", saved_request, request ) ) {
+        return 0;
+    }
+
+    /* must match first line up to "?" at least */
+    const string & request_line = request.first_line();
+    const string & saved_request_line = saved_request.first_line();
+    if ( strip_query( request_line ) != strip_query( saved_request_line ) ) {
+        return 0;
+    }
+
+    /* success! return size of common prefix */
+    const auto max_match = min( request_line.size(), saved_request_line.size() );
+    for ( unsigned int i = 0; i < max_match; i++ ) {
+        if ( request_line.at( i ) != saved_request_line.at( i ) ) {
+            return i;
+        }
+    }
+
+    return max_match;
+}
+
+RecordingIndex::RecordingIndex( FileDescriptor & fd )
+{
+    MahimahiProtobufs::RecordingIndex index;
+    if ( not index.ParseFromFileDescriptor( fd.fd_num() ) ) {
+        throw runtime_error( "RecordingIndex: invalid index" );
+    }
+
+    for ( const auto & entry : index.entry() ) {
+        entries_[ entry.key() ].assign( entry.filename().begin(), entry.filename().end() );
+    }
+}
+
+void RecordingIndex::add( const MahimahiProtobufs::RequestResponse & record, const string & filename )
+{
+    entries_[ recording_key( record ) ].push_back( filename );
+}
+
+void RecordingIndex::save( FileDescriptor & fd ) const
+{
+    MahimahiProtobufs::RecordingIndex index;
+
+    for ( const auto & entry : entries_ ) {
+        auto new_entry = index.add_entry();
+        new_entry->set_key( entry.first );
+        for ( const auto & filename : entry.second ) {
+            new_entry->add_filename( filename );
+        }
+    }
+
+    if ( not index.SerializeToFileDescriptor( fd.fd_num() ) ) {
+        throw runtime_error( "RecordingIndex: failure to serialize index" );
+    }
+}
+
+const vector< string > & RecordingIndex::lookup( const string & key ) const
+{
+    static const vector< string > no_candidates;
+
+    const auto entry = entries_.find( key );
+    return entry == entries_.end() ? no_candidates : entry->second;
+}
@@ -0,0 +1,51 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef RECORDING_INDEX_HH
+#define RECORDING_INDEX_HH
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "file_descriptor.hh"
+#include "http_request.hh"
+#include "http_record.pb.h"
+
+/* request line up to (but not including) the query string */
+std::string strip_query( const std::string & request_line );
+
+/* a saved request can only match an incoming request with the same key:
+   the same scheme, Host header, and request line up to the "?" */
+std::string recording_key( const bool is_https,
+                           const std::string & host,
+                           const std::string & request_line );
+
+std::string recording_key( const MahimahiProtobufs::RequestResponse & record );
+
+/* how well a saved request matches an incoming one: zero if it can't be
+   used to answer it, otherwise the length of the common prefix of the request lines */
+unsigned int match_score( const HTTPRequest & saved_request, const bool saved_is_https,
+                          const HTTPRequest & request, const bool is_https );
+
+/* maps the key of each saved request to the file(s) holding it, so
+   mm-replayserver only has to parse the candidates for a request */
+class RecordingIndex
+{
+private:
+    std::map< std::string, std::vector< std::string > > entries_ {};
+
+public:
+    RecordingIndex() {}
+
+    /* read an index previously written with save() */
+    RecordingIndex( FileDescriptor & fd );
+
+    void add( const MahimahiProtobufs::RequestResponse & record, const std::string & filename );
+
+    void save( FileDescriptor & fd ) const;
+
+    /* names of the files that may hold a match for the key */
+    const std::vector< std::string > & lookup( const std::string & key ) const;
+};
+
+#endif /* RECORDING_INDEX_HH */
@@ -0,0 +1,110 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fcntl.h>
+
+#include <iostream>
+
+#include "replay_store.hh"
+#include "recording_index.hh"
+#include "recording_archive.hh"
+#include "http_response.hh"
+#include "tokenize.hh"
+#include "file_descriptor.hh"
+#include "util.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* does the saved response rely on the connection closing to end its body? */
+static bool body_ends_at_eof( const HTTPResponse & response, const HTTPRequest & request )
+{
+    const auto tokens = split( response.first_line(), " " );
+    if ( tokens.size() < 2 or tokens.at( 1 ).empty() ) {
+        throw runtime_error( "ReplayStore: invalid status line: " + response.first_line() );
+    }
+    const string & status_code = tokens.at( 1 );
+
+    /* same rules as HTTPResponse::calculate_expected_body_size() */
+    if ( status_code.at( 0 ) == '1' or status_code == "204" or status_code == "304" or request.is_head() ) {
+        return false;
+    }
+
+    if ( response.has_header( "Transfer-Encoding" ) ) {
+        return not HTTPMessage::equivalent_strings( split( response.get_header_value( "Transfer-Encoding" ), "," ).back(),
+                                                    "chunked" );
+    }
+
+    return not response.has_header( "Content-Length" );
+}
+
+ReplayStore::Entry::Entry( const MahimahiProtobufs::RequestResponse & record )
+    : server_address( record.ip(), record.port() ),
+      request( record.request() ),
+      is_https( record.scheme() == MahimahiProtobufs::RequestResponse_Scheme_HTTPS ),
+      response(),
+      close_after_response()
+{
+    const HTTPResponse saved_response( record.response() );
+
+    response = saved_response.str();
+    close_after_response = body_ends_at_eof( saved_response, request );
+}
+
+void ReplayStore::add( const MahimahiProtobufs::RequestResponse & record )
+{
+    /* one bad record shouldn't keep the rest of the recording from replaying */
+    try {
+        entries_.emplace_back( record );
+    } catch ( const exception & e ) {
+        cerr << "ReplayStore: skipping record for " << record.request().first_line() << ": " << e.what() << endl;
+        return;
+    }
+
+    by_key_[ recording_key( record ) ].push_back( entries_.size() - 1 );
+}
+
+ReplayStore::ReplayStore( const string & recording )
+{
+    if ( RecordingArchive::is_archive( recording ) ) {
+        const RecordingArchive archive( recording );
+        for ( size_t i = 0; i < archive.size(); i++ ) {
+            add( archive.record( i ) );
+        }
+        return;
+    }
+
+    for ( const auto & filename : list_directory_contents( recording ) ) {
+        FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
+
+        MahimahiProtobufs::RequestResponse record;
+        if ( not record.ParseFromFileDescriptor( fd.fd_num() ) ) {
+            throw runtime_error( filename + ": invalid HTTP request/response" );
+        }
+
+        add( record );
+    }
+}
+
+const ReplayStore::Entry * ReplayStore::find( const HTTPRequest & request, const bool is_https ) const
+{
+    const auto candidates = by_key_.find( recording_key( is_https,
+                                                         request.has_header( "Host" ) ? request.get_header_value( "Host" ) : "",
+                                                         request.first_line() ) );
+    if ( candidates == by_key_.end() ) {
+        return nullptr;
+    }
+
+    unsigned int best_score = 0;
+    const Entry * best_match = nullptr;
+
+    for ( const auto & i : candidates->second ) {
+        const Entry & entry = entries_.at( i );
+        const unsigned int score = match_score( entry.request, entry.is_https, request, is_https );
+        if ( score > best_score ) {
+            best_match = &entry;
+            best_score = score;
+        }
+    }
+
+    return best_match;
+}
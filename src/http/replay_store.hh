@@ -0,0 +1,49 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef REPLAY_STORE_HH
+#define REPLAY_STORE_HH
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "http_request.hh"
+#include "address.hh"
+#include "http_record.pb.h"
+
+/* a whole recording (directory or archive) held in memory for serving */
+class ReplayStore
+{
+public:
+    struct Entry
+    {
+        Address server_address;
+        HTTPRequest request;
+        bool is_https;
+
+        /* saved response, serialized once */
+        std::string response;
+
+        /* the body is delimited by closing the connection (RFC 2616 section 4.4, rule 5) */
+        bool close_after_response;
+
+        Entry( const MahimahiProtobufs::RequestResponse & record );
+    };
+
+private:
+    std::vector< Entry > entries_ {};
+    std::map< std::string, std::vector< size_t > > by_key_ {};
+
+    void add( const MahimahiProtobufs::RequestResponse & record );
+
+public:
+    /* load every record in the directory (which must end in '/') or archive */
+    ReplayStore( const std::string & recording );
+
+    const std::vector< Entry > & entries( void ) const { return entries_; }
+
+    /* best saved answer for the request, or nullptr if nothing matches */
+    const Entry * find( const HTTPRequest & request, const bool is_https ) const;
+};
+
+#endif /* REPLAY_STORE_HH */
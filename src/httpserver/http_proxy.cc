@@ -1,22 +1,22 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
+#include <sys/eventfd.h>
+
 #include <thread>
+#include <mutex>
+#include <atomic>
 #include <string>
 #include <iostream>
-#include <arpa/inet.h>
-#include <linux/netfilter_ipv4.h>
+#include <algorithm>
 
 #include "address.hh"
 #include "socket.hh"
-#include "system_runner.hh"
 #include "http_proxy.hh"
 #include "poller.hh"
-#include "bytestream_queue.hh"
 #include "http_request_parser.hh"
 #include "http_response_parser.hh"
 #include "file_descriptor.hh"
 #include "event_loop.hh"
-#include "temp_file.hh"
 #include "secure_socket.hh"
 #include "backing_store.hh"
 #include "exception.hh"
@@ -24,101 +24,427 @@
 using namespace std;
 using namespace PollerShortNames;
 
+/* plain connections have no handshakes */
+static bool continue_connect( TCPSocket & ) { return true; }
+static bool continue_accept( TCPSocket & ) { return true; }
+static bool handshake_wants_read( const TCPSocket & ) { return false; }
+static bool handshake_wants_write( const TCPSocket & ) { return false; }
+
+static bool continue_connect( SecureSocket & socket ) { return socket.continue_connect(); }
+static bool continue_accept( SecureSocket & socket ) { return socket.continue_accept(); }
+static bool handshake_wants_read( const SecureSocket & socket ) { return socket.wants_read(); }
+static bool handshake_wants_write( const SecureSocket & socket ) { return socket.wants_write(); }
+
+/* bytes waiting for a non-blocking socket to become writable */
+class OutboundBuffer
+{
+private:
+    string buffer_ {};
+    size_t written_ { 0 };
+
+public:
+    /* stop reading from the other side while this many bytes wait, so a
+       slow reader holds back its peer instead of filling the buffer */
+    static const size_t HIGH_WATER_MARK = 1024 * 1024;
+
+    void append( const string & data ) { buffer_.append( data ); }
+
+    bool empty( void ) const { return written_ == buffer_.size(); }
+
+    bool full( void ) const { return buffer_.size() - written_ >= HIGH_WATER_MARK; }
+
+    template <class SocketType>
+    void write_to( SocketType & socket )
+    {
+        const auto begin = buffer_.cbegin() + written_;
+        written_ += socket.write( begin, buffer_.cend() ) - begin;
+
+        /* drop what has been written once it is most of the buffer */
+        if ( written_ > buffer_.size() / 2 ) {
+            buffer_.erase( 0, written_ );
+            written_ = 0;
+        }
+    }
+};
+
+/* one proxied connection: a handshake with the server, then one with the client
+   (for TLS), then requests and responses ferried between the two */
+template <class SocketType>
+class ProxyConnection
+{
+private:
+    SocketType server_, client_;
+    const Address server_addr_;
+    HTTPBackingStore & backing_store_;
+
+    bool server_handshake_complete_, client_handshake_complete_;
+
+    /* false once the server's bytes stop making sense as HTTP responses */
+    bool recording_;
+
+    HTTPRequestParser request_parser_ {};
+    HTTPResponseParser response_parser_ {};
+
+    OutboundBuffer to_server_ {}, to_client_ {};
+
+    bool proxying( void ) const { return server_handshake_complete_ and client_handshake_complete_; }
+
+    void continue_handshakes( void )
+    {
+        if ( not server_handshake_complete_ ) {
+            server_handshake_complete_ = continue_connect( server_ );
+        }
+
+        if ( server_handshake_complete_ and not client_handshake_complete_ ) {
+            client_handshake_complete_ = continue_accept( client_ );
+        }
+    }
+
+public:
+    ProxyConnection( SocketType && server, SocketType && client,
+                     const Address & server_addr, HTTPBackingStore & backing_store )
+        : server_( move( server ) ), client_( move( client ) ),
+          server_addr_( server_addr ), backing_store_( backing_store ),
+          server_handshake_complete_( false ), client_handshake_complete_( false ),
+          recording_( true )
+    {
+        continue_handshakes();
+    }
+
+    SocketType & server( void ) { return server_; }
+    SocketType & client( void ) { return client_; }
+
+    /* what each socket is waiting for */
+    bool server_wants_read( void ) const
+    {
+        if ( not server_handshake_complete_ ) {
+            return handshake_wants_read( server_ );
+        }
+
+        return proxying() and not client_.eof() and not server_.eof() and not to_client_.full();
+    }
+
+    bool server_wants_write( void ) const
+    {
+        if ( not server_handshake_complete_ ) {
+            return handshake_wants_write( server_ );
+        }
+
+        return proxying() and not to_server_.empty();
+    }
+
+    bool client_wants_read( void ) const
+    {
+        if ( server_handshake_complete_ and not client_handshake_complete_ ) {
+            return handshake_wants_read( client_ );
+        }
+
+        return proxying() and not server_.eof() and not client_.eof() and not to_server_.full();
+    }
+
+    bool client_wants_write( void ) const
+    {
+        if ( server_handshake_complete_ and not client_handshake_complete_ ) {
+            return handshake_wants_write( client_ );
+        }
+
+        return proxying() and not to_client_.empty();
+    }
+
+    /* neither side has anything more to say to the other */
+    bool finished( void ) const
+    {
+        return not ( server_wants_read() or server_wants_write()
+                     or client_wants_read() or client_wants_write() );
+    }
+
+    /* bytes from server are passed through to the client as they arrive,
+       and also go to the response parser so that completed responses
+       can be saved */
+    void read_server( void )
+    {
+        if ( not proxying() ) {
+            return continue_handshakes();
+        }
+
+        const string buffer = server_.read();
+        if ( buffer.empty() and not server_.eof() ) {
+            return; /* only part of a TLS record */
+        }
+
+        to_client_.append( buffer );
+
+        if ( not recording_ ) {
+            return;
+        }
+
+        try {
+            response_parser_.parse( buffer );
+        } catch ( const exception & e ) {
+            /* keep proxying, but nothing more on this connection can be recorded */
+            print_exception( e );
+            recording_ = false;
+            return;
+        }
+
+        while ( not response_parser_.empty() ) {
+            backing_store_.save( response_parser_.front(), server_addr_ );
+            response_parser_.pop();
+        }
+    }
+
+    /* requests from client go to request parser, and completed
+       requests are queued for the server */
+    void read_client( void )
+    {
+        if ( not proxying() ) {
+            return continue_handshakes();
+        }
+
+        const string buffer = client_.read();
+        if ( buffer.empty() and not client_.eof() ) {
+            return;
+        }
+
+        request_parser_.parse( buffer );
+
+        while ( not request_parser_.empty() ) {
+            to_server_.append( request_parser_.front().str() );
+            response_parser_.new_request_arrived( request_parser_.front() );
+            request_parser_.pop();
+        }
+    }
+
+    void write_server( void )
+    {
+        if ( not proxying() ) {
+            return continue_handshakes();
+        }
+
+        to_server_.write_to( server_ );
+    }
+
+    void write_client( void )
+    {
+        if ( not proxying() ) {
+            return continue_handshakes();
+        }
+
+        to_client_.write_to( client_ );
+    }
+};
+
+/* the proxy's connection to the original destination, until it is established */
+struct PendingConnection
+{
+    TCPSocket server, client;
+    const Address server_addr;
+
+    PendingConnection( TCPSocket && s_client )
+        : server(), client( move( s_client ) ), server_addr( client.original_dest() )
+    {
+        server.set_blocking( false );
+        server.start_connect( server_addr );
+    }
+};
+
+class HTTPProxy::Worker
+{
+private:
+    SSLContext & server_context_, & client_context_;
+    HTTPBackingStore & backing_store_;
+
+    Poller poller_ {};
+
+    /* accepted connections handed over by the listener's thread */
+    mutex mutex_ {};
+    vector< TCPSocket > incoming_ {};
+    FileDescriptor wakeup_ { SystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK ) ) };
+    atomic<bool> halt_ { false };
+
+    thread thread_;
+
+    template <class ProxySocketType>
+    void proxy( ProxySocketType && server, ProxySocketType && client, const Address & server_addr );
+
+    void add_connection( TCPSocket && client );
+    void loop( void );
+    void wake( void );
+
+public:
+    Worker( SSLContext & server_context, SSLContext & client_context,
+            HTTPBackingStore & backing_store );
+    ~Worker();
+
+    void hand_off( TCPSocket && client );
+};
+
 HTTPProxy::HTTPProxy( const Address & listener_addr )
     : listener_socket_(),
       server_context_( SERVER ),
-      client_context_( CLIENT )
+      client_context_( CLIENT ),
+      workers_(),
+      next_worker_( 0 )
 {
     listener_socket_.bind( listener_addr );
-    listener_socket_.listen();
+
+    /* browsers open many connections at once */
+    listener_socket_.listen( 1024 );
 }
 
-template <class SocketType>
-void HTTPProxy::loop( SocketType & server, SocketType & client, HTTPBackingStore & backing_store )
+HTTPProxy::~HTTPProxy()
 {
-    Poller poller;
-
-    HTTPRequestParser request_parser;
-    HTTPResponseParser response_parser;
-
-    const Address server_addr = client.original_dest();
-
-    /* poll on original connect socket and new connection socket to ferry packets */
-    /* responses from server go to response parser */
-    poller.add_action( Poller::Action( server, Direction::In,
-                                       [&] () {
-                                           string buffer = server.read();
-                                           response_parser.parse( buffer );
-                                           return ResultType::Continue;
-                                       },
-                                       [&] () { return not client.eof(); } ) );
-
-    /* requests from client go to request parser */
-    poller.add_action( Poller::Action( client, Direction::In,
-                                       [&] () {
-                                           string buffer = client.read();
-                                           request_parser.parse( buffer );
-                                           return ResultType::Continue;
-                                       },
-                                       [&] () { return not server.eof(); } ) );
-
-    /* completed requests from client are serialized and sent to server */
-    poller.add_action( Poller::Action( server, Direction::Out,
-                                       [&] () {
-                                           server.write( request_parser.front().str() );
-                                           response_parser.new_request_arrived( request_parser.front() );
-                                           request_parser.pop();
-                                           return ResultType::Continue;
-                                       },
-                                       [&] () { return not request_parser.empty(); } ) );
-
-    /* completed responses from server are serialized and sent to client */
-    poller.add_action( Poller::Action( client, Direction::Out,
-                                       [&] () {
-                                           client.write( response_parser.front().str() );
-                                           backing_store.save( response_parser.front(), server_addr );
-                                           response_parser.pop();
-                                           return ResultType::Continue;
-                                       },
-                                       [&] () { return not response_parser.empty(); } ) );
-
-    while ( true ) {
-        if ( poller.poll( -1 ).result == Poller::Result::Type::Exit ) {
-            return;
+    stop();
+}
+
+/* a connection that is finished (or broken) takes both of its sockets out of the poller */
+template <class SocketType, class Callable>
+static Poller::Action::CallbackType proxy_step( Poller & poller,
+                                                const shared_ptr< ProxyConnection< SocketType > > & connection,
+                                                const Callable & step )
+{
+    return [&poller, connection, step] () -> Result {
+        try {
+            step();
+
+            if ( not connection->finished() ) {
+                return ResultType::Continue;
+            }
+        } catch ( const exception & e ) {
+            print_exception( e );
         }
-    }
+
+        poller.cancel_all( connection->server().fd_num() );
+        poller.cancel_all( connection->client().fd_num() );
+        return ResultType::CancelAll;
+    };
 }
 
-void HTTPProxy::handle_tcp( HTTPBackingStore & backing_store )
+template <class ProxySocketType>
+void HTTPProxy::Worker::proxy( ProxySocketType && server, ProxySocketType && client, const Address & server_addr )
 {
-    thread newthread( [&] ( TCPSocket client ) {
-            try {
-                /* get original destination for connection request */
-                Address server_addr = client.original_dest();
+    /* the connection lives as long as its actions stay in the poller */
+    auto connection = make_shared< ProxyConnection< ProxySocketType > >( move( server ), move( client ),
+                                                                        server_addr, backing_store_ );
 
-                /* create socket and connect to original destination and send original request */
-                TCPSocket server;
-                server.connect( server_addr );
+    Poller & poller = poller_;
+    const auto drop = [&poller, connection] () -> Result {
+        poller.cancel_all( connection->server().fd_num() );
+        poller.cancel_all( connection->client().fd_num() );
+        return ResultType::CancelAll;
+    };
 
-                if ( server_addr.port() != 443 ) { /* normal HTTP */
-                    return loop( server, client, backing_store );
-                }
+    poller_.add_action( Poller::Action( connection->server(), Direction::In,
+                                        proxy_step( poller_, connection, [connection] () { connection->read_server(); } ),
+                                        [connection] () { return connection->server_wants_read(); },
+                                        drop ) );
 
-                /* handle TLS */
-                SecureSocket tls_server( client_context_.new_secure_socket( move( server ) ) );
-                tls_server.connect();
+    poller_.add_action( Poller::Action( connection->client(), Direction::In,
+                                        proxy_step( poller_, connection, [connection] () { connection->read_client(); } ),
+                                        [connection] () { return connection->client_wants_read(); },
+                                        drop ) );
 
-                SecureSocket tls_client( server_context_.new_secure_socket( move( client ) ) );
-                tls_client.accept();
+    poller_.add_action( Poller::Action( connection->server(), Direction::Out,
+                                        proxy_step( poller_, connection, [connection] () { connection->write_server(); } ),
+                                        [connection] () { return connection->server_wants_write(); },
+                                        drop ) );
 
-                loop( tls_server, tls_client, backing_store );
-            } catch ( const exception & e ) {
-                print_exception( e );
+    poller_.add_action( Poller::Action( connection->client(), Direction::Out,
+                                        proxy_step( poller_, connection, [connection] () { connection->write_client(); } ),
+                                        [connection] () { return connection->client_wants_write(); },
+                                        drop ) );
+}
+
+void HTTPProxy::Worker::add_connection( TCPSocket && client )
+{
+    client.set_blocking( false );
+
+    /* connect to original destination without waiting for it */
+    auto pending = make_shared< PendingConnection >( move( client ) );
+
+    const auto connected = [this, pending] () -> Result {
+        try {
+            pending->server.finish_connect();
+
+            if ( pending->server_addr.port() != 443 ) { /* normal HTTP */
+                proxy( move( pending->server ), move( pending->client ), pending->server_addr );
+            } else {
+                proxy( client_context_.new_secure_socket( move( pending->server ) ),
+                       server_context_.new_secure_socket( move( pending->client ) ),
+                       pending->server_addr );
             }
-        }, listener_socket_.accept() );
+        } catch ( const exception & e ) {
+            print_exception( e );
+            return ResultType::CancelAll;
+        }
 
-    /* don't wait around for the reply */
-    newthread.detach();
+        /* the sockets have moved on to the new connection's actions */
+        return ResultType::Cancel;
+    };
+
+    poller_.add_action( Poller::Action( pending->server, Direction::Out,
+                                        connected, [] () { return true; }, connected ) );
+}
+
+HTTPProxy::Worker::Worker( SSLContext & server_context, SSLContext & client_context,
+                           HTTPBackingStore & backing_store )
+    : server_context_( server_context ),
+      client_context_( client_context ),
+      backing_store_( backing_store ),
+      thread_( [&] () { loop(); } )
+{}
+
+HTTPProxy::Worker::~Worker()
+{
+    halt_ = true;
+    wake();
+    thread_.join();
+}
+
+void HTTPProxy::Worker::wake( void )
+{
+    const uint64_t one = 1;
+    wakeup_.write( string( reinterpret_cast<const char *>( &one ), sizeof( one ) ) );
+}
+
+void HTTPProxy::Worker::hand_off( TCPSocket && client )
+{
+    {
+        unique_lock<mutex> ul( mutex_ );
+        incoming_.push_back( move( client ) );
+    }
+
+    wake();
+}
+
+void HTTPProxy::Worker::loop( void )
+{
+    poller_.add_action( Poller::Action( wakeup_, Direction::In,
+                                        [&] () -> Result {
+                                            wakeup_.read();
+
+                                            vector< TCPSocket > incoming;
+                                            {
+                                                unique_lock<mutex> ul( mutex_ );
+                                                incoming.swap( incoming_ );
+                                            }
+
+                                            for ( auto & client : incoming ) {
+                                                try {
+                                                    add_connection( move( client ) );
+                                                } catch ( const exception & e ) {
+                                                    print_exception( e );
+                                                }
+                                            }
+
+                                            return halt_ ? ResultType::Exit : ResultType::Continue;
+                                        } ) );
+
+    try {
+        while ( poller_.poll( -1 ).result != Poller::Result::Type::Exit ) {}
+    } catch ( const exception & e ) {
+        print_exception( e );
+    }
 }
 
 /* register this HTTPProxy's TCP listener socket to handle events with
@@ -126,9 +452,21 @@ void HTTPProxy::handle_tcp( HTTPBackingStore & backing_store )
    backing_store (which is captured and must continue to persist) */
 void HTTPProxy::register_handlers( EventLoop & event_loop, HTTPBackingStore & backing_store )
 {
+    const unsigned int worker_count = max( 1u, thread::hardware_concurrency() );
+    for ( unsigned int i = 0; i < worker_count; i++ ) {
+        workers_.emplace_back( new Worker( server_context_, client_context_, backing_store ) );
+    }
+
     event_loop.add_simple_input_handler( tcp_listener(),
                                          [&] () {
-                                             handle_tcp( backing_store );
+                                             workers_.at( next_worker_ )->hand_off( listener_socket_.accept() );
+                                             next_worker_ = (next_worker_ + 1) % workers_.size();
                                              return ResultType::Continue;
                                          } );
 }
+
+void HTTPProxy::stop( void )
+{
+    /* each worker finishes its thread as it is destroyed */
+    workers_.clear();
+}
@@ -4,6 +4,8 @@
 #define HTTP_PROXY_HH
 
 #include <string>
+#include <vector>
+#include <memory>
 
 #include "socket.hh"
 #include "secure_socket.hh"
@@ -11,31 +13,36 @@
 
 class HTTPBackingStore;
 class EventLoop;
-class Poller;
-class HTTPRequestParser;
-class HTTPResponseParser;
 
 class HTTPProxy
 {
 private:
     TCPSocket listener_socket_;
 
-    template <class SocketType>
-    void loop( SocketType & server, SocketType & client, HTTPBackingStore & backing_store );
-
     SSLContext server_context_, client_context_;
 
+    /* a thread that multiplexes many proxied connections through one poller */
+    class Worker;
+    std::vector< std::unique_ptr< Worker > > workers_;
+
+    /* accepted connections are handed to the workers in turn */
+    size_t next_worker_;
+
 public:
     HTTPProxy( const Address & listener_addr );
+    ~HTTPProxy();
 
     TCPSocket & tcp_listener( void ) { return listener_socket_; }
 
-    void handle_tcp( HTTPBackingStore & backing_store );
-
     /* register this HTTPProxy's TCP listener socket to handle events with
        the given event_loop, saving request-response pairs to the given
-       backing_store (which is captured and must continue to persist) */
+       backing_store (which is captured and must continue to persist).
+       This starts one worker thread per core, so fork any children first. */
     void register_handlers( EventLoop & event_loop, HTTPBackingStore & backing_store );
+
+    /* stop the workers, abandoning their connections
+       (call before destroying the backing store) */
+    void stop( void );
 };
 
 #endif /* HTTP_PROXY_HH */
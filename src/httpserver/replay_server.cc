@@ -0,0 +1,232 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "replay_server.hh"
+#include "replay_store.hh"
+#include "http_request_parser.hh"
+#include "event_loop.hh"
+#include "poller.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* plain sockets have no handshake */
+static bool continue_handshake( TCPSocket & ) { return true; }
+static bool handshake_wants_read( const TCPSocket & ) { return false; }
+static bool handshake_wants_write( const TCPSocket & ) { return false; }
+
+static bool continue_handshake( SecureSocket & socket ) { return socket.continue_accept(); }
+static bool handshake_wants_read( const SecureSocket & socket ) { return socket.wants_read(); }
+static bool handshake_wants_write( const SecureSocket & socket ) { return socket.wants_write(); }
+
+/* will the client expect the connection to close after this request? */
+static bool client_wants_close( const HTTPRequest & request )
+{
+    if ( request.has_header( "Connection" ) ) {
+        return HTTPMessage::equivalent_strings( request.get_header_value( "Connection" ), "close" );
+    }
+
+    const string http_1_0 = "HTTP/1.0";
+    const string & first_line = request.first_line();
+    return first_line.size() >= http_1_0.size()
+        and first_line.compare( first_line.size() - http_1_0.size(), http_1_0.size(), http_1_0 ) == 0;
+}
+
+static string not_found( const HTTPRequest & request )
+{
+    const string body = "replayserver: could not find a match for " + request.first_line() + CRLF;
+
+    return "HTTP/1.1 404 Not Found" + CRLF
+        + "Content-Type: text/plain" + CRLF
+        + "Content-Length: " + to_string( body.size() ) + CRLF + CRLF
+        + body;
+}
+
+template <class SocketType>
+class ReplayConnection
+{
+private:
+    SocketType socket_;
+    const ReplayStore & store_;
+    const bool is_https_;
+
+    bool handshake_complete_;
+    HTTPRequestParser parser_ {};
+
+    /* responses not yet written to the client */
+    string outbound_ {};
+    size_t outbound_written_ { 0 };
+
+    /* close once outbound_ has been written */
+    bool closing_ { false };
+
+    bool drained( void ) const { return outbound_written_ == outbound_.size(); }
+
+    void answer_requests( void )
+    {
+        while ( not closing_ and not parser_.empty() ) {
+            const HTTPRequest & request = parser_.front();
+
+            const ReplayStore::Entry * const match = store_.find( request, is_https_ );
+            if ( match ) {
+                outbound_.append( match->response );
+                closing_ = match->close_after_response;
+            } else {
+                outbound_.append( not_found( request ) );
+            }
+
+            closing_ = closing_ or client_wants_close( request );
+
+            parser_.pop();
+        }
+    }
+
+public:
+    ReplayConnection( SocketType && socket, const ReplayStore & store, const bool is_https )
+        : socket_( move( socket ) ), store_( store ), is_https_( is_https ),
+          handshake_complete_( continue_handshake( socket_ ) )
+    {}
+
+    SocketType & socket( void ) { return socket_; }
+
+    bool wants_read( void ) const
+    {
+        if ( not handshake_complete_ ) {
+            return handshake_wants_read( socket_ );
+        }
+
+        return not closing_ and not socket_.eof();
+    }
+
+    bool wants_write( void ) const
+    {
+        if ( not handshake_complete_ ) {
+            return handshake_wants_write( socket_ );
+        }
+
+        return not drained();
+    }
+
+    Result handshake( void )
+    {
+        handshake_complete_ = continue_handshake( socket_ );
+        return ResultType::Continue;
+    }
+
+    Result read( void )
+    {
+        if ( not handshake_complete_ ) {
+            return handshake();
+        }
+
+        const string buffer = socket_.read();
+        if ( buffer.empty() and not socket_.eof() ) {
+            /* only part of a TLS record */
+            return ResultType::Continue;
+        }
+
+        parser_.parse( buffer );
+        answer_requests();
+
+        /* client is done and has nothing left to receive */
+        if ( socket_.eof() and drained() ) {
+            return ResultType::CancelAll;
+        }
+
+        return ResultType::Continue;
+    }
+
+    Result write( void )
+    {
+        if ( not handshake_complete_ ) {
+            return handshake();
+        }
+
+        const auto begin = outbound_.cbegin() + outbound_written_;
+        outbound_written_ += socket_.write( begin, outbound_.cend() ) - begin;
+
+        if ( drained() ) {
+            outbound_.clear();
+            outbound_written_ = 0;
+
+            if ( closing_ or socket_.eof() ) {
+                return ResultType::CancelAll;
+            }
+        }
+
+        return ResultType::Continue;
+    }
+};
+
+/* a connection's problems shouldn't stop the server */
+template <class Callable>
+static Poller::Action::CallbackType drop_on_error( const Callable & callback )
+{
+    return [callback] () -> Result {
+        try {
+            return callback();
+        } catch ( const exception & e ) {
+            print_exception( e );
+            return ResultType::CancelAll;
+        }
+    };
+}
+
+ReplayServer::ReplayServer( const set< Address > & addresses )
+    : server_context_( SERVER )
+{
+    for ( const auto & address : addresses ) {
+        listeners_.emplace_back();
+        listeners_.back().set_reuseaddr();
+        listeners_.back().bind( address );
+
+        /* browsers open many connections to each server at once */
+        listeners_.back().listen( 1024 );
+    }
+}
+
+template <class SocketType>
+void ReplayServer::serve( EventLoop & event_loop, SocketType && socket, const ReplayStore & store )
+{
+    const bool is_https = is_same< SocketType, SecureSocket >::value;
+
+    /* the connection lives as long as its actions stay in the poller */
+    auto connection = make_shared< ReplayConnection< SocketType > >( move( socket ), store, is_https );
+
+    const auto drop = [] () { return ResultType::CancelAll; };
+
+    event_loop.add_action( Poller::Action( connection->socket(), Direction::In,
+                                           drop_on_error( [connection] () { return connection->read(); } ),
+                                           [connection] () { return connection->wants_read(); },
+                                           drop ) );
+
+    event_loop.add_action( Poller::Action( connection->socket(), Direction::Out,
+                                           drop_on_error( [connection] () { return connection->write(); } ),
+                                           [connection] () { return connection->wants_write(); },
+                                           drop ) );
+}
+
+void ReplayServer::register_handlers( EventLoop & event_loop, const ReplayStore & store )
+{
+    for ( auto & listener : listeners_ ) {
+        const bool is_https = listener.local_address().port() == 443;
+
+        event_loop.add_simple_input_handler( listener,
+                                             [&, is_https] () {
+                                                 TCPSocket client = listener.accept();
+                                                 client.set_blocking( false );
+
+                                                 if ( is_https ) {
+                                                     serve( event_loop, server_context_.new_secure_socket( move( client ) ), store );
+                                                 } else {
+                                                     serve( event_loop, move( client ), store );
+                                                 }
+
+                                                 return ResultType::Continue;
+                                             } );
+    }
+}
@@ -0,0 +1,37 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef REPLAY_SERVER_HH
+#define REPLAY_SERVER_HH
+
+#include <vector>
+#include <set>
+
+#include "socket.hh"
+#include "secure_socket.hh"
+#include "address.hh"
+
+class EventLoop;
+class ReplayStore;
+
+/* answers requests for every recorded server from one event loop,
+   keeping connections alive between requests */
+class ReplayServer
+{
+private:
+    /* listeners for HTTP and (on port 443) HTTPS */
+    std::vector< TCPSocket > listeners_ {};
+
+    SSLContext server_context_;
+
+    template <class SocketType>
+    void serve( EventLoop & event_loop, SocketType && socket, const ReplayStore & store );
+
+public:
+    /* binds the addresses, so construct before dropping privileges */
+    ReplayServer( const std::set< Address > & addresses );
+
+    /* serve requests from the store (which is captured and must continue to persist) */
+    void register_handlers( EventLoop & event_loop, const ReplayStore & store );
+};
+
+#endif /* REPLAY_SERVER_HH */
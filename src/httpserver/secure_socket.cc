@@ -105,7 +105,8 @@ SSLContext::SSLContext( const SSL_MODE type )
 
 SecureSocket::SecureSocket( TCPSocket && sock, SSL * ssl )
     : TCPSocket( move( sock ) ),
-      ssl_( ssl )
+      ssl_( ssl ),
+      want_( 0 )
 {
     if ( not ssl_ ) {
         throw runtime_error( "SecureSocket: constructor must be passed valid SSL structure" );
@@ -117,6 +118,10 @@ SecureSocket::SecureSocket( TCPSocket && sock, SSL * ssl )
 
     /* enable read/write to return only after handshake/renegotiation and successful completion */
     SSL_set_mode( ssl_.get(), SSL_MODE_AUTO_RETRY );
+
+    /* let a non-blocking SSL_write return after each record, and be retried
+       from a buffer that has since grown */
+    SSL_set_mode( ssl_.get(), SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER );
 }
 
 SecureSocket SSLContext::new_secure_socket( TCPSocket && sock )
@@ -144,6 +149,36 @@ void SecureSocket::accept( void )
     register_read();
 }
 
+bool SecureSocket::continue_handshake( const int ret, const string & attempt )
+{
+    /* the handshake may both read and write the socket */
+    register_read();
+    register_write();
+
+    if ( ret == 1 ) {
+        want_ = 0;
+        return true;
+    }
+
+    const int error = SSL_get_error( ssl_.get(), ret );
+    if ( error == SSL_ERROR_WANT_READ or error == SSL_ERROR_WANT_WRITE ) {
+        want_ = error;
+        return false;
+    }
+
+    throw ssl_error( attempt );
+}
+
+bool SecureSocket::continue_connect( void )
+{
+    return continue_handshake( SSL_connect( ssl_.get() ), "SSL_connect" );
+}
+
+bool SecureSocket::continue_accept( void )
+{
+    return continue_handshake( SSL_accept( ssl_.get() ), "SSL_accept" );
+}
+
 string SecureSocket::read( void )
 {
     /* SSL record max size is 16kB */
@@ -168,9 +203,16 @@ string SecureSocket::read( void )
         register_read();
         return string(); /* EOF */
     } else if ( bytes_read < 0 ) {
+        if ( SSL_get_error( ssl_.get(), bytes_read ) == SSL_ERROR_WANT_READ ) {
+            /* non-blocking, and only part of a record has arrived */
+            want_ = SSL_ERROR_WANT_READ;
+            register_read();
+            return string();
+        }
         throw ssl_error( "SSL_read" );
     } else {
         /* success */
+        want_ = 0;
         register_read();
         return string( buffer, bytes_read );
     }
@@ -178,12 +220,34 @@ string SecureSocket::read( void )
 
 void SecureSocket::write(const string & message )
 {
-    /* SSL_write returns with success if complete contents of message are written */
-    ssize_t bytes_written = SSL_write( ssl_.get(), message.data(), message.length() );
+    /* with partial writes enabled, SSL_write may return after each record */
+    auto it = message.begin();
+    while ( it != message.end() ) {
+        it = write( it, message.end() );
+    }
+}
 
-    if ( bytes_written < 0 ) {
-        throw ssl_error( "SSL_write" );
+string::const_iterator SecureSocket::write( const string::const_iterator & begin,
+                                            const string::const_iterator & end )
+{
+    if ( begin >= end ) {
+        throw runtime_error( "nothing to write" );
     }
 
+    const int bytes_written = SSL_write( ssl_.get(), &*begin, end - begin );
+
     register_write();
+
+    if ( bytes_written > 0 ) {
+        want_ = 0;
+        return begin + bytes_written;
+    }
+
+    /* non-blocking, and the socket buffer is full: retry with the same data */
+    if ( SSL_get_error( ssl_.get(), bytes_written ) == SSL_ERROR_WANT_WRITE ) {
+        want_ = SSL_ERROR_WANT_WRITE;
+        return begin;
+    }
+
+    throw ssl_error( "SSL_write" );
 }
@@ -21,14 +21,35 @@ private:
     typedef std::unique_ptr<SSL, SSL_deleter> SSL_handle;
     SSL_handle ssl_;
 
+    /* what the last non-blocking operation is waiting for
+       (SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE), or zero */
+    int want_;
+
+    bool continue_handshake( const int ret, const std::string & attempt );
+
     SecureSocket( TCPSocket && sock, SSL * ssl );
 
 public:
     void connect( void );
     void accept( void );
 
+    /* for non-blocking sockets: make as much progress on the handshake as
+       possible, and return true once it has completed. Call again when
+       the socket is ready in the direction given by wants_read()/wants_write(). */
+    bool continue_connect( void );
+    bool continue_accept( void );
+
+    bool wants_read( void ) const { return want_ == SSL_ERROR_WANT_READ; }
+    bool wants_write( void ) const { return want_ == SSL_ERROR_WANT_WRITE; }
+
+    /* on a non-blocking socket, read() returns an empty string without EOF
+       when no application data is available yet */
     std::string read( void );
     void write( const std::string & message );
+
+    /* write as much as possible without blocking; returns the end of what was written */
+    std::string::const_iterator write( const std::string::const_iterator & begin,
+                                       const std::string::const_iterator & end );
 };
 
 class SSLContext
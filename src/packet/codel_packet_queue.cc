@@ -1,5 +1,6 @@
 #include <math.h>
 #include "codel_packet_queue.hh"
+#include "tun_packet.hh"
 #include "timestamp.hh"
 
 
@@ -7,8 +8,8 @@ using namespace std;
 
 CODELPacketQueue::CODELPacketQueue( const string & args )
   : DroppingPacketQueue(args),
-    target_ ( get_arg( args, "target") ),
-    interval_ ( get_arg( args, "interval") ),
+    target_ ( arg( "target" ) * 1000 ),
+    interval_ ( arg( "interval" ) * 1000 ),
     first_above_time_ ( 0 ),
     drop_next_( 0 ),
     count_ ( 0 ),
@@ -61,7 +62,7 @@ uint64_t CODELPacketQueue::control_law ( uint64_t t, uint32_t count )
 
 QueuedPacket CODELPacketQueue::dequeue( void )
 {   
-  const uint64_t now = timestamp();
+  const uint64_t now = timestamp_usecs();
   dodequeue_result r = std::move( dodequeue ( now ) );
   uint32_t delta;
     
@@ -90,7 +91,7 @@ QueuedPacket CODELPacketQueue::dequeue( void )
     lastcount_ = count_;
   }
 
-  return r.p;
+  return std::move( r.p );
 }
 
 
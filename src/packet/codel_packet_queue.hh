@@ -11,7 +11,7 @@ struct dodequeue_result {
     bool ok_to_drop;
 
     dodequeue_result ( )
-        : p ( "", 0 ), ok_to_drop ( false )
+        : p ( PacketBuffer(), 0 ), ok_to_drop ( false )
     {}
 };
 
@@ -25,11 +25,10 @@ struct dodequeue_result {
 class CODELPacketQueue : public DroppingPacketQueue
 {
 private:
-    const static unsigned int PACKET_SIZE = 1504;
-    //Configuration parameters
+    //Configuration parameters (given in ms, kept in us)
     uint32_t target_, interval_;
 
-    //State variables
+    //State variables (times in us)
     uint64_t first_above_time_, drop_next_;
     uint32_t count_, lastcount_;
     bool dropping_;
@@ -1,28 +1,38 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <iostream>
+#include <algorithm>
 
 #include "dropping_packet_queue.hh"
+#include "tun_packet.hh"
 #include "exception.hh"
 #include "ezio.hh"
 
 using namespace std;
 
+/* most packets to make room for up front; a queue held to more grows as it fills */
+static const unsigned int MAX_PREALLOCATED = 65536;
+
 DroppingPacketQueue::DroppingPacketQueue( const string & args )
-    : packet_limit_( get_arg( args, "packets" ) ),
-      byte_limit_( get_arg( args, "bytes" ) )
+    : internal_queue_(),
+      args_( parse_args( args ) ),
+      packet_limit_( arg( "packets" ) ),
+      byte_limit_( arg( "bytes" ) )
 {
     if ( packet_limit_ == 0 and byte_limit_ == 0 ) {
         throw runtime_error( "Dropping queue must have a byte or packet limit." );
     }
+
+    /* one over the limit, for the queues that accept and then drop */
+    const unsigned int expected_packets = packet_limit_ ? packet_limit_ : byte_limit_ / PACKET_SIZE + 1;
+    internal_queue_.reserve( min( expected_packets, MAX_PREALLOCATED ) + 1 );
 }
 
 QueuedPacket DroppingPacketQueue::dequeue( void )
 {
     assert( not internal_queue_.empty() );
 
-    QueuedPacket ret = std::move( internal_queue_.front() );
-    internal_queue_.pop();
+    QueuedPacket ret = internal_queue_.pop();
 
     queue_size_in_bytes_ -= ret.contents.size();
     queue_size_in_packets_--;
@@ -32,6 +42,12 @@ QueuedPacket DroppingPacketQueue::dequeue( void )
     return ret;
 }
 
+unsigned int DroppingPacketQueue::arg( const string & name ) const
+{
+    const auto it = args_.find( name );
+    return it == args_.end() ? 0 : it->second;
+}
+
 bool DroppingPacketQueue::empty( void ) const
 {
     return internal_queue_.empty();
@@ -60,14 +76,12 @@ bool DroppingPacketQueue::good( void ) const
 
 unsigned int DroppingPacketQueue::size_bytes( void ) const
 {
-    assert( queue_size_in_bytes_ >= 0 );
-    return unsigned( queue_size_in_bytes_ );
+    return queue_size_in_bytes_;
 }
 
 unsigned int DroppingPacketQueue::size_packets( void ) const
 {
-    assert( queue_size_in_packets_ >= 0 );
-    return unsigned( queue_size_in_packets_ );
+    return queue_size_in_packets_;
 }
 
 /* put a packet on the back of the queue */
@@ -75,7 +89,7 @@ void DroppingPacketQueue::accept( QueuedPacket && p )
 {
     queue_size_in_bytes_ += p.contents.size();
     queue_size_in_packets_++;
-    internal_queue_.emplace( std::move( p ) );
+    internal_queue_.push( std::move( p ) );
 }
 
 string DroppingPacketQueue::to_string( void ) const
@@ -99,34 +113,33 @@ string DroppingPacketQueue::to_string( void ) const
     return ret;
 }
 
-unsigned int DroppingPacketQueue::get_arg( const string & args, const string & name )
+DroppingPacketQueue::Args DroppingPacketQueue::parse_args( const string & args )
 {
-    auto offset = args.find( name );
-    if ( offset == string::npos ) {
-        return 0; /* default value */
-    } else {
-        /* extract the value */
-
-        /* advance by length of name */
-        offset += name.size();
-
-        /* make sure next char is "=" */
-        if ( args.substr( offset, 1 ) != "=" ) {
+    Args ret;
+    const string separators = ", \t";
+
+    for ( size_t start = args.find_first_not_of( separators ); start != string::npos;
+          start = args.find_first_not_of( separators, start ) ) {
+        const size_t end = min( args.find_first_of( separators, start ), args.size() );
+        const string token = args.substr( start, end - start );
+        start = end;
+
+        /* NAME=NUMBER */
+        const size_t equals = token.find( '=' );
+        if ( equals == 0 or equals == string::npos or equals + 1 == token.size()
+             or token.find_first_not_of( "0123456789", equals + 1 ) != string::npos ) {
             throw runtime_error( "could not parse queue arguments: " + args );
         }
 
-        /* advance by length of "=" */
-        offset++;
-
-        /* find the first non-digit character */
-        auto offset2 = args.substr( offset ).find_first_not_of( "0123456789" );
-
-        auto digit_string = args.substr( offset ).substr( 0, offset2 );
+        ret[ token.substr( 0, equals ) ] = myatoi( token.substr( equals + 1 ) );
+    }
 
-        if ( digit_string.empty() ) {
-            throw runtime_error( "could not parse queue arguments: " + args );
-        }
+    return ret;
+}
 
-        return myatoi( digit_string );
-    }
+unsigned int DroppingPacketQueue::get_arg( const string & args, const string & name )
+{
+    const Args parsed = parse_args( args );
+    const auto it = parsed.find( name );
+    return it == parsed.end() ? 0 : it->second; /* default value */
 }
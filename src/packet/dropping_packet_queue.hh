@@ -3,25 +3,34 @@
 #ifndef DROPPING_PACKET_QUEUE_HH
 #define DROPPING_PACKET_QUEUE_HH
 
-#include <queue>
+#include <map>
 #include <cassert>
 
 #include "abstract_packet_queue.hh"
+#include "ring_buffer.hh"
 #include "exception.hh"
 
 class DroppingPacketQueue : public AbstractPacketQueue
 {
+public:
+    typedef std::map<std::string, unsigned int> Args;
+
 private:
-    int queue_size_in_bytes_ = 0, queue_size_in_packets_ = 0;
+    unsigned int queue_size_in_bytes_ = 0, queue_size_in_packets_ = 0;
 
-    std::queue<QueuedPacket> internal_queue_ {};
+    /* sized from the limits up front, so steady-state traffic never allocates */
+    RingBuffer<QueuedPacket> internal_queue_;
 
     virtual const std::string & type( void ) const = 0;
 
 protected:
+    const Args args_;
     const unsigned int packet_limit_;
     const unsigned int byte_limit_;
 
+    /* a queue argument, or 0 if it was not given */
+    unsigned int arg( const std::string & name ) const;
+
     /* put a packet on the back of the queue */
     void accept( QueuedPacket && p );
 
@@ -41,6 +50,8 @@ public:
 
     std::string to_string( void ) const override;
 
+    /* "NAME=NUMBER[, NAME2=NUMBER2, ...]" */
+    static Args parse_args( const std::string & args );
     static unsigned int get_arg( const std::string & args, const std::string & name );
 
     unsigned int size_bytes( void ) const override;
@@ -0,0 +1,311 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <random>
+
+#include "fq_codel_packet_queue.hh"
+#include "timestamp.hh"
+#include "tun_packet.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static unsigned int arg_or_default( const DroppingPacketQueue::Args & args, const string & name,
+                                    const unsigned int default_value )
+{
+    const auto it = args.find( name );
+    return it == args.end() ? default_value : it->second;
+}
+
+static uint64_t load( const unsigned char * data, const size_t length )
+{
+    uint64_t value = 0;
+    memcpy( &value, data, length );
+    return value;
+}
+
+/* fold a value into the hash (the splitmix64 finalizer) */
+static uint64_t mix( uint64_t hash, const uint64_t value )
+{
+    hash ^= value;
+    hash += 0x9e3779b97f4a7c15;
+    hash = ( hash ^ ( hash >> 30 ) ) * 0xbf58476d1ce4e5b9;
+    hash = ( hash ^ ( hash >> 27 ) ) * 0x94d049bb133111eb;
+    return hash ^ ( hash >> 31 );
+}
+
+FQCoDelPacketQueue::FQCoDelPacketQueue( const string & args, const bool vnet_hdr )
+    : FQCoDelPacketQueue( DroppingPacketQueue::parse_args( args ), vnet_hdr )
+{}
+
+FQCoDelPacketQueue::FQCoDelPacketQueue( const DroppingPacketQueue::Args & args, const bool vnet_hdr )
+    : packet_limit_( arg_or_default( args, "packets", 0 ) ),
+      byte_limit_( arg_or_default( args, "bytes", 0 ) ),
+      target_( arg_or_default( args, "target", 5 ) * 1000 ),
+      interval_( arg_or_default( args, "interval", 100 ) * 1000 ),
+      quantum_( arg_or_default( args, "quantum", PACKET_SIZE ) ),
+      flows_( arg_or_default( args, "flows", 1024 ) ),
+      size_bytes_( 0 ),
+      size_packets_( 0 ),
+      perturbation_( args.count( "seed" ) ? mix( 0, args.at( "seed" ) )
+                     : ( uint64_t( random_device()() ) << 32 ) | random_device()() ),
+      ip_offset_( tun_ip_offset( vnet_hdr ) )
+{
+    if ( packet_limit_ == 0 and byte_limit_ == 0 ) {
+        throw runtime_error( "FQ-CoDel queue must have a byte or packet limit." );
+    }
+
+    if ( flows_.empty() ) {
+        throw runtime_error( "FQ-CoDel queue must have at least one flow." );
+    }
+
+    if ( quantum_ == 0 ) {
+        throw runtime_error( "FQ-CoDel queue must have a nonzero quantum." );
+    }
+}
+
+/* The TUN device hands us each packet after four bytes of packet
+   information, the last two of which are the ethertype (and, if it was
+   opened with offloads, a virtio-net header; see tun_packet.hh). Anything
+   that is not IPv4 or IPv6 shares one flow; so do the ports of IP
+   fragments. */
+unsigned int FQCoDelPacketQueue::flow_index( const PacketBuffer & contents ) const
+{
+    const unsigned char * const packet = reinterpret_cast<const unsigned char *>( contents.data() );
+    const unsigned char * const end = packet + contents.size();
+
+    uint64_t hash = perturbation_;
+
+    if ( contents.size() < ip_offset_ ) {
+        return hash % flows_.size();
+    }
+
+    const unsigned char * const ip = packet + ip_offset_;
+    const unsigned int ethertype = ( packet[ 2 ] << 8 ) | packet[ 3 ];
+
+    const unsigned char * transport = nullptr;
+    unsigned int protocol = 0;
+
+    if ( ethertype == 0x0800 and end - ip >= 20 ) {
+        const size_t header_length = ( ip[ 0 ] & 0x0f ) * 4;
+        const bool fragment = ( ( ( ip[ 6 ] & 0x3f ) << 8 ) | ip[ 7 ] ) != 0; /* MF flag or an offset */
+
+        hash = mix( hash, load( ip + 12, 8 ) ); /* source and destination addresses */
+        protocol = ip[ 9 ];
+
+        /* a header that claims more than the packet holds gives no ports */
+        if ( header_length >= 20 and size_t( end - ip ) >= header_length and not fragment ) {
+            transport = ip + header_length;
+        }
+    } else if ( ethertype == 0x86dd and end - ip >= 40 ) {
+        for ( size_t offset = 8; offset < 40; offset += 8 ) {
+            hash = mix( hash, load( ip + offset, 8 ) );
+        }
+        protocol = ip[ 6 ];
+        transport = ip + 40;
+    } else {
+        return hash % flows_.size();
+    }
+
+    hash = mix( hash, protocol );
+
+    /* TCP, UDP, DCCP and SCTP all start with the two ports */
+    if ( ( protocol == 6 or protocol == 17 or protocol == 33 or protocol == 132 )
+         and transport and end - transport >= 4 ) {
+        hash = mix( hash, load( transport, 4 ) );
+    }
+
+    return hash % flows_.size();
+}
+
+bool FQCoDelPacketQueue::good( void ) const
+{
+    return ( byte_limit_ == 0 or size_bytes_ <= byte_limit_ )
+        and ( packet_limit_ == 0 or size_packets_ <= packet_limit_ );
+}
+
+/* As Linux does, take up to half the fattest flow's bytes (at most 64
+   packets) at once, so the search over the flows happens rarely. */
+void FQCoDelPacketQueue::drop_from_fattest_flow( void )
+{
+    Flow * fattest = &flows_.front();
+    for ( auto & flow : flows_ ) {
+        if ( flow.bytes > fattest->bytes ) {
+            fattest = &flow;
+        }
+    }
+
+    assert( not fattest->packets.empty() );
+
+    const unsigned int threshold = fattest->bytes / 2;
+    unsigned int dropped_bytes = 0;
+
+    for ( unsigned int i = 0; i < 64 and dropped_bytes < threshold and not fattest->packets.empty(); i++ ) {
+        dropped_bytes += pop( *fattest ).contents.size();
+    }
+
+    /* the flow's last packet can leave nothing to halve */
+    if ( dropped_bytes == 0 ) {
+        pop( *fattest );
+    }
+}
+
+void FQCoDelPacketQueue::enqueue( QueuedPacket && p )
+{
+    const unsigned int index = flow_index( p.contents );
+    Flow & flow = flows_.at( index );
+
+    flow.bytes += p.contents.size();
+    size_bytes_ += p.contents.size();
+    size_packets_++;
+
+    flow.packets.push( move( p ) );
+
+    if ( not flow.active ) {
+        flow.active = true;
+        flow.deficit = quantum_;
+        new_flows_.push( index );
+    }
+
+    while ( not good() ) {
+        drop_from_fattest_flow();
+    }
+}
+
+QueuedPacket FQCoDelPacketQueue::pop( Flow & flow )
+{
+    assert( not flow.packets.empty() );
+
+    QueuedPacket ret = flow.packets.pop();
+
+    flow.bytes -= ret.contents.size();
+    size_bytes_ -= ret.contents.size();
+    size_packets_--;
+
+    return ret;
+}
+
+/* CoDel's dodequeue: take the head of the flow and say whether it has
+   been above target for an interval. As with the codel queue, a flow's
+   last packet is never declared droppable, so dequeue() always has
+   something to give. */
+QueuedPacket FQCoDelPacketQueue::codel_pop( Flow & flow, const uint64_t now, bool & ok_to_drop )
+{
+    QueuedPacket p = pop( flow );
+    ok_to_drop = false;
+
+    if ( flow.packets.empty() ) {
+        flow.first_above_time = 0;
+        return p;
+    }
+
+    if ( now - p.arrival_time < target_ or flow.bytes <= PACKET_SIZE ) {
+        flow.first_above_time = 0;
+    } else if ( flow.first_above_time == 0 ) {
+        flow.first_above_time = now + interval_;
+    } else if ( now >= flow.first_above_time ) {
+        ok_to_drop = true;
+    }
+
+    return p;
+}
+
+uint64_t FQCoDelPacketQueue::control_law( const uint64_t t, const uint32_t count ) const
+{
+    return t + uint64_t( interval_ / sqrt( count ) );
+}
+
+QueuedPacket FQCoDelPacketQueue::codel_dequeue( Flow & flow, const uint64_t now )
+{
+    bool ok_to_drop;
+    QueuedPacket p = codel_pop( flow, now, ok_to_drop );
+
+    if ( flow.dropping ) {
+        if ( not ok_to_drop ) {
+            flow.dropping = false;
+        }
+
+        while ( flow.dropping and now >= flow.drop_next ) {
+            /* drop p, and try the next */
+            flow.count++;
+            p = codel_pop( flow, now, ok_to_drop );
+            if ( not ok_to_drop ) {
+                flow.dropping = false;
+            } else {
+                flow.drop_next = control_law( flow.drop_next, flow.count );
+            }
+        }
+    } else if ( ok_to_drop ) {
+        p = codel_pop( flow, now, ok_to_drop );
+        flow.dropping = true;
+
+        const uint32_t delta = flow.count - flow.lastcount;
+        flow.count = ( delta > 1 and now - flow.drop_next < 16 * uint64_t( interval_ ) ) ? delta : 1;
+        flow.drop_next = control_law( now, flow.count );
+        flow.lastcount = flow.count;
+    }
+
+    return p;
+}
+
+QueuedPacket FQCoDelPacketQueue::dequeue( void )
+{
+    assert( not empty() );
+
+    const uint64_t now = timestamp_usecs();
+
+    while ( true ) {
+        /* every flow holding packets is on one of the lists */
+        RingBuffer<unsigned int> & list = new_flows_.empty() ? old_flows_ : new_flows_;
+        assert( not list.empty() );
+
+        const unsigned int index = list.front();
+        Flow & flow = flows_.at( index );
+
+        if ( flow.deficit <= 0 ) {
+            flow.deficit += quantum_;
+            list.pop();
+            old_flows_.push( index );
+            continue;
+        }
+
+        if ( flow.packets.empty() ) {
+            list.pop();
+
+            /* a new flow that empties goes to the back of the old ones,
+               so it cannot regain priority just by pausing */
+            if ( &list == &new_flows_ and not old_flows_.empty() ) {
+                old_flows_.push( index );
+            } else {
+                flow.active = false;
+            }
+            continue;
+        }
+
+        QueuedPacket p = codel_dequeue( flow, now );
+        flow.deficit -= p.contents.size();
+        return p;
+    }
+}
+
+string FQCoDelPacketQueue::to_string( void ) const
+{
+    string ret = "fq_codel [";
+
+    if ( byte_limit_ ) {
+        ret += "bytes=" + ::to_string( byte_limit_ ) + ", ";
+    }
+
+    if ( packet_limit_ ) {
+        ret += "packets=" + ::to_string( packet_limit_ ) + ", ";
+    }
+
+    ret += "flows=" + ::to_string( flows_.size() )
+        + ", quantum=" + ::to_string( quantum_ )
+        + ", target=" + ::to_string( target_ / 1000 )
+        + ", interval=" + ::to_string( interval_ / 1000 ) + "]";
+
+    return ret;
+}
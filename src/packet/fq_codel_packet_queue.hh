@@ -0,0 +1,76 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef FQ_CODEL_PACKET_QUEUE_HH
+#define FQ_CODEL_PACKET_QUEUE_HH
+
+#include <vector>
+
+#include "dropping_packet_queue.hh"
+#include "ring_buffer.hh"
+
+/* Flow-queueing CoDel (RFC 8290), after fq_codel in Linux. Packets are
+   hashed on their 5-tuple into one of a fixed number of flow queues,
+   each with its own CoDel state. Dequeueing is deficit round robin
+   across the flows, with flows that have just become busy served
+   before the rest. When the queue is over its limit, packets are
+   dropped from the head of the flow holding the most bytes. */
+
+class FQCoDelPacketQueue : public AbstractPacketQueue
+{
+private:
+    struct Flow
+    {
+        RingBuffer<QueuedPacket> packets {};
+        unsigned int bytes = 0;
+        int deficit = 0;
+        bool active = false; /* on new_flows_ or old_flows_ */
+
+        /* CoDel state (times in us) */
+        uint64_t first_above_time = 0, drop_next = 0;
+        uint32_t count = 0, lastcount = 0;
+        bool dropping = false;
+    };
+
+    const unsigned int packet_limit_, byte_limit_;
+    const uint32_t target_, interval_; /* us */
+    const unsigned int quantum_;
+
+    std::vector<Flow> flows_;
+    RingBuffer<unsigned int> new_flows_ {}, old_flows_ {};
+
+    unsigned int size_bytes_, size_packets_;
+
+    /* keeps the flow hash from being predictable */
+    const uint64_t perturbation_;
+
+    /* where the IP header starts (after a virtio-net header, with offloads) */
+    const size_t ip_offset_;
+
+    FQCoDelPacketQueue( const DroppingPacketQueue::Args & args, const bool vnet_hdr );
+
+    unsigned int flow_index( const PacketBuffer & contents ) const;
+
+    bool good( void ) const;
+    void drop_from_fattest_flow( void );
+
+    QueuedPacket pop( Flow & flow );
+    QueuedPacket codel_pop( Flow & flow, const uint64_t now, bool & ok_to_drop );
+    QueuedPacket codel_dequeue( Flow & flow, const uint64_t now );
+    uint64_t control_law( const uint64_t t, const uint32_t count ) const;
+
+public:
+    FQCoDelPacketQueue( const std::string & args, const bool vnet_hdr = false );
+
+    void enqueue( QueuedPacket && p ) override;
+
+    QueuedPacket dequeue( void ) override;
+
+    bool empty( void ) const override { return size_packets_ == 0; }
+
+    std::string to_string( void ) const override;
+
+    unsigned int size_bytes( void ) const override { return size_bytes_; }
+    unsigned int size_packets( void ) const override { return size_packets_; }
+};
+
+#endif /* FQ_CODEL_PACKET_QUEUE_HH */
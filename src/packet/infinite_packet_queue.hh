@@ -3,17 +3,17 @@
 #ifndef INFINITE_PACKET_QUEUE_HH
 #define INFINITE_PACKET_QUEUE_HH
 
-#include <queue>
 #include <cassert>
 
 #include "queued_packet.hh"
 #include "abstract_packet_queue.hh"
+#include "ring_buffer.hh"
 #include "exception.hh"
 
 class InfinitePacketQueue : public AbstractPacketQueue
 {
 private:
-    std::queue<QueuedPacket> internal_queue_ {};
+    RingBuffer<QueuedPacket> internal_queue_ {};
     int queue_size_in_bytes_ = 0, queue_size_in_packets_ = 0;
 
 public:
@@ -28,15 +28,14 @@ public:
     {
         queue_size_in_bytes_ += p.contents.size();
         queue_size_in_packets_++;
-        internal_queue_.emplace( std::move( p ) );
+        internal_queue_.push( std::move( p ) );
     }
 
     QueuedPacket dequeue( void ) override
     {
         assert( not internal_queue_.empty() );
 
-        QueuedPacket ret = std::move( internal_queue_.front() );
-        internal_queue_.pop();
+        QueuedPacket ret = internal_queue_.pop();
 
         queue_size_in_bytes_ -= ret.contents.size();
         queue_size_in_packets_--;
@@ -0,0 +1,30 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "packet_queue_factory.hh"
+#include "infinite_packet_queue.hh"
+#include "drop_tail_packet_queue.hh"
+#include "drop_head_packet_queue.hh"
+#include "codel_packet_queue.hh"
+#include "pie_packet_queue.hh"
+#include "fq_codel_packet_queue.hh"
+
+using namespace std;
+
+unique_ptr<AbstractPacketQueue> make_packet_queue( const string & type, const string & args, const bool vnet_hdr )
+{
+    if ( type == "infinite" ) {
+        return unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( args ) );
+    } else if ( type == "droptail" ) {
+        return unique_ptr<AbstractPacketQueue>( new DropTailPacketQueue( args ) );
+    } else if ( type == "drophead" ) {
+        return unique_ptr<AbstractPacketQueue>( new DropHeadPacketQueue( args ) );
+    } else if ( type == "codel" ) {
+        return unique_ptr<AbstractPacketQueue>( new CODELPacketQueue( args ) );
+    } else if ( type == "pie" ) {
+        return unique_ptr<AbstractPacketQueue>( new PIEPacketQueue( args ) );
+    } else if ( type == "fq_codel" ) {
+        return unique_ptr<AbstractPacketQueue>( new FQCoDelPacketQueue( args, vnet_hdr ) );
+    } else {
+        return nullptr;
+    }
+}
@@ -0,0 +1,17 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PACKET_QUEUE_FACTORY_HH
+#define PACKET_QUEUE_FACTORY_HH
+
+#include <memory>
+#include <string>
+
+#include "abstract_packet_queue.hh"
+
+/* the queue of the given type (infinite, droptail, drophead, codel, pie or
+   fq_codel) and arguments, or nullptr for an unknown type. vnet_hdr says
+   the packets come from a TUN device with offloads (see tun_packet.hh). */
+std::unique_ptr<AbstractPacketQueue> make_packet_queue( const std::string & type, const std::string & args,
+                                                        const bool vnet_hdr = false );
+
+#endif /* PACKET_QUEUE_FACTORY_HH */
@@ -1,10 +1,16 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <thread>
+#include <mutex>
 #include <chrono>
+#include <memory>
+#include <cassert>
 
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <net/route.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "packetshell.hh"
 #include "netdevice.hh"
@@ -16,17 +22,108 @@
 #include "timestamp.hh"
 #include "exception.hh"
 #include "bindworkaround.hh"
+#include "packet_buffer.hh"
 #include "config.h"
 
 using namespace std;
 using namespace PollerShortNames;
 
+/* the CPUs this thread may run on */
+static vector<int> allowed_cpus( void )
+{
+    cpu_set_t allowed;
+    CPU_ZERO( &allowed );
+    SystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( allowed ), &allowed ) );
+
+    vector<int> ret;
+    for ( int cpu = 0; cpu < CPU_SETSIZE; cpu++ ) {
+        if ( CPU_ISSET( cpu, &allowed ) ) {
+            ret.push_back( cpu );
+        }
+    }
+
+    return ret;
+}
+
+/* keep the calling thread on one CPU */
+static void pin_thread( const int cpu )
+{
+    cpu_set_t only;
+    CPU_ZERO( &only );
+    CPU_SET( cpu, &only );
+    SystemCall( "sched_setaffinity", sched_setaffinity( 0, sizeof( only ), &only ) );
+}
+
+/* the CPUs for one direction's ferry lanes (0 for the uplink, whose lanes
+   come first, then 1 for the downlink), or none if the two directions'
+   lanes would have to share CPUs */
+static vector<int> lane_cpus( const unsigned int lanes, const unsigned int direction )
+{
+    const vector<int> cpus = allowed_cpus();
+
+    if ( lanes < 2 or 2 * lanes > cpus.size() ) {
+        return {};
+    }
+
+    return vector<int>( cpus.begin() + direction * lanes, cpus.begin() + ( direction + 1 ) * lanes );
+}
+
+/* a device's first queue, then its others */
+static vector<FileDescriptor *> all_queues( FileDescriptor & first, vector<FileDescriptor> & others )
+{
+    vector<FileDescriptor *> ret { &first };
+    for ( auto & queue : others ) {
+        ret.push_back( &queue );
+    }
+    return ret;
+}
+
+/* tells the ferry threads to stop, and waits for them */
+class FerryThreads
+{
+private:
+    FileDescriptor stop_;
+    std::vector<std::thread> threads_;
+
+public:
+    FerryThreads()
+        : stop_( SystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK ) ) ),
+          threads_()
+    {}
+
+    FileDescriptor & stop( void ) { return stop_; }
+
+    template <typename... Targs>
+    void start( Targs&&... Fargs ) { threads_.emplace_back( forward<Targs>( Fargs )... ); }
+
+    ~FerryThreads()
+    {
+        try {
+            const uint64_t one = 1;
+            stop_.write( string( reinterpret_cast<const char *>( &one ), sizeof( one ) ) );
+        } catch ( const exception & e ) {
+            print_exception( e );
+        }
+
+        for ( auto & thread : threads_ ) {
+            thread.join();
+        }
+    }
+
+    FerryThreads( const FerryThreads & other ) = delete;
+    FerryThreads & operator=( const FerryThreads & other ) = delete;
+};
+
 template <class FerryQueueType>
-PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, char ** const user_environment, const bool passthrough_until_signal )
+PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, char ** const user_environment, const bool passthrough_until_signal,
+                                          const bool offload, const unsigned int threads )
     : user_environment_( user_environment ),
+      offload_( offload ),
+      threads_( threads ),
       egress_ingress( two_unassigned_addresses( get_mahimahi_base() ) ),
       nameserver_( first_nameserver() ),
-      egress_tun_( device_prefix + "-" + to_string( getpid() ) , egress_addr(), ingress_addr() ),
+      egress_tun_( device_prefix + "-" + to_string( getpid() ) , egress_addr(), ingress_addr(), offload, threads > 1 ),
+      egress_queues_(),
       dns_outside_( egress_addr(), nameserver_, nameserver_ ),
       nat_rule_( ingress_addr() ),
       passthrough_until_signal_( passthrough_until_signal ),
@@ -38,6 +135,15 @@ PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, cha
         throw runtime_error( "PacketShell: environment was not cleared" );
     }
 
+    if ( threads_ == 0 ) {
+        throw runtime_error( "PacketShell: need at least one thread" );
+    }
+
+    /* the downlink's queues, attached here in the outer namespace */
+    for ( unsigned int i = 1; i < threads_; i++ ) {
+        egress_queues_.push_back( egress_tun_.attach_queue() );
+    }
+
     /* initialize base timestamp value before any forking */
     initial_timestamp();
 }
@@ -62,7 +168,12 @@ void PacketShell<FerryQueueType>::start_uplink( const string & shell_prefix,
 
     /* Fork */
     event_loop_.add_special_child_process( 77, "packetshell", [&]() {
-            TunDevice ingress_tun( "ingress", ingress_addr(), egress_addr() );
+            TunDevice ingress_tun( "ingress", ingress_addr(), egress_addr(), offload_, threads_ > 1 );
+
+            vector<FileDescriptor> ingress_queues;
+            for ( unsigned int i = 1; i < threads_; i++ ) {
+                ingress_queues.push_back( ingress_tun.attach_queue() );
+            }
 
             /* bring up localhost */
             interface_ioctl( SIOCSIFFLAGS, "lo",
@@ -78,7 +189,7 @@ void PacketShell<FerryQueueType>::start_uplink( const string & shell_prefix,
 
             SystemCall( "ioctl SIOCADDRT", ioctl( UDPSocket().fd_num(), SIOCADDRT, &route ) );
 
-            Ferry inner_ferry { passthrough_until_signal_ };
+            Ferry inner_ferry { passthrough_until_signal_, offload_ };
 
             /* dnsmasq doesn't distinguish between UDP and TCP forwarding nameservers,
                so use a DNSProxy that listens on the same UDP and TCP port */
@@ -119,9 +230,14 @@ void PacketShell<FerryQueueType>::start_uplink( const string & shell_prefix,
 
             /* allow downlink to write directly to inner namespace's TUN device */
             pipe_.first.send_fd( ingress_tun );
-
-            FerryQueueType uplink_queue { ferry_maker() };
-            return inner_ferry.loop( uplink_queue, ingress_tun, egress_tun_ );
+            for ( auto & queue : ingress_queues ) {
+                pipe_.first.send_fd( queue );
+            }
+
+            return inner_ferry.loop( [&] () { return ferry_maker(); },
+                                     all_queues( ingress_tun, ingress_queues ),
+                                     all_queues( egress_tun_, egress_queues_ ),
+                                     lane_cpus( threads_, 0 ) );
         }, true );  /* new network namespace */
 }
 
@@ -150,12 +266,19 @@ void PacketShell<FerryQueueType>::start_downlink( Targs&&... Fargs )
             /* downlink packets go to inner namespace's TUN device */
             FileDescriptor ingress_tun = pipe_.second.recv_fd();
 
-            Ferry outer_ferry { passthrough_until_signal_ };
+            vector<FileDescriptor> ingress_queues;
+            for ( unsigned int i = 1; i < threads_; i++ ) {
+                ingress_queues.push_back( pipe_.second.recv_fd() );
+            }
+
+            Ferry outer_ferry { passthrough_until_signal_, offload_ };
 
             dns_outside_.register_handlers( outer_ferry );
 
-            FerryQueueType downlink_queue { ferry_maker() };
-            return outer_ferry.loop( downlink_queue, egress_tun_, ingress_tun );
+            return outer_ferry.loop( [&] () { return ferry_maker(); },
+                                     all_queues( egress_tun_, egress_queues_ ),
+                                     all_queues( ingress_tun, ingress_queues ),
+                                     lane_cpus( threads_, 1 ) );
         } );
 }
 
@@ -165,38 +288,141 @@ int PacketShell<FerryQueueType>::wait_for_exit( void )
     return event_loop_.loop();
 }
 
+template <class FerryQueueType>
+template <class LoopType>
+void PacketShell<FerryQueueType>::Ferry::add_ferry_actions( LoopType & loop,
+                                                           FerryQueueType & ferry_queue,
+                                                           FileDescriptor & tun,
+                                                           FileDescriptor & sibling )
+{
+    /* tun device gets datagrams -> read all that are waiting (up to the budget)
+       -> give to ferry */
+    tun.set_blocking( false );
+
+    loop.add_action( Poller::Action( tun, Direction::In,
+                                     [&] () {
+                                         for ( unsigned int i = 0; i < READ_BUDGET; i++ ) {
+                                             PacketBuffer packet( tun, large_packets_ );
+                                             if ( packet.empty() and not tun.eof() ) {
+                                                 break; /* drained */
+                                             }
+
+                                             if ( passthrough_ ) {
+                                                 packet.write_to( sibling );
+                                             } else {
+                                                 ferry_queue.read_packet( move( packet ) );
+                                             }
+
+                                             if ( tun.eof() ) {
+                                                 break;
+                                             }
+                                         }
+                                         return ResultType::Continue;
+                                     } ) );
+
+    /* ferry ready to write datagram -> send to sibling's tun device */
+    loop.add_action( Poller::Action( sibling, Direction::Out,
+                                     [&] () {
+                                         ferry_queue.write_packets( sibling );
+                                         return ResultType::Continue;
+                                     },
+                                     [&] () { return (!passthrough_) and ferry_queue.pending_output(); } ) );
+
+    /* exit if finished */
+    loop.add_action( Poller::Action( sibling, Direction::Out,
+                                     [&] () {
+                                         return Result( ResultType::Exit, 77 );
+                                     },
+                                     [&] () { return ferry_queue.finished(); } ) );
+}
+
 template <class FerryQueueType>
 int PacketShell<FerryQueueType>::Ferry::loop( FerryQueueType & ferry_queue,
                                               FileDescriptor & tun,
                                               FileDescriptor & sibling )
 {
-    /* tun device gets datagram -> read it -> give to ferry */
-    add_simple_input_handler( tun, 
-                              [&] () {
-                                  if ( passthrough_ ) {
-                                      sibling.write( tun.read() );
-                                  } else {
-                                      ferry_queue.read_packet( tun.read() );
-                                  }
-                                  return ResultType::Continue;
-                              } );
+    add_ferry_actions( *this, ferry_queue, tun, sibling );
 
-    /* ferry ready to write datagram -> send to sibling's tun device */
-    add_action( Poller::Action( sibling, Direction::Out,
-                                [&] () {
-                                    ferry_queue.write_packets( sibling );
-                                    return ResultType::Continue;
-                                },
-                                [&] () { return (!passthrough_) and ferry_queue.pending_output(); } ) );
+    /* the queue's wait_time() is in microseconds */
+    return internal_loop( [&] () { return int64_t( ferry_queue.wait_time() ); } );
+}
 
-    /* exit if finished */
-    add_action( Poller::Action( sibling, Direction::Out,
-                                [&] () {
-                                    return Result( ResultType::Exit, 77 );
-                                },
-                                [&] () { return ferry_queue.finished(); } ) );
+template <class FerryQueueType>
+void PacketShell<FerryQueueType>::Ferry::thread_loop( FerryQueueType & ferry_queue,
+                                                     FileDescriptor & tun,
+                                                     FileDescriptor & sibling,
+                                                     FileDescriptor & stop )
+{
+    Poller poller;
+
+    add_ferry_actions( poller, ferry_queue, tun, sibling );
+
+    /* the ferry is exiting */
+    poller.add_action( Poller::Action( stop, Direction::In,
+                                       [] () { return ResultType::Exit; } ) );
+
+    while ( poller.poll_usecs( ferry_queue.wait_time() ).result != Poller::Result::Type::Exit ) {}
+}
+
+template <class FerryQueueType>
+int PacketShell<FerryQueueType>::Ferry::loop( const function<FerryQueueType(void)> & make_queue,
+                                              const vector<FileDescriptor *> & tuns,
+                                              const vector<FileDescriptor *> & siblings,
+                                              const vector<int> & cpus )
+{
+    assert( not tuns.empty() and tuns.size() == siblings.size() );
+
+    if ( tuns.size() == 1 ) {
+        FerryQueueType ferry_queue { make_queue() };
+        return loop( ferry_queue, *tuns.front(), *siblings.front() );
+    }
+
+    /* This thread's queue is made first, so bad arguments fail here. Each
+       other queue is made, used and destroyed on its own ferry thread,
+       since a PacketBuffer must go back to the pool of the thread that
+       read it; make_queue need not be thread-safe, so they take turns. */
+    FerryQueueType ferry_queue { make_queue() };
+    mutex make_queue_mutex;
+
+    const bool pin = not cpus.empty();
+
+    /* a ferry thread that fails brings down the ferry */
+    FileDescriptor failed( SystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK ) ) );
+    add_simple_input_handler( failed, [] () { return Result( ResultType::Exit, EXIT_FAILURE ); } );
+
+    FerryThreads threads;
+
+    for ( size_t i = 1; i < tuns.size(); i++ ) {
+        threads.start( [&, i] () {
+                try {
+                    if ( pin ) {
+                        pin_thread( cpus.at( i ) );
+                    }
+
+                    unique_ptr<FerryQueueType> thread_queue;
+                    {
+                        lock_guard<mutex> lock( make_queue_mutex );
+                        thread_queue.reset( new FerryQueueType( make_queue() ) );
+                    }
+
+                    thread_loop( *thread_queue, *tuns.at( i ), *siblings.at( i ), threads.stop() );
+                } catch ( const exception & e ) {
+                    print_exception( e );
+
+                    /* a plain write(2): the FileDescriptor's counts aren't safe to share between threads */
+                    const uint64_t one = 1;
+                    if ( ::write( failed.fd_num(), &one, sizeof( one ) ) != sizeof( one ) ) {
+                        print_exception( unix_error( "write" ) );
+                    }
+                }
+            } );
+    }
+
+    if ( pin ) {
+        pin_thread( cpus.at( 0 ) );
+    }
 
-    return internal_loop( [&] () { return ferry_queue.wait_time(); } );
+    return loop( ferry_queue, *tuns.front(), *siblings.front() );
 }
 
 struct TemporaryEnvironment
@@ -4,6 +4,9 @@
 #define PACKETSHELL_HH
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
 
 #include "netdevice.hh"
 #include "nat.hh"
@@ -18,9 +21,12 @@ class PacketShell
 {
 private:
     char ** const user_environment_;
+    bool offload_; /* TUN devices carry GSO super-packets */
+    unsigned int threads_; /* ferry threads (and TUN queues) in each direction */
     std::pair<Address, Address> egress_ingress;
     Address nameserver_;
     TunDevice egress_tun_;
+    std::vector<FileDescriptor> egress_queues_; /* egress_tun_'s other queues */
     DNSProxy dns_outside_;
     NAT nat_rule_ {};
     bool passthrough_until_signal_ {};
@@ -32,20 +38,55 @@ private:
     const Address & egress_addr( void ) { return egress_ingress.first; }
     const Address & ingress_addr( void ) { return egress_ingress.second; }
 
+    Address get_mahimahi_base( void ) const;
+
+public:
+    /* moves packets from one TUN device through a queue to another
+       (public so it can also be driven without the shell, e.g. to benchmark it) */
     class Ferry : public EventLoop
     {
-        bool passthrough_;
+        std::atomic<bool> passthrough_; /* read by the ferry threads too */
         void handle_sigusr1() override { passthrough_ = false; }
 
+        /* datagrams may be super-packets */
+        bool large_packets_;
+
+        /* most datagrams to read from the TUN device per wakeup: enough to
+           spread a wakeup over a burst, few enough that a busy device can't
+           keep the loop from writing to the sibling for long */
+        static const unsigned int READ_BUDGET = 64;
+
     public:
-        Ferry( const bool passthrough ) : passthrough_( passthrough ) {}
+        Ferry( const bool passthrough, const bool large_packets = false )
+            : passthrough_( passthrough ), large_packets_( large_packets ) {}
         int loop( FerryQueueType & ferry_queue, FileDescriptor & tun, FileDescriptor & sibling );
-    };
 
-    Address get_mahimahi_base( void ) const;
+        /* Ferry between each pair of TUN queues (tuns[ i ] to siblings[ i ]),
+           the first in this loop and each other in a thread of its own, with
+           its own queue from make_queue. The ferry threads only move packets;
+           signals, DNS and child processes stay here. Lane i is pinned to
+           cpus[ i ], unless cpus is empty. */
+        int loop( const std::function<FerryQueueType(void)> & make_queue,
+                  const std::vector<FileDescriptor *> & tuns,
+                  const std::vector<FileDescriptor *> & siblings,
+                  const std::vector<int> & cpus = {} );
+
+    private:
+        /* move packets from tun through the queue to sibling, on the given loop
+           (this ferry, or a ferry thread's poller) */
+        template <class LoopType>
+        void add_ferry_actions( LoopType & loop, FerryQueueType & ferry_queue,
+                                FileDescriptor & tun, FileDescriptor & sibling );
+
+        void thread_loop( FerryQueueType & ferry_queue, FileDescriptor & tun, FileDescriptor & sibling,
+                          FileDescriptor & stop );
+    };
 
-public:
-    PacketShell( const std::string & device_prefix, char ** const user_environment, const bool passthrough_until_signal );
+    /* With more than one thread, each direction's queue is made once per
+       thread from the same arguments, so they must be given as lvalues
+       (not moved from). */
+    PacketShell( const std::string & device_prefix, char ** const user_environment, const bool passthrough_until_signal,
+                 const bool offload = false, const unsigned int threads = 1 );
 
     template <typename... Targs>
     void start_uplink( const std::string & shell_prefix,
@@ -2,6 +2,7 @@
 #include <chrono>
 
 #include "pie_packet_queue.hh"
+#include "tun_packet.hh"
 #include "timestamp.hh"
 
 using namespace std;
@@ -10,8 +11,8 @@ using namespace std;
 
 PIEPacketQueue::PIEPacketQueue( const string & args )
   : DroppingPacketQueue(args),
-    qdelay_ref_ ( get_arg( args, "qdelay_ref" ) ),
-    max_burst_ ( get_arg( args, "max_burst" ) ),
+    qdelay_ref_ ( arg( "qdelay_ref" ) ),
+    max_burst_ ( arg( "max_burst" ) ),
     alpha_ ( 0.125 ),
     beta_ ( 1.25 ),
     t_update_ ( 30 ),
@@ -24,7 +25,7 @@ PIEPacketQueue::PIEPacketQueue( const string & args )
     dq_tstamp_ ( 0 ),
     avg_dq_rate_ ( 0 ),
     uniform_generator_ ( 0.0, 1.0 ),
-    prng_( random_device()() ),
+    prng_( arg( "seed" ) ? arg( "seed" ) : random_device()() ),
     last_update_( timestamp() )
 {
   if ( qdelay_ref_ == 0 || max_burst_ == 0 ) {
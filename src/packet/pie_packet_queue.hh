@@ -17,10 +17,6 @@
 class PIEPacketQueue : public DroppingPacketQueue
 {
 private:
-    //This constant is copied from link_queue.hh.
-    //It maybe better to get this in a more reliable way in the future.
-    const static unsigned int PACKET_SIZE = 1504; /* default max TUN payload size */
-
     //Configurable parameters
     uint32_t qdelay_ref_, max_burst_;
 
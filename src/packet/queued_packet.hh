@@ -3,17 +3,21 @@
 #ifndef QUEUED_PACKET_HH
 #define QUEUED_PACKET_HH
 
-#include <string>
 #include <cstdint>
 
+#include "packet_buffer.hh"
+
 struct QueuedPacket
 {
-    uint64_t arrival_time;
-    std::string contents;
+    uint64_t arrival_time; /* timestamp_usecs() */
+    PacketBuffer contents;
 
-    QueuedPacket( const std::string & s_contents, uint64_t s_arrival_time )
-        : arrival_time( s_arrival_time ), contents( s_contents )
+    QueuedPacket( PacketBuffer && s_contents, uint64_t s_arrival_time )
+        : arrival_time( s_arrival_time ), contents( std::move( s_contents ) )
     {}
+
+    /* an empty slot, for queues that keep their storage */
+    QueuedPacket() : arrival_time( 0 ), contents() {}
 };
 
 #endif /* QUEUED_PACKET_HH */
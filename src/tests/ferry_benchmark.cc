@@ -0,0 +1,129 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Packets per second through Ferry::loop, with the poll(2) and epoll
+   backends of the Poller. A datagram socket pair stands in for each TUN
+   device; other threads write the packets in and read them out. Idle
+   fds (each with an action that never becomes ready) can be added to
+   show how each backend scales with the number of fds. */
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "packetshell.cc"
+#include "ring_buffer.hh"
+#include "exception.hh"
+#include "ezio.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* passes packets straight through, and finishes after a given number */
+class CountingQueue
+{
+private:
+    RingBuffer<PacketBuffer> packets_ {};
+    unsigned int remaining_;
+
+public:
+    CountingQueue( const unsigned int count ) : remaining_( count ) {}
+
+    void read_packet( PacketBuffer && contents ) { packets_.push( move( contents ) ); }
+
+    void write_packets( FileDescriptor & fd )
+    {
+        while ( not packets_.empty() ) {
+            packets_.front().write_to( fd );
+            packets_.pop();
+            remaining_--;
+        }
+    }
+
+    unsigned int wait_time( void ) const { return packets_.empty() ? 1000000 : 0; }
+
+    bool pending_output( void ) const { return not packets_.empty(); }
+
+    bool finished( void ) const { return remaining_ == 0; }
+};
+
+static pair<FileDescriptor, FileDescriptor> datagram_pair( void )
+{
+    int fds[ 2 ];
+    SystemCall( "socketpair", socketpair( AF_UNIX, SOCK_DGRAM, 0, fds ) );
+    return make_pair( FileDescriptor( fds[ 0 ] ), FileDescriptor( fds[ 1 ] ) );
+}
+
+static double packets_per_second( const Poller::Backend backend, const unsigned int packets,
+                                  const unsigned int idle_fds )
+{
+    Poller::set_default_backend( backend );
+
+    auto in = datagram_pair(), out = datagram_pair();
+
+    PacketShell<CountingQueue>::Ferry ferry { false };
+    CountingQueue queue { packets };
+
+    vector<pair<FileDescriptor, FileDescriptor>> idle;
+    idle.reserve( idle_fds ); /* the actions refer to the fds */
+    for ( unsigned int i = 0; i < idle_fds; i++ ) {
+        idle.push_back( datagram_pair() );
+        FileDescriptor & fd = idle.back().first;
+        ferry.add_action( Poller::Action( fd, Direction::In, [&fd] () { fd.read(); return ResultType::Continue; } ) );
+    }
+
+    const string packet( 1400, 'x' );
+
+    const auto start = chrono::steady_clock::now();
+
+    thread sender( [&] () {
+            for ( unsigned int i = 0; i < packets; i++ ) {
+                in.second.write( packet );
+            }
+        } );
+
+    thread receiver( [&] () {
+            for ( unsigned int i = 0; i < packets; i++ ) {
+                out.second.read();
+            }
+        } );
+
+    try { ferry.loop( queue, in.first, out.first ); } catch ( const exception & e ) { print_exception( e ); }
+
+    sender.join();
+    receiver.join();
+
+    const double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+    return packets / seconds;
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc > 3 ) {
+            cerr << "Usage: " << argv[ 0 ] << " [PACKETS [IDLE_FDS]]" << endl;
+            return EXIT_FAILURE;
+        }
+
+        /* the ferry checks that it has given up root */
+        if ( geteuid() == 0 ) {
+            throw runtime_error( "run the benchmark as an unprivileged user" );
+        }
+
+        const unsigned int packets = argc > 1 ? myatoi( argv[ 1 ] ) : 200000;
+        const unsigned int idle_fds = argc > 2 ? myatoi( argv[ 2 ] ) : 0;
+
+        cout << fixed << setprecision( 0 );
+        cout << "poll:  " << packets_per_second( Poller::Backend::Poll, packets, idle_fds ) << " packets/s" << endl;
+        cout << "epoll: " << packets_per_second( Poller::Backend::Epoll, packets, idle_fds ) << " packets/s" << endl;
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
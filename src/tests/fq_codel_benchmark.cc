@@ -0,0 +1,110 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Cost of an enqueue and a dequeue with many concurrent flows: the
+   queue holds a few packets from each of (by default) 10,000 UDP flows,
+   and each packet dequeued goes straight back in, so the backlog and
+   the mix of flows stay the same and no packets are built in the timed
+   loop. fq_codel is shown with a few bucket counts, against the single
+   FIFO disciplines. */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+
+#include "packet_queue_factory.hh"
+#include "tun_packet.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+#include "ezio.hh"
+
+using namespace std;
+
+/* a 1400-byte IPv4/UDP packet as the TUN device hands it over, from a source address and port unique to the flow */
+static PacketBuffer udp_packet( const unsigned int flow )
+{
+    string packet( TUN_PI_LENGTH + 1400, 0 );
+    packet[ 2 ] = 0x08; /* ethertype 0x0800 */
+
+    char * const ip = &packet[ TUN_PI_LENGTH ];
+    ip[ 0 ] = 0x45;
+    ip[ 9 ] = 17; /* UDP */
+    ip[ 12 ] = 10;
+    ip[ 13 ] = 0;
+    ip[ 14 ] = flow >> 8;
+    ip[ 15 ] = flow;
+    ip[ 16 ] = 10;
+    ip[ 19 ] = 1;
+
+    char * const udp = ip + 20;
+    udp[ 0 ] = ( 1024 + flow ) >> 8;
+    udp[ 1 ] = 1024 + flow;
+    udp[ 3 ] = 80;
+
+    return PacketBuffer( packet );
+}
+
+static double nanoseconds_per_pair( const string & type, const string & args,
+                                    const unsigned int flows, const unsigned int per_flow,
+                                    const unsigned int operations )
+{
+    unique_ptr<AbstractPacketQueue> queue = make_packet_queue( type, args );
+    if ( not queue ) {
+        throw runtime_error( "unknown queue type " + type );
+    }
+
+    for ( unsigned int i = 0; i < per_flow; i++ ) {
+        for ( unsigned int flow = 0; flow < flows; flow++ ) {
+            queue->enqueue( QueuedPacket( udp_packet( flow ), timestamp_usecs() ) );
+        }
+    }
+
+    const auto start = chrono::steady_clock::now();
+
+    for ( unsigned int i = 0; i < operations; i++ ) {
+        if ( queue->empty() ) {
+            throw runtime_error( type + " queue ran dry" );
+        }
+
+        QueuedPacket p = queue->dequeue();
+        p.arrival_time = timestamp_usecs();
+        queue->enqueue( move( p ) );
+    }
+
+    return chrono::duration<double, nano>( chrono::steady_clock::now() - start ).count() / operations;
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc > 2 ) {
+            cerr << "Usage: " << argv[ 0 ] << " [FLOWS]" << endl;
+            return EXIT_FAILURE;
+        }
+
+        const unsigned int flows = argc > 1 ? myatoi( argv[ 1 ] ) : 10000;
+        const unsigned int per_flow = 2, operations = 5000000;
+        const string limit = "packets=" + to_string( flows * per_flow * 2 );
+
+        const vector<pair<string, string>> queues = {
+            { "droptail", limit },
+            { "codel", limit + ",target=5,interval=100" },
+            { "fq_codel", limit + ",flows=1024,seed=1" },
+            { "fq_codel", limit + ",flows=16384,seed=1" },
+            { "fq_codel", limit + ",flows=65536,seed=1" } };
+
+        cout << flows << " flows, " << per_flow << " packets queued from each" << endl;
+        cout << fixed << setprecision( 0 );
+
+        for ( const auto & queue : queues ) {
+            cout << setw( 10 ) << queue.first << " [" << queue.second << "]: "
+                 << nanoseconds_per_pair( queue.first, queue.second, flows, per_flow, operations )
+                 << " ns per enqueue+dequeue" << endl;
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Checks the varint and zigzag encodings, that a binary mm-link log
+   turned back into text by mm-log-to-text matches the text log of the
+   same records, and that a quiet log is written without waiting for
+   its block to fill. */
+
+#include <random>
+#include <limits>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+
+#include "link_log.hh"
+#include "varint.hh"
+#include "temp_file.hh"
+#include "test.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* the standard output of a command */
+static string command_output( const string & command )
+{
+    FILE * const pipe = popen( command.c_str(), "r" );
+    if ( not pipe ) {
+        throw unix_error( "popen " + command );
+    }
+
+    string output;
+    char buffer[ 65536 ];
+    size_t bytes_read;
+    while ( ( bytes_read = fread( buffer, 1, sizeof( buffer ), pipe ) ) > 0 ) {
+        output.append( buffer, bytes_read );
+    }
+
+    if ( pclose( pipe ) != 0 ) {
+        throw runtime_error( command + ": failed" );
+    }
+
+    return output;
+}
+
+static void check_varint( const uint64_t value, const size_t length )
+{
+    string encoded;
+    encode_varint( value, encoded );
+    check( encoded.size() == length, to_string( value ) + " encodes in " + to_string( length ) + " bytes" );
+
+    size_t offset = 0;
+    uint64_t decoded;
+    check( decode_varint( encoded.data(), encoded.size(), offset, decoded )
+           and decoded == value and offset == length, to_string( value ) + " decodes" );
+
+    offset = 0;
+    check( not decode_varint( encoded.data(), encoded.size() - 1, offset, decoded ),
+           "truncated " + to_string( value ) + " is refused" );
+}
+
+static void check_varints( mt19937_64 & prng )
+{
+    check_varint( 0, 1 );
+    check_varint( 127, 1 );
+    check_varint( 128, 2 );
+    check_varint( 16383, 2 );
+    check_varint( 16384, 3 );
+    check_varint( uint64_t( 1 ) << 63, 10 );
+    check_varint( numeric_limits<uint64_t>::max(), 10 );
+
+    for ( unsigned int i = 0; i < 10000; i++ ) {
+        const uint64_t value = prng() >> ( prng() % 64 );
+        size_t length = 1;
+        for ( uint64_t rest = value >> 7; rest; rest >>= 7 ) {
+            length++;
+        }
+        check_varint( value, length );
+    }
+
+    /* more than 64 bits */
+    const string too_big = string( 9, char( 0xff ) ) + char( 0x02 );
+    size_t offset = 0;
+    uint64_t decoded;
+    check( not decode_varint( too_big.data(), too_big.size(), offset, decoded ), "a 65-bit varint is refused" );
+
+    const vector<int64_t> signed_values = { 0, 1, -1, 2, -2, numeric_limits<int64_t>::max(), numeric_limits<int64_t>::min() };
+    for ( const int64_t value : signed_values ) {
+        check( zigzag_decode( zigzag_encode( value ) ) == value, "zigzag round trip of " + to_string( value ) );
+    }
+    check( zigzag_encode( -1 ) == 1 and zigzag_encode( 1 ) == 2, "small magnitudes stay small" );
+}
+
+/* the same records as a binary and a text log, then the binary one back through mm-log-to-text */
+static void check_round_trip( const string & log_to_text, mt19937_64 & prng )
+{
+    const string header = "# mahimahi mm-link test\n# base timestamp: 0\n";
+
+    TempFile binary_file( "/tmp/link-log-test" ), text_file( "/tmp/link-log-test" );
+
+    vector<LinkLogRecord> records;
+
+    {
+        LinkLog binary( binary_file.name(), true, header ), text( text_file.name(), false, header );
+
+        /* enough to fill several blocks, with times going back a little now and then */
+        uint64_t time = 0;
+        const string types = "+-#d";
+        for ( unsigned int i = 0; i < 200000; i++ ) {
+            time = prng() % 10 == 0 ? time - min<uint64_t>( time, prng() % 500 ) : time + prng() % 20000;
+            const char type = types[ prng() % types.size() ];
+            const LinkLogRecord record { type, time, prng() % 1600, type == '-' or type == 'd' ? prng() % 100000 : 0 };
+
+            records.push_back( record );
+
+            switch ( type ) {
+            case '+': binary.arrival( record.time, record.bytes ); text.arrival( record.time, record.bytes ); break;
+            case '-': binary.departure( record.time, record.bytes, record.extra ); text.departure( record.time, record.bytes, record.extra ); break;
+            case '#': binary.opportunity( record.time, record.bytes ); text.opportunity( record.time, record.bytes ); break;
+            case 'd': binary.drop( record.time, record.bytes, record.extra ); text.drop( record.time, record.bytes, record.extra ); break;
+            }
+        }
+    }
+
+    check( BinaryLinkLog::is_binary_log( binary_file.name() ), "binary log has the magic" );
+    check( not BinaryLinkLog::is_binary_log( text_file.name() ), "text log lacks the magic" );
+
+    BinaryLinkLog log( binary_file.name() );
+    check( log.header() == header, "header survives" );
+
+    LinkLogRecord record;
+    for ( const auto & expected : records ) {
+        check( log.next( record ), "record is there" );
+        check( record.type == expected.type and record.time == expected.time
+               and record.bytes == expected.bytes and record.extra == expected.extra, "record survives" );
+    }
+    check( not log.next( record ), "no records left over" );
+
+    check( command_output( log_to_text + " " + binary_file.name() ) == read_file( text_file.name() ),
+           "mm-log-to-text gives the text log" );
+}
+
+/* a record or two shouldn't sit in a block until the log is closed */
+static void check_quiet_log( void )
+{
+    TempFile file( "/tmp/link-log-test" );
+    LinkLog log( file.name(), false, "" );
+
+    log.arrival( 1000, 1500 );
+    this_thread::sleep_for( chrono::seconds( 3 ) );
+
+    check( read_file( file.name() ) == "1 + 1500\n", "a quiet log is written while still open" );
+}
+
+int main( void )
+{
+    return run_test( "link-log-test", [] () {
+            mt19937_64 prng( 1 );
+
+            check_varints( prng );
+
+            /* "make check" builds frontend before tests */
+            check_round_trip( "../frontend/mm-log-to-text", prng );
+
+            check_quiet_log();
+        } );
+}
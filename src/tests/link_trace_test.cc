@@ -0,0 +1,208 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Packs text traces into the binary trace format and checks that both
+   give the same runs, that skip_to() agrees, that unpacking gives back
+   the original text, and that damaged traces are refused when opened. */
+
+#include <fstream>
+#include <random>
+
+#include <unistd.h>
+#include <endian.h>
+
+#include "link_trace.hh"
+#include "temp_file.hh"
+#include "varint.hh"
+#include "test.hh"
+
+using namespace std;
+
+/* a file that doesn't exist yet, removed at the end */
+class ScratchFile
+{
+private:
+    std::string name_;
+
+public:
+    ScratchFile( const string & name ) : name_( name ) {}
+    ~ScratchFile() { unlink( name_.c_str() ); }
+
+    const string & name( void ) const { return name_; }
+
+    ScratchFile( const ScratchFile & other ) = delete;
+    ScratchFile & operator=( const ScratchFile & other ) = delete;
+};
+
+/* as the binary trace header holds it */
+static string le64( const uint64_t value )
+{
+    const uint64_t le = htole64( value );
+    return string( reinterpret_cast<const char *>( &le ), sizeof( le ) );
+}
+
+/* the trace as text, one timestamp per line, as mm-trace unpack writes it */
+static string unpack( LinkTrace & trace )
+{
+    string lines;
+    do {
+        for ( uint64_t i = 0; i < trace.run_length(); i++ ) {
+            lines += to_string( trace.timestamp() ) + "\n";
+        }
+    } while ( trace.next_run() );
+    return lines;
+}
+
+static void check_same_runs( LinkTrace & text, LinkTrace & binary )
+{
+    uint64_t runs = 0;
+    while ( true ) {
+        check( text.timestamp() == binary.timestamp() and text.run_length() == binary.run_length(),
+               "run " + to_string( runs ) + " matches" );
+        runs++;
+
+        const bool text_more = text.next_run(), binary_more = binary.next_run();
+        check( text_more == binary_more, "both traces end together" );
+        if ( not text_more ) {
+            break;
+        }
+    }
+
+    check( text.opportunity_count() == binary.opportunity_count(), "opportunity counts match" );
+    check( text.period() == binary.period(), "periods match" );
+}
+
+static void check_same_skips( LinkTrace & text, LinkTrace & binary, mt19937 & prng )
+{
+    uniform_int_distribution<uint64_t> target( 0, binary.period() + 10 );
+
+    for ( unsigned int i = 0; i < 1000; i++ ) {
+        const uint64_t ms = target( prng );
+        uint64_t text_skipped = 0, binary_skipped = 0;
+        const bool text_found = text.skip_to( ms, text_skipped );
+        const bool binary_found = binary.skip_to( ms, binary_skipped );
+
+        check( text_found == binary_found and text_skipped == binary_skipped,
+               "skip_to( " + to_string( ms ) + " ) matches" );
+        check( text.timestamp() == binary.timestamp(), "skip_to( " + to_string( ms ) + " ) lands on the same run" );
+    }
+}
+
+/* pack the text trace, then compare the two */
+static void check_round_trip( const string & text_filename, mt19937 & prng )
+{
+    ScratchFile binary_file( text_filename + ".mmtrace" );
+
+    {
+        const unique_ptr<LinkTrace> text = LinkTrace::open( text_filename );
+        write_binary_trace( *text, binary_file.name() );
+    }
+
+    check( BinaryTrace::is_binary_trace( binary_file.name() ), "packed trace has the magic" );
+    check( not BinaryTrace::is_binary_trace( text_filename ), "text trace lacks the magic" );
+
+    {
+        const unique_ptr<LinkTrace> text = LinkTrace::open( text_filename );
+        const unique_ptr<LinkTrace> binary = LinkTrace::open( binary_file.name() );
+        check_same_runs( *text, *binary );
+        check_same_skips( *text, *binary, prng );
+    }
+
+    const unique_ptr<LinkTrace> binary = LinkTrace::open( binary_file.name() );
+    check( unpack( *binary ) == read_file( text_filename ), "unpacking gives back the text trace" );
+}
+
+static void check_refused( const string & contents, const string & what )
+{
+    TempFile file( "/tmp/link-trace-test" );
+    file.write( contents );
+
+    try {
+        BinaryTrace trace( file.name() );
+    } catch ( const exception & ) {
+        return;
+    }
+
+    throw runtime_error( "check failed: " + what + " is refused" );
+}
+
+/* a text trace that goes bad far past the first chunk of runs */
+static void check_text_refused( const string & bad_line, const bool rate, const string & what )
+{
+    TempFile file( "/tmp/link-trace-test" );
+    string lines;
+    for ( unsigned int i = 1; i <= 10000; i++ ) {
+        lines += ( rate ? "12" : to_string( i ) ) + "\n";
+    }
+    file.write( lines + bad_line + "\n" );
+
+    try {
+        LinkTrace::open( file.name(), rate );
+    } catch ( const exception & ) {
+        return;
+    }
+
+    throw runtime_error( "check failed: " + what + " is refused" );
+}
+
+int main( void )
+{
+    return run_test( "link-trace-test", [] () {
+            mt19937 prng( 1 );
+
+            /* more runs than a text trace reads in one chunk, some with
+               several opportunities and some far apart */
+            TempFile text( "/tmp/link-trace-test" );
+            string lines;
+            uint64_t ms = 0;
+            for ( unsigned int run = 0; run < 20000; run++ ) {
+                ms += 1 + ( run % 97 == 0 ? 100000 : prng() % 20 );
+                for ( unsigned int i = 0, n = 1 + prng() % 3; i < n; i++ ) {
+                    lines += to_string( ms ) + "\n";
+                }
+            }
+            text.write( lines );
+
+            check_round_trip( text.name(), prng );
+
+            /* a single opportunity */
+            TempFile one( "/tmp/link-trace-test" );
+            one.write( "1\n" );
+            check_round_trip( one.name(), prng );
+
+            /* a shipped trace, if the source tree is at hand */
+            const char * const srcdir = getenv( "srcdir" );
+            const string shipped = string( srcdir ? srcdir : "." ) + "/../../traces/TMobile-LTE-driving.down";
+            if ( ifstream( shipped ).good() ) {
+                check_round_trip( shipped, prng );
+            }
+
+            /* damaged binary traces */
+            ScratchFile packed( text.name() + ".mmtrace" );
+            {
+                const unique_ptr<LinkTrace> trace = LinkTrace::open( text.name() );
+                write_binary_trace( *trace, packed.name() );
+            }
+            const string good = read_file( packed.name() );
+
+            check_refused( good.substr( 0, good.size() - 1 ), "a truncated trace" );
+            check_refused( good.substr( 0, 32 ), "a trace with no runs" );
+            check_refused( "MMTRACE2" + good.substr( 8 ), "a trace with the wrong magic" );
+
+            string bad_count = good;
+            bad_count[ 8 ]++;
+            check_refused( bad_count, "a trace whose header doesn't match its runs" );
+
+            /* one run at 1 ms, too long to be a real link's, with a header to match */
+            const uint64_t too_long = BinaryTrace::MAX_RUN_LENGTH + 1;
+            string huge_run = "MMTRACE1" + le64( too_long ) + le64( 1 ) + le64( 1 );
+            encode_varint( 1, huge_run );
+            encode_varint( too_long, huge_run );
+            check_refused( huge_run, "a trace with an overlong run" );
+
+            /* damaged text traces */
+            check_text_refused( "x", false, "a text trace with a bad timestamp" );
+            check_text_refused( "5", false, "a text trace that goes back in time" );
+            check_text_refused( "", false, "a text trace with an empty line" );
+            check_text_refused( "fast", true, "a rate trace with a bad rate" );
+        } );
+}
@@ -0,0 +1,117 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Time to parse HTTP as the input grows: responses with bodies of 1 to
+   16 MB, fed in 1 kB pieces, and streams of 10,000 to 160,000 pipelined
+   requests in one buffer. The cost per byte (or per request) should
+   stay flat as the size doubles. */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+#include "http_request_parser.hh"
+#include "http_response_parser.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static double seconds_since( const chrono::steady_clock::time_point & start )
+{
+    return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+static HTTPRequest get_request( void )
+{
+    HTTPRequestParser parser;
+    parser.parse( "GET / HTTP/1.1\r\nHost: example.com\r\n\r\n" );
+    if ( parser.empty() ) {
+        throw runtime_error( "request did not parse" );
+    }
+    return parser.front();
+}
+
+static double parse_response( const size_t body_size, const size_t piece_size )
+{
+    const string headers = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+        "Content-Length: " + to_string( body_size ) + "\r\n\r\n";
+    const string piece( piece_size, 'x' );
+
+    HTTPResponseParser parser;
+    parser.new_request_arrived( get_request() );
+
+    const auto start = chrono::steady_clock::now();
+
+    parser.parse( headers );
+    for ( size_t fed = 0; fed < body_size; fed += piece_size ) {
+        parser.parse( piece.substr( 0, min( piece_size, body_size - fed ) ) );
+    }
+
+    const double elapsed = seconds_since( start );
+
+    if ( parser.empty() or parser.front().toprotobuf().body().size() != body_size ) {
+        throw runtime_error( "response did not parse" );
+    }
+
+    return elapsed;
+}
+
+static double parse_pipelined_requests( const unsigned int count )
+{
+    string request = "GET /index.html HTTP/1.1\r\nHost: example.com\r\n";
+    for ( unsigned int i = 0; i < 10; i++ ) {
+        request += "X-Header-" + to_string( i ) + ": some value for the header\r\n";
+    }
+    request += "\r\n";
+
+    string stream;
+    for ( unsigned int i = 0; i < count; i++ ) {
+        stream += request;
+    }
+
+    HTTPRequestParser parser;
+
+    const auto start = chrono::steady_clock::now();
+
+    parser.parse( stream );
+
+    unsigned int parsed = 0;
+    while ( not parser.empty() ) {
+        parser.pop();
+        parsed++;
+    }
+
+    const double elapsed = seconds_since( start );
+
+    if ( parsed != count ) {
+        throw runtime_error( "requests did not parse" );
+    }
+
+    return elapsed;
+}
+
+int main( void )
+{
+    try {
+        cout << fixed << setprecision( 2 );
+
+        cout << "response body (1 kB pieces)" << endl;
+        for ( size_t megabytes = 1; megabytes <= 16; megabytes *= 2 ) {
+            const size_t bytes = megabytes << 20;
+            const double elapsed = parse_response( bytes, 1024 );
+            cout << setw( 6 ) << megabytes << " MB: " << setw( 8 ) << elapsed * 1e3 << " ms, "
+                 << elapsed * 1e9 / bytes << " ns/byte" << endl;
+        }
+
+        cout << "pipelined requests (one buffer)" << endl;
+        for ( unsigned int count = 10000; count <= 160000; count *= 2 ) {
+            const double elapsed = parse_pipelined_requests( count );
+            cout << setw( 6 ) << count << " requests: " << setw( 8 ) << elapsed * 1e3 << " ms, "
+                 << elapsed * 1e9 / count << " ns/request" << endl;
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
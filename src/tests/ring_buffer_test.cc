@@ -0,0 +1,144 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Checks RingBuffer against std::deque: growing while the contents
+   wrap around the end of the slots, reserve(), move-only elements, and
+   that a buffer at its working size stops growing. */
+
+#include <deque>
+#include <memory>
+#include <random>
+
+#include "ring_buffer.hh"
+#include "test.hh"
+
+using namespace std;
+
+static void check_same( const RingBuffer<unsigned int> & ring, const deque<unsigned int> & model )
+{
+    check( ring.size() == model.size() and ring.empty() == model.empty(), "sizes match" );
+    check( ring.capacity() >= ring.size(), "capacity covers the size" );
+    if ( not model.empty() ) {
+        check( ring.front() == model.front() and ring.back() == model.back(), "ends match" );
+    }
+}
+
+/* drain the buffer, checking the order */
+static void check_drain( RingBuffer<unsigned int> & ring, deque<unsigned int> & model )
+{
+    while ( not model.empty() ) {
+        check( ring.pop() == model.front(), "elements come out in order" );
+        model.pop_front();
+    }
+    check( ring.empty(), "buffer is empty" );
+}
+
+static void check_wrapped_growth( void )
+{
+    RingBuffer<unsigned int> ring;
+    deque<unsigned int> model;
+    unsigned int next = 0;
+
+    check( ring.capacity() == 0, "starts with no slots" );
+
+    ring.push( next );
+    model.push_back( next++ );
+    check( ring.capacity() == 16, "first growth is to 16 slots" );
+
+    /* move the head along, so the contents wrap when the slots fill */
+    for ( unsigned int i = 0; i < 10; i++ ) {
+        ring.push( next );
+        model.push_back( next++ );
+        check( ring.pop() == model.front(), "element comes out" );
+        model.pop_front();
+    }
+
+    while ( ring.size() < ring.capacity() ) {
+        ring.push( next );
+        model.push_back( next++ );
+    }
+    check( ring.capacity() == 16, "full, but not yet grown" );
+
+    /* grow with the contents wrapped */
+    ring.push( next );
+    model.push_back( next++ );
+    check( ring.capacity() == 32, "doubles when full" );
+    check_same( ring, model );
+
+    /* wrap again, then reserve */
+    for ( unsigned int i = 0; i < 20; i++ ) {
+        ring.push( next );
+        model.push_back( next++ );
+        ring.pop();
+        model.pop_front();
+    }
+    ring.reserve( 8 );
+    check( ring.capacity() == 32, "reserving less does nothing" );
+    ring.reserve( 100 );
+    check( ring.capacity() == 100, "reserve gives the capacity asked for" );
+    check_same( ring, model );
+
+    check_drain( ring, model );
+}
+
+static void check_random( void )
+{
+    mt19937 prng( 1 );
+    RingBuffer<unsigned int> ring( 5 );
+    deque<unsigned int> model;
+    unsigned int next = 0;
+
+    /* a working size that wanders, so the buffer grows with the head anywhere */
+    for ( unsigned int i = 0; i < 1000000; i++ ) {
+        const unsigned int push_odds = ( i / 100000 ) % 2 ? 45 : 55;
+        if ( prng() % 100 < push_odds or model.empty() ) {
+            ring.push( next );
+            model.push_back( next++ );
+        } else {
+            check( ring.pop() == model.front(), "element comes out in order" );
+            model.pop_front();
+        }
+
+        if ( i % 1000 == 0 ) {
+            check_same( ring, model );
+        }
+    }
+
+    check_drain( ring, model );
+
+    /* once big enough, steady use doesn't grow it */
+    const size_t capacity = ring.capacity();
+    for ( unsigned int i = 0; i < 100000; i++ ) {
+        for ( unsigned int j = prng() % 100; j > 0; j-- ) {
+            ring.push( next );
+            model.push_back( next++ );
+        }
+        check_drain( ring, model );
+    }
+    check( ring.capacity() == capacity, "steady use doesn't grow the buffer" );
+}
+
+static void check_move_only( void )
+{
+    RingBuffer<unique_ptr<unsigned int>> ring;
+
+    for ( unsigned int round = 0; round < 3; round++ ) {
+        for ( unsigned int i = 0; i < 100; i++ ) {
+            ring.push( unique_ptr<unsigned int>( new unsigned int( i ) ) );
+        }
+        for ( unsigned int i = 0; i < 100; i++ ) {
+            const unique_ptr<unsigned int> value = ring.pop();
+            check( value and *value == i, "move-only element comes out" );
+        }
+    }
+
+    check( ring.empty(), "move-only buffer is empty" );
+}
+
+int main( void )
+{
+    return run_test( "ring-buffer-test", [] () {
+            check_wrapped_growth();
+            check_random();
+            check_move_only();
+        } );
+}
@@ -0,0 +1,50 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef TEST_HH
+#define TEST_HH
+
+/* What the unit tests share: each is a program that runs its checks,
+   prints "NAME PASSED" and exits successfully, or prints the first
+   check that failed and exits with failure. */
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "exception.hh"
+
+inline void check( const bool condition, const std::string & what )
+{
+    if ( not condition ) {
+        throw std::runtime_error( "check failed: " + what );
+    }
+}
+
+/* the whole contents of a file */
+inline std::string read_file( const std::string & filename )
+{
+    std::ifstream file( filename );
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+/* the test's exit status */
+inline int run_test( const std::string & name, const std::function<void( void )> & checks )
+{
+    try {
+        checks();
+    } catch ( const std::exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    std::cout << name << " PASSED" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+#endif /* TEST_HH */
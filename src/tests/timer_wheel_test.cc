@@ -0,0 +1,216 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* Checks TimerWheel: timers far enough out to cascade down through
+   several levels fire at their expiry and not before, timers that are
+   cancelled (or destroyed) while pending never fire, and random
+   schedules, cancels and advances agree with a simple model of which
+   timers are pending. */
+
+#include <vector>
+#include <memory>
+#include <random>
+
+#include "timer_wheel.hh"
+#include "test.hh"
+
+using namespace std;
+
+/* a timer that records when (by the wheel's time) it fired */
+class RecordingTimer
+{
+private:
+    vector<uint64_t> fired_ {};
+
+public:
+    TimerWheel::Timer timer;
+
+    RecordingTimer( TimerWheel & wheel ) : timer( [&] () { fired_.push_back( wheel.now() ); } ) {}
+
+    const vector<uint64_t> & fired( void ) const { return fired_; }
+};
+
+static void check_cascade( const uint64_t start, const uint64_t delay )
+{
+    const string what = "timer from " + to_string( start ) + " after " + to_string( delay );
+    TimerWheel wheel( start );
+    RecordingTimer t( wheel );
+
+    const uint64_t expiry = start + delay;
+    wheel.schedule( t.timer, expiry );
+
+    /* follow next_expiry() as a poller would, checking it never overshoots */
+    unsigned int wakeups = 0;
+    while ( t.fired().empty() ) {
+        const uint64_t next = wheel.next_expiry();
+        check( next <= expiry and next >= wheel.now(), what + ": next_expiry is no later than the expiry" );
+        wheel.advance( next );
+        check( t.fired().empty() or wheel.now() == expiry, what + ": fires at its expiry" );
+        check( ++wakeups <= 2 * 11, what + ": reached in a wakeup or two per level" );
+    }
+
+    check( t.fired().size() == 1 and not t.timer.pending(), what + ": fires once" );
+    check( wheel.next_expiry() == TimerWheel::NEVER, what + ": wheel is empty after" );
+}
+
+static void check_cascades( void )
+{
+    /* across one, several, and all of the levels' boundaries */
+    check_cascade( 0, 1 );
+    check_cascade( 63, 1 );
+    check_cascade( 63, 64 );
+    check_cascade( 4095, 1 );
+    check_cascade( 1000, 64 * 64 * 64 + 5 );
+    check_cascade( 12345678, uint64_t( 1 ) << 40 );
+    check_cascade( 1, TimerWheel::NEVER - 2 );
+
+    /* one big advance runs everything due, in order of expiry */
+    TimerWheel wheel( 100 );
+    vector<uint64_t> order;
+    vector<unique_ptr<TimerWheel::Timer>> timers;
+    const vector<uint64_t> expiries = { 5000000, 100 + 64, 300000, 101, 100 + 4096, 100 + 4095, 250 };
+    for ( const uint64_t expiry : expiries ) {
+        timers.emplace_back( new TimerWheel::Timer( [&order, expiry] () { order.push_back( expiry ); } ) );
+        wheel.schedule( *timers.back(), expiry );
+    }
+
+    wheel.advance( 400000 );
+    check( order == vector<uint64_t>( { 101, 100 + 64, 250, 100 + 4095, 100 + 4096, 300000 } ),
+           "timers due at one advance run in order of expiry" );
+    check( wheel.next_expiry() <= 5000000 and timers.front()->pending(), "the later timer waits" );
+
+    /* already due: runs at the next advance, not when scheduled */
+    RecordingTimer late( wheel );
+    wheel.schedule( late.timer, 10 );
+    check( late.fired().empty() and wheel.next_expiry() == wheel.now(), "a timer already due waits for advance" );
+    wheel.advance( wheel.now() );
+    check( late.fired().size() == 1, "a timer already due runs at the next advance" );
+}
+
+static void check_cancels( void )
+{
+    TimerWheel wheel( 0 );
+
+    /* cancelled before and after it has moved down a level */
+    RecordingTimer t( wheel );
+    wheel.schedule( t.timer, 64 * 64 * 64 );
+    wheel.cancel( t.timer );
+    check( not t.timer.pending() and wheel.next_expiry() == TimerWheel::NEVER, "cancel empties the wheel" );
+
+    wheel.schedule( t.timer, 64 * 64 * 64 + 64 * 64 * 5 + 7 );
+    wheel.advance( 64 * 64 * 64 + 1 );
+    check( t.fired().empty() and t.timer.pending(), "partly cascaded timer still pending" );
+    wheel.cancel( t.timer );
+    check( wheel.next_expiry() == TimerWheel::NEVER, "cancelling a cascaded timer empties the wheel" );
+    wheel.advance( 64 * 64 * 64 * 2 );
+    check( t.fired().empty(), "cancelled timer never fires" );
+
+    /* cancelling one of two in a slot leaves the other */
+    RecordingTimer a( wheel ), b( wheel );
+    wheel.schedule( a.timer, wheel.now() + 1000 );
+    wheel.schedule( b.timer, wheel.now() + 1000 );
+    wheel.cancel( a.timer );
+    wheel.cancel( a.timer ); /* a second cancel does nothing */
+    wheel.advance( wheel.now() + 1000 );
+    check( a.fired().empty() and b.fired().size() == 1, "the other timer in the slot still fires" );
+
+    /* rescheduling moves it */
+    wheel.schedule( a.timer, wheel.now() + 10 );
+    wheel.schedule( a.timer, wheel.now() + 5000 );
+    wheel.advance( wheel.now() + 10 );
+    check( a.fired().empty() and a.timer.pending(), "rescheduled timer doesn't fire at its old expiry" );
+    wheel.advance( a.timer.expiry() );
+    check( a.fired().size() == 1, "rescheduled timer fires at its new expiry" );
+
+    /* destroyed while pending */
+    {
+        RecordingTimer doomed( wheel );
+        wheel.schedule( doomed.timer, wheel.now() + 100 );
+    }
+    check( wheel.next_expiry() == TimerWheel::NEVER, "destroying a pending timer cancels it" );
+
+    /* a callback cancelling another that is due at the same advance */
+    unique_ptr<TimerWheel::Timer> second;
+    bool second_fired = false;
+    TimerWheel::Timer first( [&] () { wheel.cancel( *second ); } );
+    second.reset( new TimerWheel::Timer( [&] () { second_fired = true; } ) );
+    wheel.schedule( first, wheel.now() + 7 );
+    wheel.schedule( *second, wheel.now() + 8 );
+    wheel.advance( wheel.now() + 8 );
+    check( not second_fired and not second->pending(), "a callback can cancel a due timer" );
+}
+
+/* random operations against a model that just remembers each timer's expiry */
+static void check_model( void )
+{
+    mt19937_64 prng( 1 );
+    const unsigned int count = 500;
+
+    for ( unsigned int trial = 0; trial < 10; trial++ ) {
+        const uint64_t start = prng() % ( uint64_t( 1 ) << 40 );
+        TimerWheel wheel( start );
+
+        vector<uint64_t> expiry( count, 0 );
+        vector<bool> pending( count, false );
+        uint64_t last_fired = 0;
+
+        vector<unique_ptr<TimerWheel::Timer>> timers;
+        for ( unsigned int i = 0; i < count; i++ ) {
+            timers.emplace_back( new TimerWheel::Timer( [&, i] () {
+                        check( pending[ i ] and expiry[ i ] <= wheel.now(), "only pending timers fire, when due" );
+                        check( expiry[ i ] >= last_fired, "timers fire in order of expiry" );
+                        last_fired = expiry[ i ];
+                        pending[ i ] = false;
+                    } ) );
+        }
+
+        for ( unsigned int step = 0; step < 20000; step++ ) {
+            const unsigned int i = prng() % count;
+
+            switch ( prng() % 4 ) {
+            case 0:
+            case 1:
+                expiry[ i ] = wheel.now() + prng() % ( uint64_t( 1 ) << ( prng() % 40 ) );
+                pending[ i ] = true;
+                wheel.schedule( *timers[ i ], expiry[ i ] );
+                break;
+
+            case 2:
+                pending[ i ] = false;
+                wheel.cancel( *timers[ i ] );
+                break;
+
+            case 3:
+                uint64_t soonest = TimerWheel::NEVER;
+                for ( unsigned int j = 0; j < count; j++ ) {
+                    if ( pending[ j ] ) {
+                        soonest = min( soonest, max( expiry[ j ], wheel.now() ) );
+                    }
+                }
+
+                check( wheel.next_expiry() <= soonest, "next_expiry is never later than the soonest timer" );
+
+                /* mostly to the soonest expiry, sometimes further */
+                const uint64_t now = prng() % 3 ? ( soonest == TimerWheel::NEVER ? wheel.now() + 5 : soonest )
+                    : wheel.now() + prng() % ( uint64_t( 1 ) << ( prng() % 30 ) );
+
+                last_fired = 0;
+                wheel.advance( now );
+
+                for ( unsigned int j = 0; j < count; j++ ) {
+                    check( not pending[ j ] or expiry[ j ] > now, "no timer due is missed" );
+                    check( pending[ j ] == timers[ j ]->pending(), "pending() agrees with the model" );
+                }
+                break;
+            }
+        }
+    }
+}
+
+int main( void )
+{
+    return run_test( "timer-wheel-test", [] () {
+            check_cascades();
+            check_cancels();
+            check_model();
+        } );
+}
@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <functional>
+#include <cstdint>
 
 #include "poller.hh"
 #include "file_descriptor.hh"
@@ -21,9 +22,8 @@ private:
     PollerShortNames::Result handle_signal( const signalfd_siginfo & sig );
 
 protected:
-    void add_action( Poller::Action action ) { poller_.add_action( action ); }
-
-    int internal_loop( const std::function<int(void)> & wait_time );
+    /* wait_time gives the longest to wait for events, in microseconds (-1 for no limit) */
+    int internal_loop( const std::function<int64_t(void)> & wait_time );
 
     virtual void handle_sigusr1() {}
 
@@ -32,6 +32,8 @@ public:
 
     void add_simple_input_handler( FileDescriptor & fd, const Poller::Action::CallbackType & callback );
 
+    void add_action( Poller::Action action ) { poller_.add_action( action ); }
+
     template <typename... Targs>
     void add_child_process( Targs&&... Fargs )
     {
@@ -47,7 +49,7 @@ public:
         child_processes_.emplace_back( continue_status, ChildProcess( std::forward<Targs>( Fargs )... ) );
     }
 
-    int loop( void ) { return internal_loop( [] () { return -1; } ); } /* no timeout */
+    int loop( void ) { return internal_loop( [] () { return int64_t( -1 ); } ); } /* no timeout */
 
     virtual ~EventLoop() {}
 };
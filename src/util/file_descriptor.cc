@@ -93,3 +93,53 @@ string::const_iterator FileDescriptor::write( const std::string & buffer, const
 
     return it;
 }
+
+/* read into caller-supplied memory */
+size_t FileDescriptor::read_into( char * const buffer, const size_t capacity )
+{
+    const ssize_t ret = ::read( fd_, buffer, capacity );
+    if ( ret < 0 and (errno == EAGAIN or errno == EWOULDBLOCK) ) {
+        register_read();
+        return 0; /* non-blocking, and nothing to read */
+    }
+
+    ssize_t bytes_read = SystemCall( "read", ret );
+    if ( bytes_read == 0 ) {
+        set_eof();
+    }
+
+    register_read();
+
+    return bytes_read;
+}
+
+/* write all of caller-supplied memory */
+void FileDescriptor::write_from( const char * const buffer, const size_t length )
+{
+    if ( length == 0 ) {
+        throw runtime_error( "nothing to write" );
+    }
+
+    size_t bytes_written = 0;
+    while ( bytes_written < length ) {
+        const ssize_t ret = SystemCall( "write", ::write( fd_, buffer + bytes_written, length - bytes_written ) );
+        if ( ret == 0 ) {
+            throw runtime_error( "write returned 0" );
+        }
+        bytes_written += ret;
+    }
+
+    register_write();
+}
+
+void FileDescriptor::set_blocking( const bool block )
+{
+    int flags = SystemCall( "fcntl F_GETFL", fcntl( fd_, F_GETFL ) );
+    if ( block ) {
+        flags = flags & ~O_NONBLOCK;
+    } else {
+        flags = flags | O_NONBLOCK;
+    }
+
+    SystemCall( "fcntl F_SETFL", fcntl( fd_, F_SETFL, flags ) );
+}
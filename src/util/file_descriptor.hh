@@ -38,12 +38,20 @@ public:
     unsigned int read_count( void ) const { return read_count_; }
     unsigned int write_count( void ) const { return write_count_; }
 
+    /* set or clear O_NONBLOCK */
+    void set_blocking( const bool block );
+
     /* read and write methods */
     std::string read( const size_t limit = BUFFER_SIZE );
     std::string::const_iterator write( const std::string & buffer, const bool write_all = true );
     std::string::const_iterator write( const std::string::const_iterator & begin,
                                        const std::string::const_iterator & end );
 
+    /* read into, or write all of, caller-supplied memory (e.g., a packet buffer).
+       On a non-blocking fd with nothing to read, read_into() returns 0 without EOF. */
+    size_t read_into( char * const buffer, const size_t capacity );
+    void write_from( const char * const buffer, const size_t length );
+
     /* forbid copying FileDescriptor objects or assigning them */
     FileDescriptor( const FileDescriptor & other ) = delete;
     const FileDescriptor & operator=( const FileDescriptor & other ) = delete;
@@ -0,0 +1,47 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include "mapped_file.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static size_t file_size( const FileDescriptor & fd )
+{
+    struct stat file_info;
+    SystemCall( "fstat", fstat( fd.fd_num(), &file_info ) );
+    return file_info.st_size;
+}
+
+MappedFile::MappedFile( const string & filename )
+    : fd_( SystemCall( "open " + filename, open( filename.c_str(), O_RDONLY ) ) ),
+      size_( file_size( fd_ ) ),
+      data_( nullptr )
+{
+    /* mmap refuses zero-length mappings */
+    if ( size_ == 0 ) {
+        return;
+    }
+
+    void * const region = mmap( nullptr, size_, PROT_READ, MAP_SHARED, fd_.fd_num(), 0 );
+    if ( region == MAP_FAILED ) {
+        throw unix_error( "mmap " + filename );
+    }
+
+    data_ = static_cast<const char *>( region );
+}
+
+MappedFile::~MappedFile()
+{
+    if ( data_ ) {
+        try {
+            SystemCall( "munmap", munmap( const_cast<char *>( data_ ), size_ ) );
+        } catch ( const exception & e ) {
+            print_exception( e );
+        }
+    }
+}
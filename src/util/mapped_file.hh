@@ -0,0 +1,31 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef MAPPED_FILE_HH
+#define MAPPED_FILE_HH
+
+#include <string>
+
+#include "file_descriptor.hh"
+
+/* read-only memory mapping of an entire file, unmapped when object destroyed */
+class MappedFile
+{
+private:
+    FileDescriptor fd_;
+    size_t size_;
+    const char * data_;
+
+public:
+    MappedFile( const std::string & filename );
+    ~MappedFile();
+
+    /* accessors */
+    const char * data( void ) const { return data_; }
+    size_t size( void ) const { return size_; }
+
+    /* forbid copying or assigning */
+    MappedFile( const MappedFile & other ) = delete;
+    MappedFile & operator=( const MappedFile & other ) = delete;
+};
+
+#endif /* MAPPED_FILE_HH */
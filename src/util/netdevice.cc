@@ -14,21 +14,49 @@
 #include "socket.hh"
 #include "util.hh"
 #include "system_runner.hh"
+#include "tun_packet.hh"
 #include "config.h"
 
 using namespace std;
 
 TunDevice::TunDevice( const string & name,
                       const Address & addr,
-                      const Address & peer )
-    : FileDescriptor( SystemCall( "open /dev/net/tun", open( "/dev/net/tun", O_RDWR ) ) )
+                      const Address & peer,
+                      const bool offload,
+                      const bool multi_queue )
+    : FileDescriptor( SystemCall( "open /dev/net/tun", open( "/dev/net/tun", O_RDWR ) ) ),
+      name_( name ),
+      flags_( IFF_TUN | ( offload ? IFF_VNET_HDR : 0 ) | ( multi_queue ? IFF_MULTI_QUEUE : 0 ) )
 {
     interface_ioctl( *this, TUNSETIFF, name,
-                     [] ( ifreq &ifr ) { ifr.ifr_flags = IFF_TUN; } );
+                     [&] ( ifreq &ifr ) { ifr.ifr_flags = flags_; } );
+
+    if ( offload ) {
+        int vnet_hdr_size = TUN_VNET_HDR_LENGTH;
+        SystemCall( "ioctl TUNSETVNETHDRSZ", ioctl( fd_num(), TUNSETVNETHDRSZ, &vnet_hdr_size ) );
+        /* TSO only: the kernel has ignored TUN_F_UFO since 4.14, and the
+           UDP segmentation flags that replaced it are refused by older kernels */
+        SystemCall( "ioctl TUNSETOFFLOAD", ioctl( fd_num(), TUNSETOFFLOAD,
+                                                   TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN ) );
+    }
 
     assign_address( name, addr, peer );
 }
 
+FileDescriptor TunDevice::attach_queue( void )
+{
+    if ( not ( flags_ & IFF_MULTI_QUEUE ) ) {
+        throw runtime_error( name_ + ": not a multi-queue TUN device" );
+    }
+
+    /* the vnet header size and offloads belong to the device, not the queue */
+    FileDescriptor queue( SystemCall( "open /dev/net/tun", open( "/dev/net/tun", O_RDWR ) ) );
+    interface_ioctl( queue, TUNSETIFF, name_,
+                     [&] ( ifreq &ifr ) { ifr.ifr_flags = flags_; } );
+
+    return queue;
+}
+
 void interface_ioctl( FileDescriptor & fd, const unsigned long request,
                       const string & name,
                       function<void( ifreq &ifr )> ifr_adjustment)
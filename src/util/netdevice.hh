@@ -25,8 +25,25 @@ void assign_address( const std::string & device_name, const Address & addr, cons
 
 class TunDevice : public FileDescriptor
 {
+private:
+    std::string name_;
+    short flags_;
+
 public:
-    TunDevice( const std::string & name, const Address & addr, const Address & peer );
+    /* most queues a multi-queue device can have (the kernel's MAX_TAP_QUEUES) */
+    static const unsigned int MAX_QUEUES = 256;
+
+    /* With offload, the device takes checksum and TCP segmentation offloads,
+       so the kernel hands over (and accepts) GSO super-packets of up to 64 KiB,
+       each with a virtio-net header after the packet information.
+       A multi-queue device can have more queues attached. */
+    TunDevice( const std::string & name, const Address & addr, const Address & peer,
+               const bool offload = false, const bool multi_queue = false );
+
+    /* another queue of a multi-queue device; the kernel spreads outgoing
+       packets across the queues by flow (must be called in the device's
+       network namespace, with CAP_NET_ADMIN) */
+    FileDescriptor attach_queue( void );
 };
 
 class VirtualEthernetPair
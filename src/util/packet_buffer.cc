@@ -0,0 +1,107 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+
+#include "packet_buffer.hh"
+
+using namespace std;
+
+/* free slots, handed out most recently used first */
+template <size_t SLOT_SIZE, size_t SLOTS_PER_SLAB>
+class PacketPool
+{
+private:
+    vector< unique_ptr< char[] > > slabs_ {};
+    vector< char * > free_slots_ {};
+
+    void grow( void )
+    {
+        slabs_.emplace_back( new char[ SLOTS_PER_SLAB * SLOT_SIZE ] );
+        free_slots_.reserve( slabs_.size() * SLOTS_PER_SLAB );
+
+        for ( size_t i = 0; i < SLOTS_PER_SLAB; i++ ) {
+            free_slots_.push_back( slabs_.back().get() + i * SLOT_SIZE );
+        }
+    }
+
+public:
+    char * get( void )
+    {
+        if ( free_slots_.empty() ) {
+            grow();
+        }
+
+        char * const ret = free_slots_.back();
+        free_slots_.pop_back();
+        return ret;
+    }
+
+    void put( char * const slot ) { free_slots_.push_back( slot ); }
+
+    static PacketPool & local( void )
+    {
+        static thread_local PacketPool pool;
+        return pool;
+    }
+};
+
+typedef PacketPool< PacketBuffer::CAPACITY, 256 > SmallPool;
+typedef PacketPool< PacketBuffer::LARGE_CAPACITY, 16 > LargePool;
+
+PacketBuffer::PacketBuffer( FileDescriptor & fd, const bool large )
+    : data_( large ? LargePool::local().get() : SmallPool::local().get() ),
+      size_( 0 ),
+      large_( large )
+{
+    const size_t capacity = large ? LARGE_CAPACITY : CAPACITY;
+
+    try {
+        size_ = fd.read_into( data_, capacity );
+    } catch ( ... ) {
+        release();
+        throw;
+    }
+
+    if ( size_ == capacity ) {
+        release();
+        throw runtime_error( "PacketBuffer: datagram may have been truncated" );
+    }
+
+    /* keep large slots for the packets that need them */
+    if ( large and size_ < CAPACITY ) {
+        char * const small = SmallPool::local().get();
+        memcpy( small, data_, size_ );
+        LargePool::local().put( data_ );
+        data_ = small;
+        large_ = false;
+    }
+}
+
+PacketBuffer::PacketBuffer( const string & contents )
+    : data_( nullptr ),
+      size_( contents.size() ),
+      large_( contents.size() > CAPACITY )
+{
+    if ( size_ > LARGE_CAPACITY ) {
+        throw runtime_error( "PacketBuffer: contents too large" );
+    }
+
+    data_ = large_ ? LargePool::local().get() : SmallPool::local().get();
+    contents.copy( data_, size_ );
+}
+
+void PacketBuffer::release( void )
+{
+    if ( data_ ) {
+        if ( large_ ) {
+            LargePool::local().put( data_ );
+        } else {
+            SmallPool::local().put( data_ );
+        }
+        data_ = nullptr;
+    }
+    size_ = 0;
+}
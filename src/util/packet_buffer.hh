@@ -0,0 +1,85 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PACKET_BUFFER_HH
+#define PACKET_BUFFER_HH
+
+#include <string>
+
+#include "file_descriptor.hh"
+
+/* one datagram, held in a fixed-size slot from a per-thread pool.
+   Slots are allocated in slabs and recycled when the buffer is destroyed,
+   so a packet can be read, queued, and written with no heap allocation.
+   A buffer must be destroyed on the thread that created it. */
+class PacketBuffer
+{
+public:
+    /* room for any TUN datagram (1500-byte MTU plus packet information) */
+    static const size_t CAPACITY = 2048;
+
+    /* room for a GSO super-packet from a TUN device with offloads
+       (64 KiB of IP, plus packet information and virtio-net header) */
+    static const size_t LARGE_CAPACITY = 65536 + 64;
+
+private:
+    char * data_;
+    size_t size_;
+    bool large_; /* slot is from the large pool */
+
+    void release( void );
+
+public:
+    /* empty, without a slot */
+    PacketBuffer() : data_( nullptr ), size_( 0 ), large_( false ) {}
+
+    /* read one datagram from fd (empty on EOF, or if a non-blocking fd has none).
+       With large, the datagram may be up to LARGE_CAPACITY; one that turns
+       out to fit in an ordinary slot is moved to one. */
+    explicit PacketBuffer( FileDescriptor & fd, const bool large = false );
+
+    /* copy of the given bytes */
+    explicit PacketBuffer( const std::string & contents );
+
+    /* (inline, and a moved-from buffer skips the pool, as queues move packets a lot) */
+    ~PacketBuffer() { if ( data_ ) { release(); } }
+
+    /* move constructor and assignment */
+    PacketBuffer( PacketBuffer && other )
+        : data_( other.data_ ), size_( other.size_ ), large_( other.large_ )
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    PacketBuffer & operator=( PacketBuffer && other )
+    {
+        if ( this != &other ) {
+            if ( data_ ) {
+                release();
+            }
+            data_ = other.data_;
+            size_ = other.size_;
+            large_ = other.large_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        return *this;
+    }
+
+    /* accessors */
+    const char * data( void ) const { return data_; }
+    size_t size( void ) const { return size_; }
+    bool empty( void ) const { return size_ == 0; }
+
+    /* write the whole datagram to fd */
+    void write_to( FileDescriptor & fd ) const { fd.write_from( data_, size_ ); }
+
+    std::string str( void ) const { return std::string( data_, size_ ); }
+
+    /* forbid copying or assigning */
+    PacketBuffer( const PacketBuffer & other ) = delete;
+    PacketBuffer & operator=( const PacketBuffer & other ) = delete;
+};
+
+#endif /* PACKET_BUFFER_HH */
@@ -2,16 +2,51 @@
 
 #include <algorithm>
 #include <numeric>
+#include <limits>
+#include <cerrno>
+
+#include <sys/timerfd.h>
+
 #include "poller.hh"
 #include "exception.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
+/* the poll(2) backend reports its events as epoll would */
+static_assert( POLLIN == EPOLLIN and POLLOUT == EPOLLOUT and POLLERR == EPOLLERR and POLLHUP == EPOLLHUP,
+               "poll and epoll event bits differ" );
+
+static Poller::Backend default_backend_ = Poller::Backend::Epoll;
+
+void Poller::set_default_backend( const Backend backend )
+{
+    default_backend_ = backend;
+}
+
+Poller::Backend Poller::default_backend( void )
+{
+    return default_backend_;
+}
+
 void Poller::add_action( Poller::Action action )
 {
-    actions_.push_back( action );
-    pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
+    new_actions_.push_back( action );
+}
+
+void Poller::cancel_all( const int fd_num )
+{
+    for ( auto & action : actions_ ) {
+        if ( action.fd.fd_num() == fd_num ) {
+            action.active = false;
+        }
+    }
+
+    for ( auto & action : new_actions_ ) {
+        if ( action.fd.fd_num() == fd_num ) {
+            action.active = false;
+        }
+    }
 }
 
 unsigned int Poller::Action::service_count( void ) const
@@ -19,57 +54,271 @@ unsigned int Poller::Action::service_count( void ) const
     return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
-Poller::Result Poller::poll( const int & timeout_ms )
+void Poller::update_registration( const int fd_num, const uint32_t events )
 {
-    assert( pollfds_.size() == actions_.size() );
-
-    /* tell poll whether we care about each fd */
-    for ( unsigned int i = 0; i < actions_.size(); i++ ) {
-        assert( pollfds_.at( i ).fd == actions_.at( i ).fd.fd_num() );
-        pollfds_.at( i ).events = (actions_.at( i ).active and actions_.at( i ).when_interested())
-            ? actions_.at( i ).direction : 0;
-
-        /* don't poll in on fds that have had EOF */
-        if ( actions_.at( i ).direction == Direction::In
-             and actions_.at( i ).fd.eof() ) {
-            pollfds_.at( i ).events = 0;
+    epoll_event event;
+    event.events = events;
+    event.data.fd = fd_num;
+
+    const auto existing = registered_.find( fd_num );
+    if ( existing == registered_.end() ) {
+        if ( epoll_ctl( epoll_->fd_num(), EPOLL_CTL_ADD, fd_num, &event ) < 0 ) {
+            /* e.g., an fd number that was closed and reused before we noticed */
+            SystemCall( "epoll_ctl EPOLL_CTL_MOD", epoll_ctl( epoll_->fd_num(), EPOLL_CTL_MOD, fd_num, &event ) );
         }
+    } else if ( existing->second != events ) {
+        if ( epoll_ctl( epoll_->fd_num(), EPOLL_CTL_MOD, fd_num, &event ) < 0 ) {
+            /* closing an fd takes it out of the epoll set */
+            SystemCall( "epoll_ctl EPOLL_CTL_ADD", epoll_ctl( epoll_->fd_num(), EPOLL_CTL_ADD, fd_num, &event ) );
+        }
+    } else {
+        return;
     }
 
-    /* Quit if no member in pollfds_ has a non-zero direction */
-    if ( not accumulate( pollfds_.begin(), pollfds_.end(), false,
-                         [] ( bool acc, pollfd x ) { return acc or x.events; } ) ) {
+    registered_[ fd_num ] = events;
+}
+
+/* drop cancelled actions (and with them, anything their callbacks own)
+   and pick up new ones */
+void Poller::rebuild( void )
+{
+    vector< Action > live_actions;
+    for ( const auto & list : { &actions_, &new_actions_ } ) {
+        for ( const auto & action : *list ) {
+            if ( action.active ) {
+                live_actions.push_back( action );
+            }
+        }
+    }
+
+    fd_actions_.clear();
+    for ( size_t i = 0; i < live_actions.size(); i++ ) {
+        fd_actions_[ live_actions[ i ].fd.fd_num() ].push_back( i );
+    }
+
+    /* an fd number with new actions may have been closed and reused
+       since it was registered, so register it afresh */
+    for ( const auto & action : new_actions_ ) {
+        if ( action.active and registered_.count( action.fd.fd_num() ) ) {
+            epoll_ctl( epoll_->fd_num(), EPOLL_CTL_DEL, action.fd.fd_num(), nullptr );
+            registered_.erase( action.fd.fd_num() );
+        }
+    }
+
+    /* unregister fds that no longer have actions, while they are still open */
+    for ( auto it = registered_.begin(); it != registered_.end(); ) {
+        if ( fd_actions_.count( it->first ) ) {
+            ++it;
+        } else {
+            /* fails harmlessly if the fd has already been closed */
+            epoll_ctl( epoll_->fd_num(), EPOLL_CTL_DEL, it->first, nullptr );
+            it = registered_.erase( it );
+        }
+    }
+
+    /* Action holds a reference, so it can be copied but not assigned */
+    actions_.swap( live_actions );
+    new_actions_.clear();
+
+    interest_.resize( actions_.size() );
+    events_.resize( fd_actions_.size() + 1 ); /* room for the timer */
+}
+
+bool Poller::dispatch( const size_t index, const uint32_t revents, Action::Result & exit_result )
+{
+    Action & action = actions_.at( index );
+
+    if ( revents & (EPOLLERR | EPOLLHUP) ) {
+        auto result = action.fderror_callback();
+
+        switch ( result.result ) {
+        case ResultType::Exit:
+            exit_result = result;
+            return false;
+        case ResultType::Cancel:
+            action.active = false;
+            break;
+        case ResultType::CancelAll:
+            cancel_all( action.fd.fd_num() );
+            break;
+        case ResultType::Continue:
+            break;
+        }
+
+        return true;
+    }
+
+    /* we only want to call callback if revents includes
+       the event we asked for */
+    if ( not (revents & interest_.at( index )) ) {
+        return true;
+    }
+
+    const int fd_num = action.fd.fd_num();
+    const auto count_before = action.service_count();
+    auto result = action.callback();
+
+    switch ( result.result ) {
+    case ResultType::Exit:
+        exit_result = result;
+        return false;
+    case ResultType::Cancel:
+        action.active = false;
+        break;
+    case ResultType::CancelAll:
+        /* the fd is going away, so it can't be busy-waited on */
+        cancel_all( fd_num );
+        return true;
+    case ResultType::Continue:
+        break;
+    }
+
+    if ( count_before == action.service_count() ) {
+        throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+    }
+
+    return true;
+}
+
+int Poller::wait_poll( const int64_t timeout_us )
+{
+    timespec timeout;
+    timeout.tv_sec = timeout_us / 1000000;
+    timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+
+    const int ready = ppoll( &pollfds_[ 0 ], pollfds_.size(), timeout_us < 0 ? nullptr : &timeout, nullptr );
+
+    if ( ready < 0 and errno == EINTR ) {
+        return 0;
+    }
+
+    SystemCall( "ppoll", ready );
+
+    int count = 0;
+    for ( const auto & x : pollfds_ ) {
+        if ( x.revents ) {
+            events_.at( count ).events = (x.revents & POLLNVAL) ? uint32_t( EPOLLERR ) : uint32_t( x.revents );
+            events_.at( count ).data.fd = x.fd;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+int Poller::wait( const int64_t timeout_us )
+{
+    if ( backend_ == Backend::Poll ) {
+        return wait_poll( timeout_us );
+    }
+
+    /* epoll_wait's timeout is in milliseconds, so finer waits use the timer */
+    const bool use_timer = timeout_us > 0 and timeout_us % 1000;
+
+    if ( use_timer or timer_armed_ ) {
+        itimerspec its {};
+        if ( use_timer ) {
+            its.it_value.tv_sec = timeout_us / 1000000;
+            its.it_value.tv_nsec = (timeout_us % 1000000) * 1000;
+        }
+        SystemCall( "timerfd_settime", timerfd_settime( timer_->fd_num(), 0, &its, nullptr ) );
+        timer_armed_ = use_timer;
+    }
+
+    const int timeout_ms = (timeout_us < 0 or use_timer) ? -1
+        : min( timeout_us / 1000, int64_t( numeric_limits<int>::max() ) );
+
+    const int ready = epoll_wait( epoll_->fd_num(), &events_[ 0 ], events_.size(), timeout_ms );
+
+    /* signals are normally blocked, but a thread can still be interrupted
+       (e.g., glibc signals every thread when another changes its euid) */
+    if ( ready < 0 and errno == EINTR ) {
+        return 0;
+    }
+
+    return SystemCall( "epoll_wait", ready );
+}
+
+Poller::Result Poller::poll_usecs( const int64_t timeout_us )
+{
+    if ( backend_ == Backend::Epoll and not epoll_ ) {
+        epoll_.reset( new FileDescriptor( SystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ) ) );
+
+        timer_.reset( new FileDescriptor( SystemCall( "timerfd_create",
+                                                      timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) ) );
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = timer_->fd_num();
+        SystemCall( "epoll_ctl EPOLL_CTL_ADD", epoll_ctl( epoll_->fd_num(), EPOLL_CTL_ADD, timer_->fd_num(), &event ) );
+    }
+
+    if ( not new_actions_.empty()
+         or any_of( actions_.begin(), actions_.end(), [] ( const Action & x ) { return not x.active; } ) ) {
+        rebuild();
+    }
+
+    /* ask each action whether it cares about its fd, and tell epoll
+       about any fd whose combined interest has changed */
+    bool any_interest = false;
+    pollfds_.clear();
+    for ( const auto & fd_and_actions : fd_actions_ ) {
+        uint32_t events = 0;
+
+        for ( const size_t i : fd_and_actions.second ) {
+            const Action & action = actions_.at( i );
+            interest_.at( i ) = (action.active and action.when_interested()) ? action.direction : 0;
+
+            /* don't poll in on fds that have had EOF */
+            if ( action.direction == Direction::In and action.fd.eof() ) {
+                interest_.at( i ) = 0;
+            }
+
+            events |= interest_.at( i );
+        }
+
+        any_interest |= (events != 0);
+
+        if ( backend_ == Backend::Poll ) {
+            pollfds_.push_back( { fd_and_actions.first, short( events ), 0 } );
+        } else {
+            update_registration( fd_and_actions.first, events );
+        }
+    }
+
+    /* Quit if no action is interested in its fd */
+    if ( not any_interest ) {
         return Result::Type::Exit;
     }
 
-    if ( 0 == SystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) ) ) {
+    const int ready = wait( timeout_us );
+    if ( ready == 0 ) {
         return Result::Type::Timeout;
     }
 
-    for ( unsigned int i = 0; i < pollfds_.size(); i++ ) {
-        if ( pollfds_[ i ].revents & (POLLERR | POLLHUP | POLLNVAL) ) {
-            //            throw Exception( "poll fd error" );
-            return Result::Type::Exit;
+    for ( int i = 0; i < ready; i++ ) {
+        if ( timer_ and events_[ i ].data.fd == timer_->fd_num() ) {
+            timer_->read();
+            timer_armed_ = false;
+            if ( ready == 1 ) {
+                return Result::Type::Timeout;
+            }
+            continue;
+        }
+
+        const auto fd_and_actions = fd_actions_.find( events_[ i ].data.fd );
+        if ( fd_and_actions == fd_actions_.end() ) {
+            continue;
         }
 
-        if ( pollfds_[ i ].revents & pollfds_[ i ].events ) {
-            /* we only want to call callback if revents includes
-               the event we asked for */
-            const auto count_before = actions_.at( i ).service_count();
-            auto result = actions_.at( i ).callback();
-
-            switch ( result.result ) {
-            case ResultType::Exit:
-                return Result( Result::Type::Exit, result.exit_status );
-            case ResultType::Cancel:
-                actions_.at( i ).active = false;
-                break;
-            case ResultType::Continue:
-                break;
+        for ( const size_t index : fd_and_actions->second ) {
+            /* may have been cancelled by an earlier callback in this round */
+            if ( not actions_.at( index ).active ) {
+                continue;
             }
 
-            if ( count_before == actions_.at( i ).service_count() ) {
-                throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+            Action::Result exit_result;
+            if ( not dispatch( index, events_[ i ].events, exit_result ) ) {
+                return Result( Result::Type::Exit, exit_result.exit_status );
             }
         }
     }
@@ -5,20 +5,36 @@
 
 #include <functional>
 #include <vector>
+#include <memory>
+#include <unordered_map>
 #include <cassert>
 
+#include <sys/epoll.h>
 #include <poll.h>
 
 #include "file_descriptor.hh"
 
+/* runs the callback of each Action whose fd is ready, using level-triggered
+   epoll. Interest is still decided by when_interested() before each poll,
+   but the kernel is only told when an fd's interest changes. (The older
+   poll(2) backend, which hands every fd to the kernel on each poll, can
+   still be chosen, e.g. to compare the two.) */
 class Poller
 {
 public:
+    enum class Backend { Epoll, Poll };
+
+    /* the backend of Pollers made from now on (set it before starting any threads) */
+    static void set_default_backend( const Backend backend );
+    static Backend default_backend( void );
+
     struct Action
     {
         struct Result
         {
-            enum class Type { Continue, Exit, Cancel } result;
+            /* Cancel stops this action; CancelAll stops every action on the same fd
+               (e.g., a connection that is finished) */
+            enum class Type { Continue, Exit, Cancel, CancelAll } result;
             unsigned int exit_status;
             Result( const Type & s_result = Type::Continue, const unsigned int & s_status = EXIT_SUCCESS )
                 : result( s_result ), exit_status( s_status ) {}
@@ -27,25 +43,68 @@ public:
         typedef std::function<Result(void)> CallbackType;
 
         FileDescriptor & fd;
-        enum PollDirection : short { In = POLLIN, Out = POLLOUT } direction;
+        enum PollDirection : short { In = EPOLLIN, Out = EPOLLOUT } direction;
         CallbackType callback;
         std::function<bool(void)> when_interested;
+
+        /* called instead of callback when poll reports an error or hangup on the fd */
+        CallbackType fderror_callback;
         bool active;
 
         Action( FileDescriptor & s_fd,
                 const PollDirection & s_direction,
                 const CallbackType & s_callback,
-                const std::function<bool(void)> & s_when_interested = [] () { return true; } )
+                const std::function<bool(void)> & s_when_interested = [] () { return true; },
+                const CallbackType & s_fderror_callback = [] () { return Result::Type::Exit; } )
             : fd( s_fd ), direction( s_direction ), callback( s_callback ),
-              when_interested( s_when_interested ), active( true ) {}
+              when_interested( s_when_interested ), fderror_callback( s_fderror_callback ),
+              active( true ) {}
 
         unsigned int service_count( void ) const;
     };
 
 private:
+    Backend backend_;
+
     std::vector< Action > actions_;
+
+    /* added since the last poll (callbacks may add actions while actions_ is being walked) */
+    std::vector< Action > new_actions_;
+
+    /* epoll instance, created at the first poll (so a Poller made
+       before a fork isn't shared with the child) */
+    std::unique_ptr< FileDescriptor > epoll_;
+
+    /* events each fd is registered for; fds stay registered (possibly
+       for no events, to hear about errors) as long as they have actions */
+    std::unordered_map< int, uint32_t > registered_;
+
+    /* the actions on each fd, as indices into actions_ */
+    std::unordered_map< int, std::vector< size_t > > fd_actions_;
+
+    /* the direction each action was polled for in this round (or 0) */
+    std::vector< short > interest_;
+
+    std::vector< epoll_event > events_;
+
+    /* for waits that aren't a whole number of milliseconds */
+    std::unique_ptr< FileDescriptor > timer_;
+    bool timer_armed_;
+
+    /* with the poll(2) backend, every fd and its events, for this round */
     std::vector< pollfd > pollfds_;
 
+    /* wait for events, or until timeout_us (-1 means no timeout); the
+       ready fds are left in events_ */
+    int wait( const int64_t timeout_us );
+    int wait_poll( const int64_t timeout_us );
+
+    void rebuild( void );
+    void update_registration( const int fd_num, const uint32_t events );
+
+    /* run the callback (or the error callback) of an action that is ready */
+    bool dispatch( const size_t index, const uint32_t revents, Action::Result & exit_result );
+
 public:
     struct Result
     {
@@ -55,9 +114,16 @@ public:
             : result( s_result ), exit_status( s_status ) {}
     };
 
-    Poller() : actions_(), pollfds_() {}
+    Poller( const Backend backend = default_backend() )
+        : backend_( backend ), actions_(), new_actions_(), epoll_(), registered_(), fd_actions_(), interest_(),
+          events_(), timer_(), timer_armed_( false ), pollfds_() {}
     void add_action( Action action );
-    Result poll( const int & timeout_ms );
+
+    /* stop every action on the fd (e.g., the other half of a finished connection) */
+    void cancel_all( const int fd_num );
+
+    Result poll( const int & timeout_ms ) { return poll_usecs( timeout_ms < 0 ? -1 : int64_t( timeout_ms ) * 1000 ); }
+    Result poll_usecs( const int64_t timeout_us );
 };
 
 namespace PollerShortNames {
@@ -0,0 +1,85 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef RING_BUFFER_HH
+#define RING_BUFFER_HH
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+#include <cstddef>
+
+/* FIFO queue in a circular array of slots. Unlike std::deque, it
+   allocates only to grow (doubling) and never gives memory back, so
+   once it has reached its working size, push and pop never touch the
+   allocator. A popped slot is left holding a moved-from T. */
+
+template <class T>
+class RingBuffer
+{
+private:
+    std::vector<T> slots_;
+    size_t head_ = 0, size_ = 0;
+
+    size_t index( const size_t offset ) const
+    {
+        const size_t i = head_ + offset;
+        return i < slots_.size() ? i : i - slots_.size();
+    }
+
+    void grow( const size_t capacity )
+    {
+        std::vector<T> bigger( capacity );
+        for ( size_t i = 0; i < size_; i++ ) {
+            bigger[ i ] = std::move( slots_[ index( i ) ] );
+        }
+
+        slots_.swap( bigger );
+        head_ = 0;
+    }
+
+public:
+    explicit RingBuffer( const size_t capacity = 0 ) : slots_( capacity ) {}
+
+    /* make room for capacity elements in all */
+    void reserve( const size_t capacity )
+    {
+        if ( slots_.size() < capacity ) {
+            grow( capacity );
+        }
+    }
+
+    void push( T value )
+    {
+        if ( size_ == slots_.size() ) {
+            grow( std::max( size_t( 16 ), 2 * slots_.size() ) );
+        }
+
+        slots_[ index( size_ ) ] = std::move( value );
+        size_++;
+    }
+
+    T & front( void ) { assert( size_ ); return slots_[ head_ ]; }
+    const T & front( void ) const { assert( size_ ); return slots_[ head_ ]; }
+
+    T & back( void ) { assert( size_ ); return slots_[ index( size_ - 1 ) ]; }
+    const T & back( void ) const { assert( size_ ); return slots_[ index( size_ - 1 ) ]; }
+
+    /* remove the front element, handing it back */
+    T pop( void )
+    {
+        assert( size_ );
+
+        T ret = std::move( slots_[ head_ ] );
+        head_ = index( 1 );
+        size_--;
+
+        return ret;
+    }
+
+    bool empty( void ) const { return size_ == 0; }
+    size_t size( void ) const { return size_; }
+    size_t capacity( void ) const { return slots_.size(); }
+};
+
+#endif /* RING_BUFFER_HH */
@@ -75,6 +75,31 @@ void Socket::connect( const Address & address )
                                       address.size() ) );
 }
 
+/* start connecting a non-blocking socket */
+void Socket::start_connect( const Address & address )
+{
+    if ( 0 == ::connect( fd_num(), &address.to_sockaddr(), address.size() ) ) {
+        return; /* e.g., on loopback */
+    }
+
+    if ( errno != EINPROGRESS ) {
+        throw unix_error( "connect" );
+    }
+}
+
+/* find out how a non-blocking connect ended */
+void Socket::finish_connect( void )
+{
+    int error;
+    getsockopt( SOL_SOCKET, SO_ERROR, error );
+    if ( error ) {
+        throw unix_error( "connect", error );
+    }
+
+    /* the socket became writable, and this was the response */
+    register_write();
+}
+
 /* send datagram to specified address */
 void UDPSocket::sendto( const Address & destination, const string & payload )
 {
@@ -37,6 +37,12 @@ public:
     /* connect socket to a specified peer address */
     void connect( const Address & address );
 
+    /* connect a non-blocking socket: start_connect() returns at once, and
+       finish_connect() throws if the connection failed (call it once the
+       socket is writable) */
+    void start_connect( const Address & address );
+    void finish_connect( void );
+
     /* accessors */
     Address local_address( void ) const;
     Address peer_address( void ) const;
@@ -0,0 +1,168 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cassert>
+
+#include "timer_wheel.hh"
+
+using namespace std;
+
+void TimerWheel::Link::push_back( Link & item )
+{
+    item.prev = prev;
+    item.next = this;
+    prev->next = &item;
+    prev = &item;
+}
+
+void TimerWheel::Link::unlink( void )
+{
+    prev->next = next;
+    next->prev = prev;
+    prev = next = this;
+}
+
+void TimerWheel::Link::splice_back( Link & other )
+{
+    if ( other.empty() ) {
+        return;
+    }
+
+    other.next->prev = prev;
+    prev->next = other.next;
+    other.prev->next = this;
+    prev = other.prev;
+
+    other.prev = other.next = &other;
+}
+
+TimerWheel::Timer::~Timer()
+{
+    if ( pending_ ) {
+        wheel_->cancel( *this );
+    }
+}
+
+TimerWheel::TimerWheel( const uint64_t now )
+    : now_( now ),
+      occupied_(),
+      slots_(),
+      due_()
+{}
+
+void TimerWheel::place( Timer & timer )
+{
+    if ( timer.expiry_ <= now_ ) {
+        timer.level_ = LEVELS;
+        due_.push_back( timer );
+        return;
+    }
+
+    /* the highest digit that differs; the timer's is the greater */
+    const unsigned int level = ( 63 - __builtin_clzll( timer.expiry_ ^ now_ ) ) / BITS;
+    const unsigned int slot = ( timer.expiry_ >> ( level * BITS ) ) & ( SLOTS - 1 );
+
+    timer.level_ = level;
+    timer.slot_ = slot;
+    slots_[ level ][ slot ].push_back( timer );
+    occupied_[ level ] |= uint64_t( 1 ) << slot;
+}
+
+void TimerWheel::schedule( Timer & timer, const uint64_t expiry )
+{
+    cancel( timer );
+
+    timer.wheel_ = this;
+    timer.expiry_ = expiry;
+    timer.pending_ = true;
+    place( timer );
+}
+
+void TimerWheel::cancel( Timer & timer )
+{
+    if ( not timer.pending_ ) {
+        return;
+    }
+
+    assert( timer.wheel_ == this );
+
+    timer.unlink();
+    timer.pending_ = false;
+
+    if ( timer.level_ < LEVELS and slots_[ timer.level_ ][ timer.slot_ ].empty() ) {
+        occupied_[ timer.level_ ] &= ~( uint64_t( 1 ) << timer.slot_ );
+    }
+}
+
+/* Every occupied slot is ahead of the wheel's time in its level, and the
+   lowest occupied level has the soonest; its time is the wheel's, with
+   that level's digit replaced by the slot's and the lower ones zeroed. */
+uint64_t TimerWheel::next_slot( unsigned int & level, unsigned int & slot ) const
+{
+    for ( level = 0; level < LEVELS; level++ ) {
+        if ( occupied_[ level ] ) {
+            slot = __builtin_ctzll( occupied_[ level ] );
+
+            const unsigned int shift = level * BITS;
+            const uint64_t higher = shift + BITS >= 64 ? 0 : ( now_ >> ( shift + BITS ) ) << ( shift + BITS );
+            return higher | ( uint64_t( slot ) << shift );
+        }
+    }
+
+    return NEVER;
+}
+
+uint64_t TimerWheel::next_expiry( void ) const
+{
+    if ( not due_.empty() ) {
+        return now_;
+    }
+
+    unsigned int level = 0, slot = 0;
+    return next_slot( level, slot );
+}
+
+void TimerWheel::advance( const uint64_t now )
+{
+    /* step from slot to slot, moving each slot's timers down a level
+       (or to due_, once the wheel's time is their expiry) */
+    while ( true ) {
+        unsigned int level = 0, slot = 0;
+        const uint64_t next = next_slot( level, slot );
+        if ( next > now ) {
+            break;
+        }
+
+        now_ = next;
+        occupied_[ level ] &= ~( uint64_t( 1 ) << slot );
+
+        Link cascade;
+        cascade.splice_back( slots_[ level ][ slot ] );
+
+        while ( not cascade.empty() ) {
+            Timer & timer = static_cast<Timer &>( *cascade.next );
+            timer.unlink();
+            place( timer );
+        }
+    }
+
+    if ( now > now_ ) {
+        now_ = now;
+    }
+
+    Link running;
+    running.splice_back( due_ );
+
+    try {
+        while ( not running.empty() ) {
+            Timer & timer = static_cast<Timer &>( *running.next );
+            timer.unlink();
+            timer.pending_ = false;
+            timer.callback_();
+        }
+    } catch ( ... ) {
+        /* leave the rest for the next advance */
+        running.splice_back( due_ );
+        due_.splice_back( running );
+        throw;
+    }
+}
@@ -0,0 +1,104 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef TIMER_WHEEL_HH
+#define TIMER_WHEEL_HH
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+
+/* Hierarchical timing wheel (after Varghese and Lauck) for deadlines in
+   microseconds. Eleven levels of 64 slots cover every 64-bit time: a timer
+   sits at the level of the highest base-64 digit in which its expiry
+   differs from the wheel's time, in the slot of its own digit there, and
+   moves down a level when the wheel's time reaches that slot. Scheduling
+   and cancelling are O(1), and a bitmap of each level's occupied slots
+   finds the next expiry without looking at the timers. */
+class TimerWheel
+{
+private:
+    /* circular doubly-linked list (a slot's sentinel, or a timer in it) */
+    struct Link
+    {
+        Link * prev;
+        Link * next;
+
+        Link() : prev( this ), next( this ) {}
+
+        bool empty( void ) const { return next == this; }
+        void push_back( Link & item );
+        void unlink( void );
+        void splice_back( Link & other ); /* moves all of other's items here */
+
+        Link( const Link & other ) = delete;
+        Link & operator=( const Link & other ) = delete;
+    };
+
+public:
+    static const uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+    /* a deadline; cancelled if destroyed while pending */
+    class Timer : private Link
+    {
+    private:
+        friend class TimerWheel;
+
+        std::function<void(void)> callback_;
+        TimerWheel * wheel_;
+        uint64_t expiry_;
+        unsigned int level_, slot_;
+        bool pending_;
+
+    public:
+        Timer( const std::function<void(void)> & callback )
+            : Link(), callback_( callback ), wheel_( nullptr ),
+              expiry_( 0 ), level_( 0 ), slot_( 0 ), pending_( false ) {}
+
+        ~Timer();
+
+        bool pending( void ) const { return pending_; }
+        uint64_t expiry( void ) const { return expiry_; }
+
+        /* forbid copying */
+        Timer( const Timer & other ) = delete;
+        Timer & operator=( const Timer & other ) = delete;
+    };
+
+private:
+    static const unsigned int BITS = 6, SLOTS = 1 << BITS, LEVELS = ( 64 + BITS - 1 ) / BITS;
+
+    uint64_t now_;
+    uint64_t occupied_[ LEVELS ]; /* bit per slot */
+    Link slots_[ LEVELS ][ SLOTS ];
+    Link due_; /* expired, waiting for advance() to run them */
+
+    void place( Timer & timer );
+
+    /* the start of the first occupied slot, or NEVER */
+    uint64_t next_slot( unsigned int & level, unsigned int & slot ) const;
+
+public:
+    TimerWheel( const uint64_t now );
+
+    /* (re)schedule the timer; one already due runs at the next advance() */
+    void schedule( Timer & timer, const uint64_t expiry );
+
+    void cancel( Timer & timer );
+
+    /* move the wheel's time forward, running the callbacks of the timers due
+       by then, in order of expiry (a callback may schedule or cancel timers;
+       those it makes due run at the next advance) */
+    void advance( const uint64_t now );
+
+    /* the next expiry, or an earlier time at which the wheel must advance
+       to find it (never later); NEVER with no timers pending */
+    uint64_t next_expiry( void ) const;
+
+    uint64_t now( void ) const { return now_; }
+
+    /* forbid copying or moving (timers point into the wheel) */
+    TimerWheel( const TimerWheel & other ) = delete;
+    TimerWheel & operator=( const TimerWheel & other ) = delete;
+};
+
+#endif /* TIMER_WHEEL_HH */
@@ -5,24 +5,69 @@
 #include "timestamp.hh"
 #include "exception.hh"
 
-uint64_t raw_timestamp( void )
+using namespace std;
+
+static uint64_t clock_usecs( const clockid_t clock )
 {
     timespec ts;
-    SystemCall( "clock_gettime", clock_gettime( CLOCK_REALTIME, &ts ) );
+    SystemCall( "clock_gettime", clock_gettime( clock, &ts ) );
+
+    uint64_t micros = ts.tv_nsec / 1000;
+    micros += uint64_t( ts.tv_sec ) * 1000000;
 
-    uint64_t millis = ts.tv_nsec / 1000000;
-    millis += uint64_t( ts.tv_sec ) * 1000;
+    return micros;
+}
+
+/* the wall-clock time (for logs) and monotonic time (for intervals)
+   when the first timestamp was taken */
+struct InitialTime
+{
+    uint64_t realtime_ms, monotonic_us;
 
-    return millis;
+    InitialTime()
+        : realtime_ms( clock_usecs( CLOCK_REALTIME ) / 1000 ),
+          monotonic_us( clock_usecs( CLOCK_MONOTONIC ) )
+    {}
+
+    static const InitialTime & get( void )
+    {
+        static const InitialTime initial_time;
+        return initial_time;
+    }
+};
+
+static thread_local const Clock * thread_clock = nullptr;
+
+void set_thread_clock( const Clock * clock )
+{
+    thread_clock = clock;
+}
+
+void VirtualClock::advance_to( const uint64_t usecs )
+{
+    if ( usecs < now_ ) {
+        throw runtime_error( "virtual clock cannot go backwards" );
+    }
+
+    now_ = usecs;
 }
 
 uint64_t initial_timestamp( void )
 {
-    static uint64_t initial_value = raw_timestamp();
-    return initial_value;
+    return InitialTime::get().realtime_ms;
+}
+
+uint64_t timestamp_usecs( void )
+{
+    if ( thread_clock ) {
+        return thread_clock->usecs();
+    }
+
+    const uint64_t start = InitialTime::get().monotonic_us;
+    return clock_usecs( CLOCK_MONOTONIC ) - start;
 }
 
 uint64_t timestamp( void )
 {
-    return raw_timestamp() - initial_timestamp();
+    return timestamp_usecs() / 1000;
 }
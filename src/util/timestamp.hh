@@ -5,7 +5,47 @@
 
 #include <cstdint>
 
+/* milliseconds and microseconds elapsed (on the monotonic clock) since
+   initial_timestamp() was first called */
 uint64_t timestamp( void );
+uint64_t timestamp_usecs( void );
+
+/* wall-clock time in milliseconds when timing started */
 uint64_t initial_timestamp( void );
 
+/* a source of time to use in place of the monotonic clock (in us) */
+class Clock
+{
+public:
+    virtual uint64_t usecs( void ) const = 0;
+    virtual ~Clock() {}
+};
+
+/* time that moves only when told to, for running an emulation offline */
+class VirtualClock : public Clock
+{
+private:
+    uint64_t now_ = 0;
+
+public:
+    uint64_t usecs( void ) const override { return now_; }
+    void advance_to( const uint64_t usecs );
+};
+
+/* make timestamp() and timestamp_usecs() on the calling thread read the
+   given clock (nullptr to go back to the monotonic clock) */
+void set_thread_clock( const Clock * clock );
+
+/* the given clock on the calling thread for as long as this lives */
+class ThreadClockOverride
+{
+public:
+    ThreadClockOverride( const Clock & clock ) { set_thread_clock( &clock ); }
+    ~ThreadClockOverride() { set_thread_clock( nullptr ); }
+
+    /* forbid copying or assigning */
+    ThreadClockOverride( const ThreadClockOverride & other ) = delete;
+    ThreadClockOverride & operator=( const ThreadClockOverride & other ) = delete;
+};
+
 #endif /* TIMESTAMP_HH */
@@ -0,0 +1,85 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef TUN_PACKET_HH
+#define TUN_PACKET_HH
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+/* A TUN device hands over each packet after four bytes of packet
+   information (flags, then the ethertype). A device opened with offloads
+   (IFF_VNET_HDR) puts a virtio-net header between the two. Which layout
+   a packet has is a property of the device, so the functions below are
+   told (vnet_hdr) rather than guessing from the packet. */
+
+const size_t TUN_PI_LENGTH = 4;
+/* struct virtio_net_hdr (linux/virtio_net.h does not build as C++):
+   flags, gso_type, then uint16 hdr_len, gso_size, csum_start, csum_offset */
+const size_t TUN_VNET_HDR_LENGTH = 10;
+/* the largest packet a TUN device without offloads hands over: a
+   1500-byte MTU plus the packet information. mm-link delivers this much
+   per opportunity. */
+const unsigned int PACKET_SIZE = 1500 + TUN_PI_LENGTH;
+
+const unsigned int VNET_GSO_NONE = 0, VNET_GSO_UDP = 3, VNET_GSO_UDP_L4 = 5, VNET_GSO_ECN = 0x80;
+
+/* offset of the IP header */
+inline size_t tun_ip_offset( const bool vnet_hdr )
+{
+    return TUN_PI_LENGTH + ( vnet_hdr ? TUN_VNET_HDR_LENGTH : 0 );
+}
+
+/* The bytes the packet would have taken as MTU-sized datagrams from a TUN
+   device without offloads: a GSO super-packet counts as the segments it
+   stands for, each carrying its own IP and transport headers and packet
+   information. Sets segments to the number of those datagrams. */
+inline size_t tun_wire_size( const char * data, const size_t size, const bool vnet_hdr, size_t & segments )
+{
+    segments = 1;
+
+    if ( not vnet_hdr or size < TUN_PI_LENGTH + TUN_VNET_HDR_LENGTH ) {
+        return size;
+    }
+
+    const size_t plain_size = size - TUN_VNET_HDR_LENGTH;
+
+    const char * const vnet = data + TUN_PI_LENGTH;
+    const unsigned int gso_type = static_cast<unsigned char>( vnet[ 1 ] ) & ~VNET_GSO_ECN;
+    uint16_t gso_size;
+    memcpy( &gso_size, vnet + 4, sizeof( gso_size ) ); /* the device's byte order is native */
+
+    if ( gso_type == VNET_GSO_NONE or gso_size == 0 ) {
+        return plain_size;
+    }
+
+    /* the headers each segment repeats */
+    const unsigned char * const ip = reinterpret_cast<const unsigned char *>( data + TUN_PI_LENGTH + TUN_VNET_HDR_LENGTH );
+    const size_t ip_size = size - TUN_PI_LENGTH - TUN_VNET_HDR_LENGTH;
+    size_t header_length;
+
+    if ( ip_size >= 20 and ( ip[ 0 ] >> 4 ) == 4 ) {
+        header_length = ( ip[ 0 ] & 0x0f ) * 4;
+    } else if ( ip_size >= 40 and ( ip[ 0 ] >> 4 ) == 6 ) {
+        header_length = 40;
+    } else {
+        return plain_size;
+    }
+
+    if ( gso_type == VNET_GSO_UDP or gso_type == VNET_GSO_UDP_L4 ) {
+        header_length += 8;
+    } else if ( ip_size >= header_length + 20 ) { /* TCP */
+        header_length += ( ip[ header_length + 12 ] >> 4 ) * 4;
+    }
+
+    if ( header_length >= ip_size ) {
+        return plain_size;
+    }
+
+    const size_t payload = ip_size - header_length;
+    segments = ( payload + gso_size - 1 ) / gso_size;
+
+    return payload + segments * ( TUN_PI_LENGTH + header_length );
+}
+
+#endif /* TUN_PACKET_HH */
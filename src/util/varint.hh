@@ -0,0 +1,58 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef VARINT_HH
+#define VARINT_HH
+
+#include <string>
+#include <cstdint>
+
+/* LEB128 varints: seven bits per byte, least significant first, with
+   the high bit set on every byte but the last */
+
+inline void encode_varint( uint64_t value, std::string & out )
+{
+    while ( value >= 0x80 ) {
+        out.push_back( char( (value & 0x7f) | 0x80 ) );
+        value >>= 7;
+    }
+
+    out.push_back( char( value ) );
+}
+
+/* returns false if the varint runs past the end or doesn't fit in 64 bits */
+inline bool decode_varint( const char * data, const size_t size, size_t & offset, uint64_t & value )
+{
+    value = 0;
+
+    for ( unsigned int shift = 0; shift < 64; shift += 7 ) {
+        if ( offset >= size ) {
+            return false;
+        }
+
+        const uint64_t byte = static_cast<unsigned char>( data[ offset++ ] );
+        if ( shift == 63 and byte > 1 ) {
+            return false;
+        }
+
+        value |= (byte & 0x7f) << shift;
+
+        if ( not (byte & 0x80) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* signed values, so small magnitudes of either sign stay short */
+inline uint64_t zigzag_encode( const int64_t value )
+{
+    return (uint64_t( value ) << 1) ^ uint64_t( value >> 63 );
+}
+
+inline int64_t zigzag_decode( const uint64_t value )
+{
+    return int64_t( value >> 1 ) ^ -int64_t( value & 1 );
+}
+
+#endif /* VARINT_HH */